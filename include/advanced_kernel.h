@@ -122,8 +122,9 @@ public:
     void schedule();
     void handle_timer_interrupt();
     
-    // 命令行接口
+    // 命令行接口，不指定输出流时输出到 std::cout
     void execute_command(const std::string& command);
+    void execute_command(const std::string& command, std::ostream& out);
     
     // 获取系统信息
     struct SystemInfo {
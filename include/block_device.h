@@ -0,0 +1,106 @@
+// include/block_device.h
+#ifndef BLOCK_DEVICE_H
+#define BLOCK_DEVICE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include "disk_manager.h"
+
+// 块设备：按固定大小的块读写，FileSystem 通过它访问存储
+class BlockDevice {
+public:
+    // 读写统计，可据此计算各后端的吞吐量
+    struct IoStats {
+        uint64_t reads;
+        uint64_t writes;
+        uint64_t bytes_read;
+        uint64_t bytes_written;
+        double read_ms;
+        double write_ms;
+    };
+    
+    BlockDevice(uint32_t block_size, uint64_t block_count);
+    virtual ~BlockDevice() {}
+    
+    // 读写单个块，块号超出范围或底层出错时返回 false。读写与写回在设备内部互斥，
+    // 多个线程可以共享同一设备
+    bool read(uint64_t block, void* buffer);
+    bool write(uint64_t block, const void* buffer);
+    bool flush();
+    
+    uint32_t block_size() const { return bsize; }
+    uint64_t block_count() const { return blocks; }
+    IoStats get_stats() const;
+    
+protected:
+    virtual bool read_block(uint64_t block, void* buffer) = 0;
+    virtual bool write_block(uint64_t block, const void* buffer) = 0;
+    virtual bool flush_device() { return true; }
+    
+    uint32_t bsize;
+    uint64_t blocks;
+    
+private:
+    mutable std::mutex io_mutex;
+    IoStats stats;
+    uint64_t read_ns;
+    uint64_t write_ns;
+};
+
+// 以宿主机上的镜像文件作为块设备
+class FileBlockDevice : public BlockDevice {
+public:
+    // block_count 为 0 时按现有文件大小确定块数，否则不足时扩展文件
+    FileBlockDevice(const std::string& path, uint64_t block_count = 0,
+                    uint32_t block_size = 4096);
+    ~FileBlockDevice();
+    
+    bool is_open() const { return fd >= 0; }
+    
+protected:
+    bool flush_device() override;
+    bool read_block(uint64_t block, void* buffer) override;
+    bool write_block(uint64_t block, const void* buffer) override;
+    
+private:
+    int fd;
+};
+
+// 内存盘：数据只存在于进程内存中
+class RamBlockDevice : public BlockDevice {
+public:
+    RamBlockDevice(uint64_t block_count, uint32_t block_size = 4096);
+    
+protected:
+    bool read_block(uint64_t block, void* buffer) override;
+    bool write_block(uint64_t block, const void* buffer) override;
+    
+private:
+    std::vector<char> data;
+};
+
+// 以 DiskManager 分区中的一个文件作为块设备，I/O 经流式句柄完成；
+// 设备必须在 DiskManager 析构前销毁
+class PartitionBlockDevice : public BlockDevice {
+public:
+    PartitionBlockDevice(DiskManager& disk, const std::string& path,
+                         uint64_t block_count, uint32_t block_size = 4096);
+    ~PartitionBlockDevice();
+    
+    bool is_open() const { return handle && handle->is_open(); }
+    
+protected:
+    bool flush_device() override;
+    bool read_block(uint64_t block, void* buffer) override;
+    bool write_block(uint64_t block, const void* buffer) override;
+    
+private:
+    DiskManager& disk;
+    std::string path;
+    std::unique_ptr<DiskManager::FileHandle> handle;
+};
+
+#endif // BLOCK_DEVICE_H
\ No newline at end of file
@@ -8,9 +8,77 @@
 #include <mutex>
 #include <fstream>
 #include <ctime>
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <list>
+#include <unordered_map>
+
+class SystemLogger;
 
 class DiskManager {
 private:
+    struct BlockInfo {
+        size_t block_number;
+        bool is_free;
+        size_t size;
+        uint64_t birth;   // 分配时的代数，不大于快照代数的块仍被该快照引用
+        uint32_t checksum;  // 最近一次写入后整块的 CRC32C
+        bool checksummed;   // 从未写入过的块没有校验和，读取时不校验
+    };
+
+    // 一段连续的磁盘块
+    struct Extent {
+        size_t start_block;
+        size_t block_count;
+    };
+
+    // 压缩簇：文件按固定逻辑大小切分，每簇单独压缩存放
+    struct Cluster {
+        size_t start_block;
+        size_t block_count;
+        size_t stored_length;   // 磁盘上的字节数
+        bool compressed;        // 压缩无收益时按原样存放
+    };
+
+    // 去重索引中的数据单元：普通文件的一个整块或压缩文件的一个簇
+    struct DedupEntry {
+        size_t start_block;
+        size_t block_count;
+        size_t stored_length;
+        bool compressed;
+        size_t refs;
+    };
+
+    // 共享尾块中的一段，存放文件最后不足一块的数据
+    struct TailSlot {
+        size_t block = 0;
+        size_t offset = 0;
+        size_t length = 0;   // 为 0 表示没有打包的尾部
+    };
+    
+    struct TailBlock {
+        size_t live_bytes;
+        std::map<size_t, size_t> free_ranges;  // 块内偏移 -> 空闲长度
+        std::string mount_point;               // 只打包同一分区的尾部
+    };
+
+    struct FileEntry {
+        std::string name;
+        std::string type;
+        size_t size;
+        time_t modified_time;
+        std::vector<Extent> extents;  // 按文件偏移顺序排列，只含整块数据
+        std::string inline_data;      // 小文件内容直接存放在条目中
+        TailSlot tail;
+        bool compressed = false;      // 为真时数据位于 clusters 而非 extents
+        std::vector<Cluster> clusters;
+    };
+    
+    // 目录树：目录路径 -> 条目表，两层均以共享指针保存以便写时复制
+    typedef std::vector<FileEntry> Directory;
+    typedef std::map<std::string, std::shared_ptr<Directory>> Tree;
+    
     struct Partition {
         std::string name;
         size_t size;
@@ -18,51 +86,158 @@ private:
         std::string mount_point;
         bool is_mounted;
         std::string filesystem_type;
+        bool compressed;   // 新写入的文件按簇压缩存放
+        bool deduplicated; // 新写入的整块与压缩簇按内容去重
+        size_t dedup_logical_blocks;   // 去重单元被引用的总块数
+        size_t dedup_physical_blocks;  // 去重单元实际占用的块数
+        std::shared_ptr<Tree> tree;    // 挂载后的目录树，可与快照共享
+        uint64_t snapshot_generation;  // 最新快照的代数，0 表示没有快照
         
         Partition(std::string n, size_t s) 
             : name(n), size(s), used_space(0), is_mounted(false),
-              filesystem_type("ext4") {}
+              filesystem_type("ext4"), compressed(false), deduplicated(false),
+              dedup_logical_blocks(0), dedup_physical_blocks(0),
+              snapshot_generation(0) {}
     };
     
-    struct BlockInfo {
-        size_t block_number;
-        bool is_free;
-        size_t size;
-    };
-
-    struct FileEntry {
+    // 分区快照：共享创建时的目录树，deadlist 记录当前版本已释放、
+    // 但仍被本快照引用的块
+    struct Snapshot {
         std::string name;
-        std::string type;
-        size_t size;
-        time_t modified_time;
-        size_t start_block;
-        size_t block_count;
+        std::string partition;
+        uint64_t generation;
+        time_t created_time;
+        std::shared_ptr<Tree> tree;
+        std::vector<size_t> deadlist;
+        size_t used_space;
     };
     
     std::string disk_file;
+    int disk_fd;
     size_t total_size;
     size_t block_size;
     std::vector<Partition> partitions;
     std::vector<BlockInfo> block_map;
-    std::map<std::string, std::vector<FileEntry>> filesystem;
+    std::shared_ptr<Tree> detached_tree;   // 不属于任何已挂载分区的路径
+    std::vector<Snapshot> snapshots;       // 按创建顺序排列
+    uint64_t generation;
+    std::map<size_t, TailBlock> tail_blocks;
+    std::unordered_map<std::string, DedupEntry> dedup_index;  // 分区+类型+SHA-256 -> 单元
+    std::unordered_map<size_t, std::string> block_hash;       // 单元起始块 -> 索引键
+    size_t inline_limit;
+    size_t tail_limit;
+    size_t disk_reads;
+    size_t disk_writes;
+    
+    // 解压后的簇缓存（LRU），按簇起始块号索引
+    std::list<std::pair<size_t, std::vector<char>>> cluster_cache;
+    std::unordered_map<size_t, std::list<std::pair<size_t, std::vector<char>>>::iterator> cache_index;
+    size_t cache_capacity;
+    
+    // 压缩统计
+    size_t compress_input_bytes;
+    size_t compress_output_bytes;
+    uint64_t compress_ns;
+    uint64_t decompress_ns;
+    size_t cache_hits;
+    size_t cache_misses;
+    
+    // 块校验统计，读取出错时经 logger 报告
+    SystemLogger* logger;
+    uint64_t checksum_ns;
+    uint64_t read_ns;
+    size_t verified_bytes;
+    size_t checksum_errors;
+    bool verify_reads;
+    std::vector<char> read_scratch;   // 非块对齐读取时读入整块的缓冲区
+    
     std::mutex disk_mutex;
     
-    // 磁盘文件操作
+    // 磁盘文件操作；读取时校验所涉及各块的 CRC32C，不符时返回 false
     bool write_to_disk(size_t offset, const void* data, size_t size);
     bool read_from_disk(size_t offset, void* buffer, size_t size);
+    void update_checksums(size_t offset, const char* data, size_t size);
+    bool verify_blocks(size_t first_block, const char* data, size_t count);
+    void copy_checksums(size_t src_offset, size_t dst_offset, size_t size);
     size_t allocate_blocks(size_t size);
     void free_blocks(size_t start_block, size_t count);
     
+    // 文件定位与按偏移读写（调用者需持有 disk_mutex）
+    std::string find_mount_point(const std::string& path) const;
+    Partition* find_partition_by_mount(const std::string& mount_point);
+    std::shared_ptr<Tree>& tree_for(const std::string& path);
+    Directory& directory(const std::string& path);
+    const Directory* find_directory(const std::string& path);
+    void erase_directory(const std::string& path);
+    FileEntry* find_entry(const std::string& filename);
+    const FileEntry* lookup_entry(const std::string& filename);
+    FileEntry* create_entry(const std::string& filename, const std::string& type);
+    size_t map_offset(const FileEntry& entry, size_t offset, size_t& run) const;
+    size_t allocated_bytes(const FileEntry& entry) const;
+    bool reserve_space(FileEntry& entry, size_t size, const std::string& mount_point);
+    void release_extents(FileEntry& entry, const std::string& mount_point);
+    
+    // 小文件内联与尾部打包
+    size_t packed_length(const FileEntry& entry) const;
+    bool allocate_tail(size_t length, TailSlot& slot, const std::string& mount_point);
+    void free_tail(TailSlot& slot, const std::string& mount_point);
+    void trim_extents(FileEntry& entry, size_t keep_blocks, const std::string& mount_point);
+    void pack_tail(FileEntry& entry, const std::string& mount_point);
+    bool unpack_tail(FileEntry& entry, const std::string& mount_point);
+    bool store_content(FileEntry& entry, const std::string& mount_point,
+                       const char* data, size_t size);
+    
+    // 内容去重：共享单元带引用计数，写入前复制
+    std::string dedup_key(const std::string& mount_point, char kind,
+                          const char* data, size_t length) const;
+    size_t release_blocks(size_t start_block, size_t count, const std::string& mount_point);
+    void replace_block(FileEntry& entry, size_t file_block, size_t new_block);
+    bool unshare_range(FileEntry& entry, const std::string& mount_point,
+                       size_t begin, size_t end);
+    bool append_block(FileEntry& entry, const std::string& mount_point, const char* data);
+    void dedup_extents(FileEntry& entry, const std::string& mount_point);
+    
+    // 快照：释放的块若仍被快照引用则转入其 deadlist
+    void retire_blocks(size_t start_block, size_t count, const std::string& mount_point);
+    Snapshot* latest_snapshot(const std::string& partition);
+    void drop_snapshot(size_t index);
+    void collect_blocks(const Tree& tree, std::unordered_map<size_t, size_t>& blocks) const;
+    void rebuild_references(Partition& part);
+    
+    // 压缩簇读写
+    const std::vector<char>* cluster_data(const Cluster& cluster);
+    bool load_cluster(const FileEntry& entry, size_t index, std::vector<char>& data);
+    bool store_cluster(FileEntry& entry, const std::string& mount_point,
+                       size_t index, const char* data, size_t length);
+    void free_cluster(Cluster& cluster, const std::string& mount_point);
+    void cache_insert(size_t start_block, const std::vector<char>& data);
+    void cache_erase(size_t start_block);
+    size_t write_clusters(FileEntry& entry, const std::string& mount_point,
+                          size_t offset, const char* data, size_t size);
+    
+    size_t read_at(const FileEntry& entry, size_t offset, void* buffer, size_t size);
+    size_t write_at(FileEntry& entry, const std::string& mount_point,
+                    size_t offset, const void* data, size_t size);
+    bool copy_on_disk(size_t src_offset, size_t dst_offset, size_t size);
+    
 public:
     DiskManager(const std::string& disk_file, size_t size, size_t block_size = 4096);
     ~DiskManager();
     
+    // 校验和不符等磁盘错误写入该日志，logger 须比 DiskManager 存活更久
+    void set_logger(SystemLogger* logger);
+    // 关闭后读取不再校验（写入仍维护校验和），用于测量校验开销或底层存储自带校验时
+    void set_read_verification(bool enabled);
+    
     // 分区管理
     bool create_partition(const std::string& name, size_t size);
     bool delete_partition(const std::string& name);
     bool mount_partition(const std::string& name, const std::string& mount_point);
     bool unmount_partition(const std::string& name);
     bool format_partition(const std::string& name);
+    // 只影响之后新写入或截断重写的文件
+    bool set_partition_compression(const std::string& name, bool enabled);
+    bool set_partition_dedup(const std::string& name, bool enabled);
     
     // 文件系统操作
     struct FileInfo {
@@ -80,12 +255,100 @@ public:
     bool delete_directory(const std::string& dirname);
     bool write_file(const std::string& filename, const std::string& content);
     std::string read_file(const std::string& filename);
+    bool copy_file(const std::string& source, const std::string& destination);
+    
+    // 流式文件句柄：按块读写，内存占用与文件大小无关
+    enum class OpenMode {
+        READ,        // 只读，文件必须存在
+        WRITE,       // 创建或截断
+        APPEND,      // 创建或追加
+        READ_WRITE   // 读写，文件必须存在
+    };
+    
+    class FileHandle {
+    public:
+        ~FileHandle();
+        
+        size_t read(void* buffer, size_t size);
+        size_t write(const void* data, size_t size);
+        bool seek(long long offset, int whence = SEEK_SET);
+        size_t tell() const { return position; }
+        size_t size();
+        // 写回缓存的压缩簇但保持句柄打开；尾部打包与去重仍留到 close()
+        bool flush();
+        void close();
+        bool is_open() const { return open; }
+        
+    private:
+        friend class DiskManager;
+        FileHandle(DiskManager& dm, const std::string& file, OpenMode m);
+        
+        DiskManager& disk;
+        std::string filename;
+        OpenMode mode;
+        size_t position;
+        bool open;
+        bool dirty;
+        
+        // 压缩文件的写缓冲：最多缓存一个簇，离开该簇或关闭时写回
+        std::vector<char> pending;
+        size_t pending_cluster;
+        bool has_pending;
+        bool flush_pending(FileEntry& entry, const std::string& mount_point);
+        // 写回缓存的簇后只读查找条目，没有待写的簇时不触发写时复制（调用者需持有 disk_mutex）
+        const FileEntry* settled_entry();
+    };
+    
+    // 句柄必须在 DiskManager 析构前关闭
+    std::unique_ptr<FileHandle> open_file(const std::string& filename,
+                                          OpenMode mode = OpenMode::READ);
+    
+    // 文件内容在镜像中的布局，供 sendfile 等零拷贝路径直接从镜像发送：整块区段给出
+    // 镜像偏移，内联、尾部打包与压缩的部分读出后直接给出内容。镜像区段不经过校验和检查，
+    // 调用者发送完成前文件不应被修改或删除
+    struct FileSegment {
+        uint64_t image_offset;
+        size_t length;
+        std::string data;   // 非空时为内容本身
+    };
+    bool get_file_layout(const std::string& filename, std::vector<FileSegment>& segments);
+    int image_descriptor() const { return disk_fd; }
     
     // 空间管理
     size_t get_free_space() const;
     size_t get_used_space() const;
     size_t get_total_space() const;
     
+    // 不超过 inline_bytes 的文件内联存放；不超过 tail_bytes 的尾部打包进共享块
+    void set_small_file_policy(size_t inline_bytes, size_t tail_bytes);
+    
+    struct StorageStats {
+        size_t total_files;
+        size_t inline_files;
+        size_t packed_tails;
+        size_t tail_blocks;
+        size_t logical_bytes;     // 文件内容总字节数
+        size_t allocated_bytes;   // 实际占用的磁盘字节数
+        size_t unpacked_bytes;    // 每个文件按整块分配时需要的字节数
+        size_t disk_reads;        // 镜像读操作次数
+        size_t disk_writes;       // 镜像写操作次数
+        size_t compressed_files;
+        size_t compress_input_bytes;   // 送入压缩器的字节数
+        size_t compress_output_bytes;  // 压缩后写入磁盘的字节数
+        double compress_ms;            // 累计压缩耗时
+        double decompress_ms;          // 累计解压耗时
+        size_t cache_hits;
+        size_t cache_misses;
+        size_t dedup_units;            // 去重索引中的单元数
+        size_t dedup_saved_bytes;      // 因共享而少占用的字节数
+        size_t verified_bytes;         // 读取时经过校验的字节数
+        size_t checksum_errors;        // 校验和不符的块数
+        double checksum_ms;            // 计算与校验 CRC32C 的累计耗时
+        double read_ms;                // 镜像读操作的累计耗时
+    };
+    
+    StorageStats get_storage_stats();
+    
     // 分区信息
     struct PartitionInfo {
         std::string name;
@@ -93,10 +356,30 @@ public:
         size_t used_space;
         std::string mount_point;
         bool is_mounted;
+        bool compressed;
+        bool deduplicated;
+        double dedup_ratio;   // 逻辑引用块数 / 实际占用块数
     };
     
     std::vector<PartitionInfo> list_partitions() const;
     PartitionInfo get_partition_info(const std::string& name) const;
+    
+    // 分区快照：创建为 O(1)，之后的修改按写时复制进行
+    struct SnapshotInfo {
+        std::string name;
+        std::string partition;
+        time_t created_time;
+        size_t held_bytes;    // 仅被该快照引用、尚未回收的字节数
+    };
+    
+    bool create_snapshot(const std::string& partition, const std::string& name);
+    bool delete_snapshot(const std::string& partition, const std::string& name);
+    // 回滚到指定快照，之后创建的快照一并删除
+    bool rollback(const std::string& partition, const std::string& name);
+    std::vector<SnapshotInfo> list_snapshots(const std::string& partition = "") const;
+    // 按快照时的内容读取文件，用于备份
+    std::string read_snapshot_file(const std::string& partition, const std::string& snapshot,
+                                   const std::string& filename);
 };
 
 #endif // DISK_MANAGER_H
\ No newline at end of file
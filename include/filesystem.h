@@ -4,12 +4,30 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <list>
+#include <map>
+#include <memory>
 #include <ctime>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include "types.h"
 
 #define BLOCK_SIZE 4096
 #define MAX_FILENAME 256
-#define MAX_BLOCKS_PER_FILE 1024
+#define DIRECT_BLOCKS 12
+#define POINTERS_PER_BLOCK (BLOCK_SIZE / sizeof(uint32_t))
+#define ROOT_INODE 1
+#define FS_CACHE_BLOCKS 1024
+#define FS_WRITEBACK_BYTES (16 * 1024 * 1024)   // 页缓存中待写回的数据超过此值时写回
+#define FS_WRITEBACK_SECONDS 5                  // 页在缓存中停留超过此秒数时写回
+#define FS_CHECK_MAX_PROBLEMS 100               // 检查报告中保留的问题描述条数
+#define FS_CHECK_ONLINE_PASSES 3                // 在线检查被并发修改干扰时重试的遍数
+#define FS_SCRUB_BATCH 256                      // 巡检每次持锁复制位图与校验和的块数
+
+class BlockDevice;
 
 // 文件系统超级块
 struct SuperBlock {
@@ -18,30 +36,53 @@ struct SuperBlock {
     uint32_t total_blocks;   // 总块数
     uint32_t free_blocks;    // 空闲块数
     uint32_t first_data_block; // 第一个数据块的位置
+    uint32_t bitmap_block;     // 空闲位图的起始块
+    uint32_t bitmap_blocks;
+    uint32_t checksum_block;   // 每块一个 CRC32 的校验和表的起始块
+    uint32_t checksum_blocks;
+    uint32_t inode_table_block; // inode 表的起始块
+    uint32_t inode_count;
 };
 
-// 文件条目
+// 文件条目（紧凑 inode）：名字存放在所属目录的数据块中，
+// 数据块通过直接指针和一级、二级间接块定位，块号 0 表示未分配
 struct FileEntry {
-    char name[MAX_FILENAME];
-    size_t size;
-    uint32_t blocks[MAX_BLOCKS_PER_FILE];
-    uint32_t block_count;
-    bool is_directory;
-    uint32_t permissions;
-    time_t created_time;
-    time_t modified_time;
-    time_t accessed_time;
+    uint64_t size;
+    uint32_t direct[DIRECT_BLOCKS];
+    uint32_t indirect;          // 指向存放块号的一级间接块
+    uint32_t double_indirect;   // 指向存放一级间接块号的二级间接块
+    uint16_t mode;              // 类型位与权限位
+    uint16_t links;             // 为 0 表示 inode 空闲
+    uint32_t created_time;
+    uint32_t modified_time;
+    uint32_t accessed_time;
+};
+
+#define INODE_DIRECTORY 0x4000
+#define INODE_PERMISSIONS 0x0FFF
+
+// 目录块中的变长目录项，rec_len 覆盖到下一项（或块尾）为止
+struct DirEntry {
+    uint32_t inode;      // 为 0 表示空闲项
+    uint16_t rec_len;
+    uint8_t name_len;
+    uint8_t file_type;   // 1 普通文件，2 目录
 };
 
+// 各操作在内部加锁；挂载期间后台线程定期检查页缓存，数据停留超过 FS_WRITEBACK_SECONDS 时写回。
+// mount、unmount 与 format 不应与其他调用并发
 class FileSystem {
 public:
     FileSystem();
     ~FileSystem();
     
     // 文件系统操作
+    // device 为镜像文件路径；为空或 "ram" 时挂载 format(size) 创建的内存盘
     bool mount(const std::string& device, const std::string& mount_point);
+    bool mount(BlockDevice& device, const std::string& mount_point);
     bool unmount();
     bool format(uint32_t size);
+    bool format(BlockDevice& device);
     
     // 文件操作
     bool create_file(const std::string& path);
@@ -51,23 +92,187 @@ public:
     bool create_directory(const std::string& path);
     bool is_directory(const std::string& path);
     std::vector<std::string> list_directory(const std::string& path);
-
+    
+    // 为页缓存中的文件数据分配块并写回，随后写回块缓存和元数据。
+    // 上次 sync() 之后后台写回失败过时同样返回 false
+    bool sync();
+    
+    // 块缓存与页缓存统计
+    struct CacheStats {
+        size_t hits;
+        size_t misses;
+        size_t cached_blocks;
+        size_t dirty_blocks;
+        size_t pending_files;   // 页缓存中尚未分配块的文件数
+        size_t pending_bytes;
+        size_t reserved_blocks;     // 为页缓存预留、写回时才分配的块数（含间接块）
+        size_t writeback_errors;    // 后台写回失败的次数
+    };
+    CacheStats get_cache_stats() const;
+    
+    // 一致性检查与巡检报告
+    struct CheckReport {
+        bool superblock_ok;
+        size_t groups;              // 检查的分配组数
+        size_t inodes;              // 检查的在用 inode 数
+        size_t bad_pointers;        // 越界或指向元数据区的块号
+        size_t duplicate_blocks;    // 已被其他 inode 引用的块
+        size_t unallocated_blocks;  // 被引用但位图中为空闲的块
+        size_t leaked_blocks;       // 位图中已用但无人引用的块
+        size_t count_errors;        // 空闲块、空闲 inode 计数与实际不符
+        size_t directory_errors;    // 损坏的目录项或指向空闲 inode 的名字
+        size_t link_errors;         // 被多个名字引用的 inode
+        size_t orphan_inodes;       // 在用但从根目录不可达的 inode
+        size_t checksum_errors;     // 巡检时读取失败或校验和不符的块
+        size_t bytes_scanned;
+        size_t repaired;
+        std::vector<std::string> problems;  // 至多 FS_CHECK_MAX_PROBLEMS 条问题描述
+    };
+    // 检查超级块、位图与 inode 引用以及目录结构。只检查时在线进行，inode 表每段、位图每组
+    // 各持锁一次，期间文件系统被修改且发现错误时重新检查，几遍都不稳定时持锁完整检查一遍。
+    // repair 为 true 是唯一的离线模式：全程独占文件系统，按分配组并行扫描后就地修复，
+    // 孤立 inode 移入 /lost+found。threads 为 0 时使用全部核心
+    CheckReport check(bool repair = false, unsigned threads = 0);
+    // 在线巡检：读出所有已用数据块并核对校验和，bytes_per_second 为 0 时不限速。
+    // 每批块只在复制位图与校验和时持锁，读设备与限速等待不阻塞其他操作
+    CheckReport scrub(size_t bytes_per_second = 0, unsigned threads = 0);
+    
 protected:
     // 内部辅助函数
     uint32_t allocate_block();
     void free_block(uint32_t block_number);
+    
+    // 空闲位图：按 64 位字扫描，每个位图块对应一个分配组
+    bool block_is_free(uint32_t block_number) const;
+    uint32_t find_free(uint32_t from, uint32_t end) const;
+    uint32_t free_run_length(uint32_t start, uint32_t limit) const;
+    void mark_run(uint32_t start, uint32_t count, bool free);
+    // 从 goal 附近分配至多 max_count 个连续块，返回起始块号并通过 count 给出实际块数；
+    // 无空闲块时返回 (uint32_t)-1
+    uint32_t allocate_run(uint32_t goal, uint32_t max_count, uint32_t& count);
     FileEntry* find_file(const std::string& path);
     std::string get_filename(const std::string& path) {
         size_t pos = path.find_last_of("/");
         return (pos == std::string::npos) ? path : path.substr(pos + 1);
     }
-
+    
+    // 块读写，经写回式 LRU 缓存访问设备
+    bool read_block(uint32_t block_number, void* buffer);
+    bool write_block(uint32_t block_number, const void* buffer);
+    char* cache_block(uint32_t block_number, bool load);
+    // 仍在块缓存中时返回其内容，不读设备、不调整 LRU 顺序
+    const char* cached_data(uint32_t block_number) const;
+    void drop_cached(uint32_t block_number);
+    bool flush_cache();
+    bool write_back(uint32_t block_number, const char* data);
+    
+    // 超级块、位图与 inode 表的持久化
+    bool load_metadata();
+    bool store_metadata();
+    
+    // inode 与块映射
+    uint32_t allocate_inode(uint16_t mode);
+    void free_inode(uint32_t ino);
+    uint32_t map_indirect(uint32_t& table, uint32_t slot, bool allocate, bool zero_new,
+                          uint32_t data_block);
+    uint32_t map_block(FileEntry& inode, uint32_t index, bool allocate, uint32_t data_block = 0);
+    void release_blocks(FileEntry& inode, uint64_t keep = 0);
+    
+    // 延迟分配：write_file 的数据先进入页缓存，写回时按最终大小一次分配块
+    bool flush_file(uint32_t ino);
+    bool flush_pending();
+    bool writeback_due() const;
+    void discard_pending(uint32_t ino);
+    bool sync_all();
+    
+    // 后台写回线程，mount 时启动、unmount 时停止
+    void flusher_loop();
+    void stop_flusher();
+    
+    // 以下为公有操作的不加锁版本，调用者需持有 fs_mutex
+    bool mount_device(BlockDevice& device, const std::string& mount_point);
+    bool format_device(BlockDevice& device);
+    bool make_directory(const std::string& path);
+    
+    // 目录项与路径解析
+    struct DirIndex {
+        std::unordered_map<std::string, std::pair<uint32_t, uint32_t>> names;  // 名字 -> (inode, 目录块序号)
+        uint32_t search_from;   // 插入新项时从这一目录块开始找空位
+    };
+    DirIndex& directory_index(uint32_t dir);
+    uint32_t resolve(const std::string& path);
+    uint32_t resolve_parent(const std::string& path, std::string& name);
+    uint32_t lookup(uint32_t dir, const std::string& name);
+    bool add_entry(uint32_t dir, const std::string& name, uint32_t ino, uint8_t type);
+    bool remove_entry(uint32_t dir, const std::string& name);
+    std::vector<std::pair<std::string, uint32_t>> read_entries(uint32_t dir);
+    
+    // 一致性检查
+    struct CheckState;
+    typedef std::function<bool(uint32_t block, uint64_t index)> BlockVisitor;
+    bool check_read(CheckState& state, uint32_t block_number, void* buffer);
+    void walk_blocks(FileEntry& inode, CheckState& state, const BlockVisitor& visit);
+    bool check_superblock(CheckState& state);
+    void check_inode(uint32_t ino, CheckState& state);
+    bool check_dir_block(char* block, uint32_t dir, CheckState& state, unsigned& dots);
+    void repair_inode(uint32_t ino, CheckState& state);
+    void check_group(uint32_t group, CheckState& state);
+    void check_tree(CheckState& state);
+    void check_free_blocks(CheckState& state);
+    CheckReport check_locked(bool repair, unsigned threads);
+    CheckReport check_online(unsigned threads);
+    bool begin_scan();
+    void end_scan();
+    
 private:
     SuperBlock superblock;
-    std::vector<bool> block_bitmap;
-    std::vector<FileEntry> file_table;
+    std::vector<uint64_t> bitmap_words;     // 1 表示空闲，超出总块数的位恒为 0
+    std::vector<uint32_t> group_free;       // 每个分配组的空闲块数
+    std::vector<uint32_t> block_crc;        // 每块最近一次写入设备时的 CRC32
+    uint32_t alloc_goal;                    // 下次分配的起始查找位置
+    std::vector<FileEntry> inode_table;     // 按 inode 号索引，0 号保留
+    std::vector<uint32_t> free_inodes;
+    std::unordered_map<uint32_t, DirIndex> dir_index;   // 已访问目录的名字索引
+    
+    struct PendingFile {
+        std::map<uint32_t, std::vector<char>> pages;  // 块序号 -> 待写回的页
+        uint64_t mapped_blocks;     // 设备上可能已映射的块数，写回时截断到新大小
+        uint64_t reserved_blocks;   // 写回时还需新分配的块数，含间接块
+        time_t dirty_since;
+    };
+    std::unordered_map<uint32_t, PendingFile> pending;  // 按 inode 号索引的页缓存
+    size_t pending_bytes;
+    uint64_t reserved_blocks;       // 各文件预留之和，其余分配不得动用
+    bool writeback_error;           // 后台写回失败后置位，由下一次 sync() 报告并清除
+    size_t writeback_errors;
+    
+    BlockDevice* device;                        // 已挂载或正在格式化的设备
+    std::unique_ptr<BlockDevice> owned_device;  // format(size) 创建的内存盘或按路径打开的镜像
+    
+    struct CachedBlock {
+        uint32_t block;
+        bool dirty;
+        std::vector<char> data;
+    };
+    std::list<CachedBlock> block_cache;
+    std::unordered_map<uint32_t, std::list<CachedBlock>::iterator> cache_index;
+    size_t cache_capacity;
+    size_t cache_hits;
+    size_t cache_misses;
+    
     std::string mount_point;
     bool mounted;
+    
+    mutable std::mutex fs_mutex;
+    std::condition_variable flusher_wake;
+    std::thread flusher;
+    bool flusher_stop;
+    
+    // 在线检查与巡检不全程持锁：位图、inode 分配或目录项每次改动都使计数加一，
+    // 据此判断检查结果是否一致；卸载前等待进行中的扫描退出
+    uint64_t metadata_changes;
+    unsigned active_scans;
+    std::condition_variable scans_done;
 };
 
 #endif // FILESYSTEM_H
\ No newline at end of file
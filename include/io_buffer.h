@@ -0,0 +1,94 @@
+// include/io_buffer.h
+#ifndef IO_BUFFER_H
+#define IO_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define IO_BUFFER_SIZE (16 * 1024)      // 每个池化缓冲的数据字节数
+#define IO_SLAB_BUFFERS 64              // 池不足时一次向系统申请的缓冲数
+
+class BufferPool;
+
+// 池中的一个缓冲，头部之后紧跟 IO_BUFFER_SIZE 字节数据。
+// 引用计数归零时回到所属的池，不经过 malloc/free
+struct alignas(64) PooledBuffer {
+    std::atomic<uint32_t> refs;
+    BufferPool* pool;
+    PooledBuffer* next_free;
+    
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+    const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+};
+
+// 池化缓冲中的一段数据。复制只增加引用计数，最后一个切片析构时缓冲归还到池中；
+// 与 shared_ptr 一样，不同线程可以各自持有同一缓冲的切片
+class BufferSlice {
+public:
+    BufferSlice() : buffer(nullptr), offset(0), length(0) {}
+    // 为 buffer 增加一个引用
+    BufferSlice(PooledBuffer* buffer, uint32_t offset, uint32_t length);
+    BufferSlice(const BufferSlice& other);
+    BufferSlice(BufferSlice&& other) noexcept;
+    BufferSlice& operator=(BufferSlice other) noexcept;
+    ~BufferSlice();
+    
+    const char* data() const { return buffer ? buffer->data() + offset : nullptr; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    
+    // 共享同一缓冲的子切片，越界部分被截掉
+    BufferSlice sub(size_t start, size_t count = std::string::npos) const;
+    void remove_prefix(size_t count);
+    // next 在同一缓冲中紧接本切片时并入本切片并返回 true
+    bool extend(const BufferSlice& next);
+    std::string to_string() const { return std::string(data(), length); }
+    
+private:
+    PooledBuffer* buffer;
+    uint32_t offset;
+    uint32_t length;
+};
+
+// 固定大小 I/O 缓冲的池：按 IO_SLAB_BUFFERS 个缓冲一块向系统申请，之后只在空闲链表上收发。
+// 由 create 创建、retire 退役；退役后仍有切片在外时，最后一个缓冲归还时才释放整个池
+class BufferPool {
+public:
+    struct Stats {
+        size_t buffers;         // 已申请的缓冲总数
+        size_t free;            // 空闲链表中的缓冲数
+        uint64_t acquired;      // 累计取出次数
+        uint64_t slabs;         // 累计向系统申请的块数
+    };
+    
+    static BufferPool* create(size_t reserve = IO_SLAB_BUFFERS);
+    void retire();
+    
+    // 取出的缓冲引用计数为 1，由调用者以 release 或切片析构归还；内存不足时返回 nullptr
+    PooledBuffer* acquire();
+    static void release(PooledBuffer* buffer);
+    Stats get_stats() const;
+    
+private:
+    BufferPool();
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    
+    bool grow(size_t count);
+    void put(PooledBuffer* buffer);
+    
+    mutable std::mutex mutex;
+    PooledBuffer* free_list;
+    std::vector<void*> slabs;
+    size_t total;
+    size_t free_count;
+    uint64_t acquired;
+    bool retired;
+};
+
+#endif // IO_BUFFER_H
\ No newline at end of file
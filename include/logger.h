@@ -9,6 +9,46 @@
 #include <mutex>
 #include <fstream>
 #include <deque>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <memory>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <limits>
+#include <unordered_map>
+
+#define LOG_RING_CAPACITY 8192      // 无锁队列槽数，必须是 2 的幂
+#define LOG_WRITER_INTERVAL_MS 10   // 后台写线程无事可做时的最长休眠时间
+#define LOG_BATCH_BYTES (64 * 1024) // 写缓冲累积到此大小时写入文件
+#define LOG_FLUSH_INTERVAL_MS 200   // 条目在写缓冲中停留的最长时间
+#define LOG_ROTATION_BYTES (16 * 1024 * 1024)   // 默认的轮转大小
+#define LOG_MAX_SEGMENTS 8                      // 默认保留的历史分段数
+#define LOG_HISTORY_ENTRIES 100000  // 内存中保留的条目数默认值
+#define LOG_INDEX_BLOCK 1024        // 分段索引每块覆盖的条目数
+#define LOG_ALL_LEVELS 0x1F         // 按 1 << 级别 组成的级别掩码
+
+// 编译期最低级别（0 DEBUG 至 4 CRITICAL）：低于它的 SLOG_* 调用连同参数一起被编译掉。
+// 未指定时定义了 NDEBUG 的发布构建去掉 DEBUG 级别
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL 1
+#else
+#define LOG_COMPILE_LEVEL 0
+#endif
+#endif
+
+// 二进制日志文件以 LOG_BINARY_MAGIC 开头，随后是记录序列（主机字节序）：
+//   'F' u32 编号, u16 长度, 格式串          格式串定义，在文件中首次使用前写出
+//   'E' i64 时间戳, u8 级别, u32 格式串编号, u16 来源长度, u16 参数长度, 来源, 参数
+// 参数依次为 'i' i64、'u' u64、'd' double 或 's' u16 长度加字节；编号 0 的格式串为 "{}"
+#define LOG_BINARY_MAGIC "SLG1"
+
+// 分段索引 <分段>.idx：LOG_INDEX_MAGIC, u8 格式（0 文本，1 二进制）, u32 块数, IndexBlock 数组,
+// u32 格式串数, 每个格式串为 u32 编号, u16 长度, 内容。偏移是未压缩文件中的字节位置
+#define LOG_INDEX_MAGIC "SLI1"
 
 class SystemLogger {
 public:
@@ -25,17 +65,29 @@ public:
         LogLevel level;
         std::string message;
         std::string source;
+        uint32_t format_id;     // 结构化条目的格式串编号，普通条目为 0
+        std::string args;       // 结构化条目的原始参数，由后台线程格式化为 message
         
+        LogEntry() : timestamp(0), level(LogLevel::INFO), format_id(0) {}
         LogEntry(LogLevel lvl, const std::string& msg, const std::string& src = "")
-            : level(lvl), message(msg), source(src) {
+            : level(lvl), message(msg), source(src), format_id(0) {
             timestamp = std::time(nullptr);
         }
     };
     
-    SystemLogger(const std::string& file, size_t max_buffer_size = 1000);
+    enum class LogFormat {
+        TEXT,       // 每条一行格式化好的文本
+        BINARY      // 格式串编号加原始参数，由 tools/logdump 转为文本或 JSON
+    };
+    
+    // max_buffer_size 为内存中保留供查询的条目数
+    SystemLogger(const std::string& file, size_t max_buffer_size = LOG_HISTORY_ENTRIES,
+                 LogFormat format = LogFormat::TEXT);
     ~SystemLogger();
     
-    // 日志记录方法
+    // 日志记录方法：条目进入无锁队列后立即返回，由后台线程写入文件；
+    // 队列满时丢弃并计数，critical() 会等待该条目落盘。低于当前级别的条目直接忽略，
+    // 但消息参数已经构造好，热路径上应改用下方的 SLOG_* 宏
     void log(LogLevel level, const std::string& message, 
              const std::string& source = "");
     void debug(const std::string& message, const std::string& source = "");
@@ -44,38 +96,256 @@ public:
     void error(const std::string& message, const std::string& source = "");
     void critical(const std::string& message, const std::string& source = "");
     
-    // 日志查询
+    // 结构化日志：format 中的 {} 依次由参数替换，调用方只记录格式串编号和原始参数，
+    // 格式化推迟到后台线程或 logdump。format 须在进程生命周期内有效，通常是字符串字面量
+    template<typename... Args>
+    void logf(LogLevel level, const char* source, const char* format, const Args&... args) {
+        if(!enabled(level)) {
+            return;
+        }
+        LogEntry entry;
+        entry.timestamp = std::time(nullptr);
+        entry.level = level;
+        entry.source = source;
+        entry.format_id = format_id(format);
+        (pack_arg(entry.args, args), ...);
+        submit(std::move(entry));
+    }
+    
+    // 运行时最低级别，configure() 的 min_level 同样设置它
+    void set_level(LogLevel level) {
+        level_threshold.store(static_cast<int>(level), std::memory_order_relaxed);
+    }
+    LogLevel get_level() const {
+        return static_cast<LogLevel>(level_threshold.load(std::memory_order_relaxed));
+    }
+    // 该级别是否会被记录：编译期比较加一次 relaxed 原子读
+    bool enabled(LogLevel level) const {
+        return static_cast<int>(level) >= LOG_COMPILE_LEVEL &&
+               static_cast<int>(level) >= level_threshold.load(std::memory_order_relaxed);
+    }
+    
+    // 格式串注册表，编号在进程内唯一
+    static uint32_t format_id(const char* format);
+    static std::string format_text(uint32_t id);
+    
+    // 解码参数，每项为类型标记（i/u/d/s）与文本形式；render 按 {} 依次代入
+    typedef std::vector<std::pair<char, std::string>> ArgList;
+    static bool unpack_args(const std::string& args, ArgList& out);
+    static std::string render(const std::string& format, const ArgList& args);
+    
+    // 等待此前进入队列的条目全部写入文件
+    void flush();
+    
+    // 日志查询：只包含后台线程已处理且仍在内存中的条目。按级别查询走级别索引，
+    // 按时间查询在按时间排序的环形存储上二分查找
     std::vector<LogEntry> get_recent_logs(int count) const;
     std::vector<LogEntry> get_logs_by_level(LogLevel level) const;
     std::vector<LogEntry> get_logs_by_timerange(time_t start, time_t end) const;
     
+    // 全文检索内存中的条目：空格分隔的词取交集，OR 分隔的各组取并集，引号内为短语。
+    // 词由字母、数字和下划线组成，不区分大小写，同时匹配消息与来源。结果按时间倒序，至多 limit 条
+    std::vector<LogEntry> search(const std::string& query, uint32_t level_mask = LOG_ALL_LEVELS,
+                                 time_t start = 0, time_t end = std::numeric_limits<time_t>::max(),
+                                 size_t limit = 100) const;
+    
+    // 查询磁盘上的历史日志（已轮转的分段与当前文件），借助分段索引只读取时间和级别
+    // 匹配的块。结果按时间排序，limit 为 0 时不限条数
+    std::vector<LogEntry> get_history(time_t start, time_t end,
+                                      uint32_t level_mask = LOG_ALL_LEVELS,
+                                      size_t limit = 0) const;
+    
     // 日志管理
     void clear_logs();
     void set_buffer_size(size_t size);
     bool export_logs(const std::string& filename) const;
     
-    // 配置
+    // 配置：日志文件超过 rotation_size 字节或 rotation_interval 秒后改名为
+    // <文件名>.<时间>.<微秒> 分段并重新打开，分段由后台线程压缩为 .gz，
+    // 只保留最新的 max_segments 个。各项为 0 时表示不按该条件轮转或不限数量
     struct LogConfig {
         bool console_output;
         bool file_output;
         LogLevel min_level;
         size_t rotation_size;
+        time_t rotation_interval;
+        size_t max_segments;
+        bool compress;
     };
     
     void configure(const LogConfig& config);
 
+    // 异步队列统计
+    struct LoggerStats {
+        uint64_t enqueued;      // 进入队列的条目数
+        uint64_t dropped;       // 队列满时丢弃的条目数
+        uint64_t written;       // 已写入文件的条目数
+        size_t queue_depth;     // 尚未写入文件的条目数
+        uint64_t write_calls;   // 写文件的系统调用次数
+        uint64_t bytes_written;
+        uint64_t rotations;
+        size_t ring_capacity;
+    };
+    LoggerStats get_stats() const;
+    
     // 工具方法
-    std::string level_to_string(LogLevel level) const;
+    static std::string level_to_string(LogLevel level);
     
 private:
     std::string log_file;
-    mutable std::mutex log_mutex;
-    std::deque<LogEntry> log_buffer;
-    size_t buffer_size;
-    std::ofstream log_stream;
+    mutable std::mutex log_mutex;       // 保护内存存储、log_fd 与写缓冲，调用者不持有
     
-    void write_to_file(const LogEntry& entry);
-    void flush_buffer();
+    // 有界环形存储：序号为 seq 的条目位于 store[seq % buffer_size]，
+    // 后台线程保证时间戳随序号不减，因此可按时间二分查找
+    std::vector<LogEntry> store;
+    uint64_t store_begin;               // 最旧条目的序号
+    uint64_t store_end;                 // 下一条目的序号
+    std::deque<uint64_t> level_index[5];    // 每个级别的条目序号
+    time_t last_timestamp;
+    
+    // 全文倒排索引：词 -> 含该词的条目序号（递增）。已淘汰的序号在查询时跳过，
+    // 存储整体轮换一遍后统一清理
+    std::unordered_map<std::string, std::vector<uint64_t>> postings;
+    uint64_t postings_swept;            // 上次清理时的 store_begin
+    
+    // 分段索引的一块：连续若干条目的时间范围、级别掩码与起始偏移
+    struct IndexBlock {
+        int64_t first_time;
+        int64_t last_time;
+        uint64_t offset;
+        uint32_t count;
+        uint32_t level_mask;
+    };
+    std::vector<IndexBlock> file_index;     // 当前文件的索引，轮转时写入 .idx
+    int log_fd;
+    LogFormat file_format;
+    LogConfig log_config;
+    uint64_t file_bytes;                // 当前分段的大小
+    time_t segment_started;
+    std::atomic<bool> clear_requested;  // 由后台线程清空文件
+    
+    // 后台线程把一批条目格式化到写缓冲，按大小或时间一次 write 写出
+    std::string write_buffer;
+    std::string console_buffer;
+    std::vector<std::string> formats;   // 后台线程缓存的格式串
+    std::vector<bool> formats_written;  // 二进制文件中已写出定义的格式串
+    time_t stamp_second;                // stamp_text 对应的秒，同一秒内的条目复用
+    char stamp_text[32];
+    size_t stamp_length;
+    std::atomic<uint64_t> write_calls;
+    std::atomic<uint64_t> bytes_written;
+    std::atomic<uint64_t> rotations;
+    
+    // 多生产者单消费者有界队列：每个槽的序号表明它当前可写还是可读
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogEntry entry;
+    };
+    alignas(64) std::atomic<int> level_threshold;   // 运行时最低级别，与只读的 ring 指针同处一个缓存行
+    std::unique_ptr<Slot[]> ring;
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) size_t dequeue_pos;     // 只由后台线程访问
+    std::atomic<size_t> written_pos;    // 已写入文件的位置，落后于 dequeue_pos 的条目在写缓冲中
+    std::atomic<uint64_t> dropped;
+    
+    std::thread writer;
+    std::mutex wake_mutex;
+    std::condition_variable wake;       // 唤醒后台线程
+    std::condition_variable drained;    // 通知等待 flush 的调用者
+    size_t flush_target;                // 受 wake_mutex 保护
+    bool stopping;
+    
+    // 轮转出的分段交给压缩线程压缩并清理，首次轮转时启动
+    struct SegmentJob {
+        std::string path;
+        bool compress;
+        size_t max_segments;
+    };
+    std::thread compressor;
+    std::mutex compress_mutex;
+    std::condition_variable compress_wake;
+    std::deque<SegmentJob> compress_jobs;
+    bool compress_stopping;
+    
+    template<typename T>
+    static void pack_arg(std::string& out, const T& value) {
+        if constexpr(std::is_floating_point<T>::value) {
+            pack_value(out, 'd', static_cast<double>(value));
+        } else if constexpr(std::is_integral<T>::value && std::is_signed<T>::value) {
+            pack_value(out, 'i', static_cast<int64_t>(value));
+        } else if constexpr(std::is_integral<T>::value) {
+            pack_value(out, 'u', static_cast<uint64_t>(value));
+        } else if constexpr(std::is_enum<T>::value) {
+            pack_value(out, 'i', static_cast<int64_t>(value));
+        } else {
+            pack_string(out, std::string_view(value));
+        }
+    }
+    template<typename T>
+    static void pack_value(std::string& out, char type, T value) {
+        out += type;
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    static void pack_string(std::string& out, std::string_view value);
+    
+    void submit(LogEntry&& entry);
+    bool enqueue(LogEntry&& entry);
+    bool dequeue(LogEntry& entry);
+    void writer_loop();
+    const std::string& cached_format(uint32_t id);
+    void store_entry(LogEntry&& entry);
+    const LogEntry& stored(uint64_t seq) const { return store[seq % store.size()]; }
+    uint64_t seq_bound(time_t t, bool after) const;
+    void index_entry(uint64_t seq, const LogEntry& entry);
+    void sweep_postings();
+    void format_entry(LogEntry& entry);
+    void append_text(const LogEntry& entry, std::string& out);
+    void encode_entry(LogEntry& entry);
+    void write_batch();
+    void truncate_file();
+    void rotate_file();
+    void compress_loop();
+    void prune_segments(size_t max_segments);
+    std::vector<std::string> list_segments() const;
+    bool write_index(const std::string& segment);
+    static bool read_index(const std::string& path, bool& binary, std::vector<IndexBlock>& blocks,
+                           std::vector<std::string>& formats);
+    static void read_blocks(const std::string& path, bool binary, const std::vector<IndexBlock>& blocks,
+                            std::vector<std::string> formats, time_t start, time_t end,
+                            uint32_t level_mask, size_t limit, std::vector<LogEntry>& out);
 };
 
+// 按级别记录日志，级别未启用时不求值其余参数，低于 LOG_COMPILE_LEVEL 的调用不生成代码：
+//   SLOG_DEBUG(logger, "cache miss on block " + std::to_string(block), "DiskManager");
+//   SLOGF_INFO(logger, "Network", "accepted {} from {}", fd, address);
+#define SLOG_AT(logger, level, ...) \
+    do { \
+        if constexpr(static_cast<int>(SystemLogger::LogLevel::level) >= LOG_COMPILE_LEVEL) { \
+            if((logger).enabled(SystemLogger::LogLevel::level)) { \
+                (logger).log(SystemLogger::LogLevel::level, __VA_ARGS__); \
+            } \
+        } \
+    } while(0)
+
+#define SLOGF_AT(logger, level, ...) \
+    do { \
+        if constexpr(static_cast<int>(SystemLogger::LogLevel::level) >= LOG_COMPILE_LEVEL) { \
+            if((logger).enabled(SystemLogger::LogLevel::level)) { \
+                (logger).logf(SystemLogger::LogLevel::level, __VA_ARGS__); \
+            } \
+        } \
+    } while(0)
+
+#define SLOG_DEBUG(logger, ...) SLOG_AT(logger, DEBUG, __VA_ARGS__)
+#define SLOG_INFO(logger, ...) SLOG_AT(logger, INFO, __VA_ARGS__)
+#define SLOG_WARNING(logger, ...) SLOG_AT(logger, WARNING, __VA_ARGS__)
+#define SLOG_ERROR(logger, ...) SLOG_AT(logger, ERROR, __VA_ARGS__)
+#define SLOG_CRITICAL(logger, ...) SLOG_AT(logger, CRITICAL, __VA_ARGS__)
+
+#define SLOGF_DEBUG(logger, ...) SLOGF_AT(logger, DEBUG, __VA_ARGS__)
+#define SLOGF_INFO(logger, ...) SLOGF_AT(logger, INFO, __VA_ARGS__)
+#define SLOGF_WARNING(logger, ...) SLOGF_AT(logger, WARNING, __VA_ARGS__)
+#define SLOGF_ERROR(logger, ...) SLOGF_AT(logger, ERROR, __VA_ARGS__)
+#define SLOGF_CRITICAL(logger, ...) SLOGF_AT(logger, CRITICAL, __VA_ARGS__)
+
 #endif // LOGGER_H
\ No newline at end of file
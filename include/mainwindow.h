@@ -5,6 +5,7 @@
 #include <QTabWidget>
 #include <QTableWidget>
 #include <QLineEdit>
+#include <QComboBox>
 #include <QPushButton>
 #include <QTimer>
 #include <QChartView>
@@ -53,6 +54,8 @@ private:
     QTableWidget* network_table;
     QTableWidget* disk_table;
     QTableWidget* log_table;
+    QLineEdit* log_search;
+    QComboBox* log_level_filter;
     QLineEdit* command_input;
     QPushButton* execute_button;
     
@@ -11,56 +11,244 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <map>
+#include <unordered_map>
 #include <memory>
-#include <random>  // 添加这个头文件
+#include <atomic>
+#include <functional>
+#include <deque>
+#include "io_buffer.h"
+
+#define NET_LISTEN_BACKLOG 1024
+#define NET_MAX_DESCRIPTORS (1 << 20)   // 所属反应器表的最大槽数
+#define NET_MAX_EVENTS 256              // 每次 epoll_wait 取回的事件数
+#define NET_READ_MIN 2048               // 当前接收缓冲剩余空间少于此值时换用新的池化缓冲
+#define NET_INPUT_LIMIT (1024 * 1024)   // 未被 receive_data 取走的数据上限，超过后暂停读取该连接
+#define NET_OUTPUT_LIMIT (4 * 1024 * 1024)  // 每个连接排队待发的数据上限
+#define NET_SAMPLE_INTERVAL_MS 1000     // 流量采样间隔，滑动窗口速率由采样差值计算
+#define NET_SAMPLE_COUNT 61             // 保留的采样数，覆盖最长 60 秒的窗口
+#define NET_LATENCY_BUCKETS 256         // 延迟直方图桶数
+#define NET_IOV_MAX 64                  // 每次 sendmsg 聚集的内存段数
+#define NET_ZEROCOPY_THRESHOLD (64 * 1024)  // 不小于此长度的内存段以 MSG_ZEROCOPY 发送
+
+class DiskManager;
 
 class NetworkManager {
+public:
+    // 接收回调：在反应器线程上调用，回调中不应阻塞。data 指向反应器的池化接收缓冲，
+    // 复制切片即可在回调之后继续持有数据而不拷贝字节，但会一直占住整个缓冲
+    typedef std::function<void(int client_id, const BufferSlice& data)> ReceiveHandler;
+    // 发送队列回落到上限一半以下时在反应器线程上调用，只针对曾被拒绝过发送的连接
+    typedef std::function<void(int client_id)> DrainHandler;
+    // 连接关闭时在描述符关闭之前调用，此后该 client_id 可能被新连接复用
+    typedef std::function<void(int client_id)> CloseHandler;
+    
+    // 发送链的一段：共享内存块的一部分、池化缓冲的切片，或文件中的一段（经 sendfile 发送，
+    // 不经过用户态）。内存一直引用到发送完成，以 MSG_ZEROCOPY 发送的要等到内核的完成通知
+    struct SendSegment {
+        std::shared_ptr<const std::string> data;
+        BufferSlice slice;                  // 非空时数据在切片中，offset 相对切片起点
+        std::shared_ptr<const int> file;    // 复制出的文件描述符，最后一个引用释放时关闭
+        uint64_t offset;
+        size_t length;
+        
+        const char* bytes() const {
+            return (slice.empty() ? data->data() : slice.data()) + offset;
+        }
+        static SendSegment memory(std::shared_ptr<const std::string> block, size_t offset = 0,
+                                  size_t length = std::string::npos);
+        // 例如把收到的切片原样发回，不复制字节
+        static SendSegment from_slice(const BufferSlice& slice);
+        // 复制 fd，调用者随后可以关闭自己的描述符
+        static SendSegment from_file(int fd, uint64_t offset, size_t length);
+    };
+    typedef std::vector<SendSegment> SendChain;
+    
 private:
+    struct Reactor;
+    
+    // 连接只由反应器线程读取和关闭；其他线程经 io_mutex 访问收发缓冲。
+    // 计数器在 I/O 路径上以 relaxed 原子操作更新
     struct ClientInfo {
         int socket_fd;
         std::string ip_address;
-        uint64_t bytes_received;
-        uint64_t bytes_sent;
-        bool connected;
+        Reactor* reactor;
+        std::atomic<uint64_t> bytes_received;
+        std::atomic<uint64_t> bytes_sent;
+        std::atomic<int64_t> request_started;   // 尚未应答的数据最早到达的时刻（纳秒），0 表示没有
+        std::atomic<bool> connected;
         
-        ClientInfo(int fd, std::string ip) 
-            : socket_fd(fd), ip_address(ip), 
-              bytes_received(0), bytes_sent(0), connected(true) {}
+        std::mutex io_mutex;
+        std::deque<BufferSlice> input;      // 已收到、尚未被 receive_data 取走的数据
+        size_t input_bytes;
+        bool read_paused;           // input 达到上限，等待 receive_data 取走后恢复读取
+        std::deque<SendSegment> output;     // 内核发送缓冲已满时排队的发送链
+        size_t output_memory;       // output 中内存段的字节数，用于背压
+        size_t output_bytes;        // output 中尚未发出的总字节数
+        bool output_blocked;        // 曾因超过上限拒绝发送，回落后通知 drain 回调
+        bool zerocopy;              // 已启用 SO_ZEROCOPY，且内核尚未报告回退为复制
+        uint32_t zerocopy_next;     // 下一次 MSG_ZEROCOPY 发送的通知序号
+        // 已交给内核、等待完成通知的内存段及其序号
+        std::deque<std::pair<uint32_t, SendSegment>> zerocopy_inflight;
+        
+        ClientInfo(int fd, std::string ip, Reactor* owner) 
+            : socket_fd(fd), ip_address(ip), reactor(owner),
+              bytes_received(0), bytes_sent(0), request_started(0), connected(true),
+              input_bytes(0), read_paused(false), output_memory(0), output_bytes(0), output_blocked(false),
+              zerocopy(false), zerocopy_next(0) {}
+    };
+    
+    // 延迟直方图（微秒）：小于 8 的值各占一桶，之后每个 2 的幂区间等分为 8 个子桶，
+    // 相对误差不超过 12.5%，超过 2^34 微秒的值计入最后一桶
+    struct LatencyHistogram {
+        std::atomic<uint64_t> buckets[NET_LATENCY_BUCKETS];
+        
+        LatencyHistogram() {
+            for(auto& bucket : buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+        void record(uint64_t us) {
+            buckets[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+        }
+        static size_t bucket_of(uint64_t us);
+        static uint64_t bucket_floor(size_t index);
     };
 
-    int server_socket;
-    std::map<int, std::shared_ptr<ClientInfo>> clients;
-    std::thread server_thread;
-    bool running;
-    mutable std::mutex network_mutex;
+    // 每个反应器线程有自己的监听套接字（SO_REUSEPORT，由内核分配新连接）、epoll 与连接表，
+    // 连接从建立到关闭都留在同一个反应器上
+    struct Reactor {
+        int listen_fd;
+        int epoll_fd;
+        int wake_fd;                // eventfd，用于停止反应器或让它恢复暂停的读取
+        std::thread thread;
+        std::mutex clients_mutex;   // 保护本反应器的连接表与 resume_reads
+        std::unordered_map<int, std::shared_ptr<ClientInfo>> clients;
+        std::vector<std::shared_ptr<ClientInfo>> resume_reads;   // 待恢复读取的连接，只会是本反应器的
+        // 接收缓冲池与正在填充的缓冲，只在反应器线程上使用；
+        // 缓冲没有其他引用时从头复用，否则继续填充剩余空间
+        BufferPool* pool;
+        PooledBuffer* receiving;
+        size_t receive_fill;
+        // 以下统计供 get_stats 无锁汇总，字节数包括已关闭的连接
+        alignas(64) std::atomic<int> connections;
+        std::atomic<uint64_t> accepted;
+        std::atomic<uint64_t> bytes_received;
+        std::atomic<uint64_t> bytes_sent;
+        std::atomic<uint64_t> sendfile_bytes;
+        std::atomic<uint64_t> zerocopy_bytes;
+        std::atomic<uint64_t> zerocopy_copied;  // 内核报告回退为复制的完成通知数
+        LatencyHistogram latency;
+        
+        Reactor() : listen_fd(-1), epoll_fd(-1), wake_fd(-1), pool(nullptr), receiving(nullptr),
+                    receive_fill(0), connections(0), accepted(0),
+                    bytes_received(0), bytes_sent(0), sendfile_bytes(0), zerocopy_bytes(0),
+                    zerocopy_copied(0) {}
+    };
     
-    // 随机数生成相关成员
-    mutable std::random_device rd;
-    mutable std::mt19937 gen;
-    mutable std::normal_distribution<double> sent_dist;
-    mutable std::normal_distribution<double> recv_dist;
-    mutable uint64_t last_bytes_sent;
-    mutable uint64_t last_bytes_received;
+    struct TrafficSample {
+        int64_t time_ms;
+        uint64_t bytes_sent;
+        uint64_t bytes_received;
+    };
+
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    // 按描述符索引的所属反应器序号加 1，0 表示不是本管理器的连接；按描述符查找连接时
+    // 只需锁住所属反应器的连接表
+    std::unique_ptr<std::atomic<uint16_t>[]> owners;
+    size_t owner_slots;
+    std::atomic<bool> running;
+    in_addr_t listen_address;   // 网络字节序，默认 INADDR_ANY
+    ReceiveHandler receive_handler;
+    DrainHandler drain_handler;
+    CloseHandler close_handler;
+    // 第一个反应器每隔 NET_SAMPLE_INTERVAL_MS 记录一次累计字节数
+    std::deque<TrafficSample> samples;
+    mutable std::mutex sample_mutex;
     
-    void handle_client(int client_socket);
-    void server_loop();
-    void generate_traffic_data(uint64_t& sent, uint64_t& received) const;
+    // 边沿触发的 epoll 反应器：非阻塞套接字，每次事件读写到 EAGAIN 为止
+    bool open_reactor(Reactor& reactor, int port, bool reuse_port);
+    void close_reactor(Reactor& reactor);
+    void server_loop(Reactor& reactor, uint16_t index);
+    void accept_clients(Reactor& reactor, uint16_t index);
+    void read_client(Reactor& reactor, ClientInfo& client);
+    void write_client(ClientInfo& client);
+    // 以下三个函数由调用者持有 client.io_mutex
+    bool flush_output(ClientInfo& client);
+    void reap_zerocopy(ClientInfo& client);
+    static void consume_output(ClientInfo& client, size_t bytes);
+    void close_client(Reactor& reactor, int fd);
+    static void close_socket(ClientInfo& client);
+    bool send_segments(int client_id, const SendSegment* segments, size_t count);
+    Reactor* owner_of(int fd) const;
+    std::shared_ptr<ClientInfo> find_client(int fd) const;
+    static void wake_reactor(Reactor& reactor);
+    static void count_received(ClientInfo& client, size_t bytes);
+    static void count_sent(ClientInfo& client, size_t bytes);
+    TrafficSample current_totals() const;
+    void record_sample();
     
 public:
     NetworkManager();
     ~NetworkManager();
     
-    bool start_server(int port);
+    // 监听端口并启动 threads 个反应器线程（0 表示每个核心一个），
+    // 内核不支持 SO_REUSEPORT 时退回单个反应器
+    bool start_server(int port, unsigned threads = 0);
     void stop_server();
+    // 只在该 IPv4 地址上监听（如 "127.0.0.1"），默认监听所有地址；须在 start_server 前设置，
+    // 地址无法解析时返回 false 并保持原设置
+    bool set_listen_address(const std::string& address);
+    // 设置后收到的数据直接交给回调，不再缓存供 receive_data 取用；须在 start_server 前设置
+    void set_receive_handler(ReceiveHandler handler);
+    void set_drain_handler(DrainHandler handler);
+    void set_close_handler(CloseHandler handler);
+    // 发送链按顺序排入连接的发送队列：队列为空时立即以 sendmsg 聚集发送，文件段用 sendfile，
+    // 大内存段用 MSG_ZEROCOPY，内核缓冲满时余下部分由反应器在可写时发出。
+    // 排队的内存段超过 NET_OUTPUT_LIMIT 时整条拒绝并返回 false，文件段不计入上限；
+    // 队列为空时总是接受，单条超过上限的消息也能发出
+    bool send_chain(int client_id, const SendChain& chain);
     bool send_data(int client_id, const std::string& data);
+    bool send_data(int client_id, const BufferSlice& data);
+    bool send_file(int client_id, int fd, uint64_t offset, size_t length);
+    // 经 sendfile 直接从 DiskManager 镜像发送文件，内联或压缩的部分按内存段发送；
+    // 发送完成前文件不应被修改或删除
+    bool send_disk_file(int client_id, DiskManager& disk, const std::string& filename);
+    // 连接尚未发出的字节数，不存在时返回 0
+    size_t pending_output(int client_id) const;
+    // 取走该连接已收到的全部数据，没有数据时返回空串
     std::string receive_data(int client_id);
+    // 同上，但把数据以池化缓冲切片追加到 slices 中，不复制字节；没有数据时返回 false
+    bool receive_data(int client_id, std::vector<BufferSlice>& slices);
     
     // 获取网络状态信息
+    struct ConnectionStats {
+        int client_id;
+        std::string ip_address;
+        uint64_t bytes_sent;
+        uint64_t bytes_received;
+    };
+    
     struct NetworkStats {
         int total_connections;
-        uint64_t total_bytes_sent;
+        uint64_t total_bytes_sent;          // 启动以来的累计值，包括已关闭的连接
         uint64_t total_bytes_received;
         std::vector<std::pair<std::string, bool>> client_status;
+        uint64_t accepted_connections;
+        // 最近 1 秒、10 秒、60 秒内的平均速率（字节/秒）
+        double send_rate[3];
+        double receive_rate[3];
+        // 应答延迟：从连接上未应答的数据到达到开始发送应答的时间（微秒），
+        // 分位数按直方图桶的中点估计
+        uint64_t latency_samples;
+        double latency_p50_us;
+        double latency_p99_us;
+        std::vector<std::pair<uint64_t, uint64_t>> latency_histogram;  // 非空桶的下界与计数
+        uint64_t sendfile_bytes;            // 经 sendfile 发出的字节数
+        uint64_t zerocopy_bytes;            // 以 MSG_ZEROCOPY 交给内核的字节数
+        uint64_t zerocopy_copied;           // 其中内核回退为复制的发送次数
+        size_t buffers_allocated;           // 各反应器接收缓冲池已申请的缓冲数
+        size_t buffers_in_use;              // 其中正被连接或回调持有的缓冲数
+        std::vector<ConnectionStats> connections;
     };
     
     NetworkStats get_stats() const;
@@ -0,0 +1,186 @@
+// include/remote.h - 远程管理协议
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// 线路格式（整数均为小端）：
+//   帧   = 帧头 { u32 length; u32 count; } + count 条记录，length 为帧头之后的字节数
+//   记录 = { u32 request_id; u16 code; u16 flags; u32 body_length; } + body
+// 请求记录的 code 为操作码，应答记录的 code 为状态码并带回请求的 request_id。
+// 客户端可以不等应答连续发送请求（流水线），一帧也可以装多条请求（批量）；
+// 应答按完成顺序返回，可能与请求顺序不同，由 request_id 对应。
+// 除 PING 与 LOGIN 外的操作都要求连接已经登录且用户拥有该操作对应的权限，否则应答 DENIED；
+// LOGIN 在反应器线程上按收到的顺序处理，紧随其后流水线发出的请求即以新身份检查；
+// 登录前帧长不得超过 REMOTE_LOGIN_MAX_FRAME
+#define REMOTE_FRAME_HEADER 8
+#define REMOTE_RECORD_HEADER 12
+#define REMOTE_MAX_FRAME (16 * 1024 * 1024)     // 帧头之后的最大字节数，超过视为协议错误
+#define REMOTE_LOGIN_MAX_FRAME 4096             // 登录前帧头之后的最大字节数，超过时断开连接
+#define REMOTE_MAX_INFLIGHT 4096                // 每个连接排队与执行中的请求上限，超过时应答 BUSY
+#define REMOTE_BACKLOG_LIMIT (64 * 1024 * 1024) // 发送队列满时暂存的应答上限，超过时断开连接
+#define REMOTE_WORKER_BATCH 64                  // 工作线程一次取出的请求数
+#define REMOTE_MAX_LOG_ENTRIES 10000            // LOG_SEARCH 与 LOG_RECENT 一次返回的条数上限
+
+// 各操作要求的 UserAuth 权限名，管理员拥有全部权限
+#define REMOTE_PERM_KERNEL "remote.kernel"          // KERNEL_COMMAND
+#define REMOTE_PERM_DISK_READ "remote.disk.read"    // DISK_READ、DISK_LIST
+#define REMOTE_PERM_DISK_WRITE "remote.disk.write"  // DISK_WRITE
+#define REMOTE_PERM_LOG "remote.log"                // LOG_SEARCH、LOG_RECENT
+
+class NetworkManager;
+class AdvancedKernel;
+class DiskManager;
+class SystemLogger;
+class UserAuth;
+class BufferSlice;
+
+enum class RemoteOp : uint16_t {
+    PING = 0,           // 原样返回 body，在反应器线程上直接应答
+    KERNEL_COMMAND,     // body 为命令行，返回 AdvancedKernel::execute_command 的输出
+    DISK_READ,          // body 为文件名，返回文件内容
+    DISK_WRITE,         // body 为 u16 文件名长度 + 文件名 + 内容
+    DISK_LIST,          // body 为目录，每行返回“类型\t大小\t名字”
+    LOG_SEARCH,         // body 为 u32 级别掩码 + u32 条数上限 + 查询串，每行一条日志
+    LOG_RECENT,         // body 为 u32 条数，每行一条日志；两者条数都不超过 REMOTE_MAX_LOG_ENTRIES
+    LOGIN               // body 为 u16 用户名长度 + 用户名 + 密码；失败时连接回到未登录状态
+};
+
+enum class RemoteStatus : uint16_t {
+    OK = 0,
+    BAD_REQUEST,        // body 格式不符
+    UNKNOWN_OP,
+    FAILED,             // 文件不存在、写入失败、结果超过单帧上限等，body 为原因
+    BUSY,               // 连接上未完成的请求过多，未执行，可以重试
+    DENIED              // 未登录、密码错误或缺少权限，未执行
+};
+
+// 一条已解析的记录，body 指向被解析的缓冲
+struct RemoteRecord {
+    uint32_t request_id;
+    uint16_t code;
+    uint16_t flags;
+    const char* body;
+    uint32_t length;
+};
+
+// 逐条追加记录，finish 填写帧头并取出整帧
+class RemoteFrameBuilder {
+public:
+    RemoteFrameBuilder();
+    
+    void add(uint32_t request_id, uint16_t code, const char* body, size_t length);
+    void add(uint32_t request_id, uint16_t code, const std::string& body) {
+        add(request_id, code, body.data(), body.size());
+    }
+    uint32_t count() const { return records; }
+    size_t size() const { return data.size(); }
+    std::string finish();
+    
+private:
+    std::string data;
+    uint32_t records;
+};
+
+// 解析 data 开头的一帧：完整时填写 records 与 frame_size 并返回 1，
+// 数据不足一帧时返回 0，格式错误（超长、记录越界、条数不符）时返回 -1
+int remote_parse_frame(const char* data, size_t size, size_t& frame_size,
+                       std::vector<RemoteRecord>& records);
+
+void remote_put_u16(std::string& out, uint16_t value);
+void remote_put_u32(std::string& out, uint32_t value);
+uint16_t remote_get_u16(const char* p);
+uint32_t remote_get_u32(const char* p);
+
+// 在 NetworkManager 的端口上提供远程管理：反应器线程拆帧，PING、LOGIN 与权限检查就地完成，
+// 其余请求交给工作线程执行，同一批完成的应答合并成一帧发回。
+// 须在 start_server 之前 start，并在 NetworkManager 停止之后析构
+class RemoteServer {
+public:
+    struct Stats {
+        uint64_t frames_received;
+        uint64_t requests;
+        uint64_t frames_sent;
+        uint64_t responses;
+        uint64_t busy;              // 因未完成请求过多而拒绝的请求数
+        uint64_t protocol_errors;   // 因格式错误断开的连接数
+        uint64_t denied;            // 因未登录或缺少权限拒绝的请求数（含登录失败）
+    };
+    
+    RemoteServer(NetworkManager& network, AdvancedKernel& kernel, DiskManager& disk,
+                 SystemLogger& logger, UserAuth& auth);
+    ~RemoteServer();
+    
+    // 注册 NetworkManager 的回调并启动 worker_count 个工作线程（0 表示每个核心一个）
+    void start(unsigned worker_count = 0);
+    void stop();
+    Stats get_stats() const;
+    
+private:
+    // 一个连接的拆帧状态与应答队列。拆帧只在连接所属的反应器线程上进行；
+    // 发送与暂存在 mutex 下进行，关闭回调置 closed 后不再向这个 client_id 发送
+    struct Session {
+        int client_id;
+        std::string input;          // 不足一帧的剩余字节
+        std::string user;           // 已登录的用户名，空表示未登录；与 input 一样只在反应器线程上读写
+        std::atomic<uint32_t> inflight;
+        std::mutex mutex;
+        bool closed;
+        std::deque<std::shared_ptr<const std::string>> backlog;    // 发送队列满时暂存的应答帧
+        size_t backlog_bytes;
+    
+        explicit Session(int id) : client_id(id), inflight(0), closed(false), backlog_bytes(0) {}
+    };
+    
+    struct Task {
+        std::shared_ptr<Session> session;
+        uint32_t request_id;
+        uint16_t op;
+        std::string body;
+    };
+    
+    NetworkManager& network;
+    AdvancedKernel& kernel;
+    DiskManager& disk;
+    SystemLogger& logger;
+    UserAuth& auth;
+    
+    mutable std::mutex sessions_mutex;
+    std::unordered_map<int, std::shared_ptr<Session>> sessions;
+    
+    std::mutex task_mutex;
+    std::condition_variable task_ready;
+    std::deque<Task> tasks;
+    std::vector<std::thread> workers;
+    bool running;
+    
+    std::atomic<uint64_t> frames_received;
+    std::atomic<uint64_t> requests;
+    std::atomic<uint64_t> frames_sent;
+    std::atomic<uint64_t> responses;
+    std::atomic<uint64_t> busy;
+    std::atomic<uint64_t> protocol_errors;
+    std::atomic<uint64_t> denied;
+    
+    void handle_data(int client_id, const BufferSlice& data);
+    bool handle_frames(Session& session, const std::shared_ptr<Session>& owner,
+                       const char* data, size_t size, size_t& consumed);
+    RemoteStatus handle_login(Session& session, const RemoteRecord& record);
+    bool permitted(const Session& session, uint16_t op) const;
+    void handle_close(int client_id);
+    void handle_drain(int client_id);
+    void worker_loop();
+    RemoteStatus execute(const Task& task, std::string& result);
+    void deliver(Session& session, std::string frame);
+};
+
+#endif // REMOTE_H
\ No newline at end of file
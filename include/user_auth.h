@@ -41,6 +41,9 @@ private:
     std::string current_user;
     mutable std::mutex auth_mutex;
 
+    // 调用者需持有 auth_mutex
+    bool permitted(const std::string& username, const std::string& permission) const;
+
 public:
     UserAuth();
     ~UserAuth();
@@ -52,6 +55,10 @@ public:
     std::string get_current_user() const;
 
     bool has_permission(const std::string& permission);
+    // 以下两个方法不读写当前用户，供远程会话等自行记录登录身份的调用方使用：
+    // authenticate 校验密码并记录登录时间；管理员拥有全部权限
+    bool authenticate(const std::string& username, const std::string& password);
+    bool has_permission(const std::string& username, const std::string& permission) const;
     bool add_permission(const std::string& username, const std::string& permission);
     bool remove_permission(const std::string& username, const std::string& permission);
 
@@ -224,7 +224,11 @@ void AdvancedKernel::handle_timer_interrupt() {
 }
 
 void AdvancedKernel::execute_command(const std::string& command) {
-	std::lock_guard<std::mutex> lock(kernel_mutex);
+	execute_command(command, std::cout);
+}
+
+void AdvancedKernel::execute_command(const std::string& command, std::ostream& out) {
+	std::unique_lock<std::mutex> lock(kernel_mutex);
 	
 	// 解析命令
 	std::istringstream iss(command);
@@ -232,10 +236,10 @@ void AdvancedKernel::execute_command(const std::string& command) {
 	iss >> cmd;
 	
 	if(cmd == "ps" || cmd == "processes") {
-		std::cout << "Process List:\n";
-		std::cout << "PID\tName\tState\tPriority\tCPU Time\n";
+		out << "Process List:\n";
+		out << "PID\tName\tState\tPriority\tCPU Time\n";
 		for(const auto& pcb : all_processes) {
-			std::cout << pcb->pid << "\t"
+			out << pcb->pid << "\t"
 			<< pcb->name << "\t"
 			<< static_cast<int>(pcb->state) << "\t"
 			<< pcb->priority << "\t\t"
@@ -245,8 +249,10 @@ void AdvancedKernel::execute_command(const std::string& command) {
 	else if(cmd == "kill") {
 		int pid;
 		if(iss >> pid) {
+			// terminate_process 自己加锁
+			lock.unlock();
 			terminate_process(pid);
-			std::cout << "Process " << pid << " terminated.\n";
+			out << "Process " << pid << " terminated.\n";
 		}
 	}
 	else if(cmd == "nice") {
@@ -256,7 +262,7 @@ void AdvancedKernel::execute_command(const std::string& command) {
 				if(pcb->pid == pid) {
 					pcb->nice_value = std::min(19, std::max(-20, value));
 					scheduler.update_priority(pcb);
-					std::cout << "Updated nice value for process " << pid << "\n";
+					out << "Updated nice value for process " << pid << "\n";
 					break;
 				}
 			}
@@ -264,13 +270,13 @@ void AdvancedKernel::execute_command(const std::string& command) {
 	}
 	else if(cmd == "mem" || cmd == "memory") {
 		SystemInfo info = get_system_info();
-		std::cout << "Memory Information:\n"
+		out << "Memory Information:\n"
 		<< "Total: " << info.total_memory / 1024 << "KB\n"
 		<< "Used: " << info.used_memory / 1024 << "KB\n"
 		<< "Free: " << info.free_memory / 1024 << "KB\n";
 	}
 	else if(cmd == "help") {
-		std::cout << "Available commands:\n"
+		out << "Available commands:\n"
 		<< "ps, processes - List all processes\n"
 		<< "kill <pid> - Terminate a process\n"
 		<< "nice <pid> <value> - Adjust process priority\n"
@@ -278,7 +284,7 @@ void AdvancedKernel::execute_command(const std::string& command) {
 		<< "help - Show this help message\n";
 	}
 	else {
-		std::cout << "Unknown command. Type 'help' for available commands.\n";
+		out << "Unknown command. Type 'help' for available commands.\n";
 	}
 }
 
@@ -0,0 +1,170 @@
+// block_device.cpp
+#include "block_device.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <cstring>
+
+namespace {
+	uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+BlockDevice::BlockDevice(uint32_t block_size, uint64_t block_count)
+: bsize(block_size), blocks(block_count), stats(), read_ns(0), write_ns(0) {
+}
+
+bool BlockDevice::read(uint64_t block, void* buffer) {
+	if(block >= blocks) {
+		return false;
+	}
+	
+	std::lock_guard<std::mutex> lock(io_mutex);
+	auto start = std::chrono::steady_clock::now();
+	bool ok = read_block(block, buffer);
+	read_ns += elapsed_ns(start);
+	if(ok) {
+		stats.reads++;
+		stats.bytes_read += bsize;
+	}
+	return ok;
+}
+
+bool BlockDevice::write(uint64_t block, const void* buffer) {
+	if(block >= blocks) {
+		return false;
+	}
+	
+	std::lock_guard<std::mutex> lock(io_mutex);
+	auto start = std::chrono::steady_clock::now();
+	bool ok = write_block(block, buffer);
+	write_ns += elapsed_ns(start);
+	if(ok) {
+		stats.writes++;
+		stats.bytes_written += bsize;
+	}
+	return ok;
+}
+
+bool BlockDevice::flush() {
+	std::lock_guard<std::mutex> lock(io_mutex);
+	return flush_device();
+}
+
+BlockDevice::IoStats BlockDevice::get_stats() const {
+	std::lock_guard<std::mutex> lock(io_mutex);
+	IoStats result = stats;
+	result.read_ms = read_ns / 1e6;
+	result.write_ms = write_ns / 1e6;
+	return result;
+}
+
+FileBlockDevice::FileBlockDevice(const std::string& path, uint64_t block_count, uint32_t block_size)
+: BlockDevice(block_size, block_count), fd(-1) {
+	
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if(fd < 0) {
+		blocks = 0;
+		return;
+	}
+	
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		::close(fd);
+		fd = -1;
+		blocks = 0;
+		return;
+	}
+	
+	// 未指定大小时沿用镜像现有大小，否则把镜像扩展到所需大小
+	uint64_t existing = static_cast<uint64_t>(st.st_size) / bsize;
+	if(block_count == 0) {
+		blocks = existing;
+	} else if(existing < block_count && ftruncate(fd, block_count * bsize) != 0) {
+		::close(fd);
+		fd = -1;
+		blocks = 0;
+	}
+}
+
+FileBlockDevice::~FileBlockDevice() {
+	if(fd >= 0) {
+		::close(fd);
+	}
+}
+
+bool FileBlockDevice::flush_device() {
+	return fd >= 0 && fsync(fd) == 0;
+}
+
+bool FileBlockDevice::read_block(uint64_t block, void* buffer) {
+	return fd >= 0 && pread(fd, buffer, bsize, block * bsize) == static_cast<ssize_t>(bsize);
+}
+
+bool FileBlockDevice::write_block(uint64_t block, const void* buffer) {
+	return fd >= 0 && pwrite(fd, buffer, bsize, block * bsize) == static_cast<ssize_t>(bsize);
+}
+
+RamBlockDevice::RamBlockDevice(uint64_t block_count, uint32_t block_size)
+: BlockDevice(block_size, block_count), data(block_count * block_size) {
+}
+
+bool RamBlockDevice::read_block(uint64_t block, void* buffer) {
+	memcpy(buffer, data.data() + block * bsize, bsize);
+	return true;
+}
+
+bool RamBlockDevice::write_block(uint64_t block, const void* buffer) {
+	memcpy(data.data() + block * bsize, buffer, bsize);
+	return true;
+}
+
+PartitionBlockDevice::PartitionBlockDevice(DiskManager& dm, const std::string& file,
+	uint64_t block_count, uint32_t block_size)
+: BlockDevice(block_size, block_count), disk(dm), path(file) {
+	
+	handle = disk.open_file(path, DiskManager::OpenMode::READ_WRITE);
+	if(!handle) {
+		handle = disk.open_file(path, DiskManager::OpenMode::WRITE);
+	}
+	if(!handle) {
+		blocks = 0;
+		return;
+	}
+	
+	// 镜像文件不足设备大小时在末尾写一个字节扩展，中间部分按空洞补零
+	uint64_t bytes = block_count * bsize;
+	if(handle->size() < bytes) {
+		char zero = 0;
+		if(!handle->seek(bytes - 1) || handle->write(&zero, 1) != 1) {
+			handle.reset();
+			blocks = 0;
+		}
+	}
+}
+
+PartitionBlockDevice::~PartitionBlockDevice() {
+	if(handle) {
+		handle->close();
+	}
+}
+
+bool PartitionBlockDevice::flush_device() {
+	if(!handle) {
+		return false;
+	}
+	
+	// 只写回缓冲的压缩簇；尾部打包与去重要扫描整个镜像文件，留到析构时关闭句柄再做
+	return handle->flush();
+}
+
+bool PartitionBlockDevice::read_block(uint64_t block, void* buffer) {
+	return handle && handle->seek(block * bsize) && handle->read(buffer, bsize) == bsize;
+}
+
+bool PartitionBlockDevice::write_block(uint64_t block, const void* buffer) {
+	return handle && handle->seek(block * bsize) && handle->write(buffer, bsize) == bsize;
+}
@@ -3,6 +3,7 @@
 #include "screen.h"
 #include "keyboard.h"
 #include <algorithm>
+#include <cstdlib>
 #include <sstream>
 
 CLI::CLI() : history_index(0), current_dir("/") {
@@ -93,6 +94,32 @@ void CLI::init() {
 		}
 	}});
 	
+	register_command({"fsck", "检查文件系统一致性，-r 同时修复", [this](const auto& args) {
+		bool repair = args.size() > 1 && args[1] == "-r";
+		auto report = filesystem.check(repair);
+		for(const auto& problem : report.problems) {
+			kprintf("  %s\n", problem.c_str());
+		}
+		size_t errors = report.bad_pointers + report.duplicate_blocks + report.unallocated_blocks +
+			report.leaked_blocks + report.count_errors + report.directory_errors +
+			report.link_errors + report.orphan_inodes;
+		if(!report.superblock_ok) {
+			kprintf("错误: 超级块损坏，无法检查\n");
+		} else {
+			kprintf("检查了 %zu 个分配组、%zu 个 inode，发现 %zu 处错误，修复 %zu 处\n",
+				report.groups, report.inodes, errors, report.repaired);
+		}
+	}});
+	
+	register_command({"scrub", "巡检数据块校验和，可指定限速 MB/s", [this](const auto& args) {
+		size_t rate = args.size() > 1 ? strtoul(args[1].c_str(), nullptr, 10) * 1024 * 1024 : 0;
+		auto report = filesystem.scrub(rate);
+		for(const auto& problem : report.problems) {
+			kprintf("  %s\n", problem.c_str());
+		}
+		kprintf("读取 %zu KB，校验错误 %zu 个\n", report.bytes_scanned / 1024, report.checksum_errors);
+	}});
+	
 	// 清屏并显示欢迎信息
 	clear_screen();
 	kprintf("Simple OS Command Line Interface\n");
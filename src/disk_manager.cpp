@@ -1,29 +1,169 @@
 // disk_manager.cpp - 磁盘管理实现
 #include "../include/disk_manager.h"
+#include "../include/logger.h"
 #include <algorithm>
 #include <cstring>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <sstream>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <cerrno>
+#include <chrono>
+#include <zlib.h>
+#include <openssl/evp.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace {
+	// 流式读写与复制时单次处理的最大字节数
+	const size_t STREAM_CHUNK = 64 * 1024;
+	
+	// 压缩分区中每个簇的逻辑大小
+	const size_t CLUSTER_SIZE = 64 * 1024;
+	
+	uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	}
+	
+	// CRC32C（Castagnoli 多项式，反射形式）
+	const uint32_t CRC32C_POLY = 0x82F63B78;
+	// 硬件实现三路交错计算时每路的长度：3 × 1360 = 4080，一个 4KB 块只剩 16 字节逐字处理
+	const size_t CRC32C_LANE = 1360;
+	
+	struct Crc32cTables {
+		uint32_t bytes[256];       // 逐字节查表
+		uint32_t shift[4][256];    // 寄存器后接 CRC32C_LANE 个零字节的线性变换
+		
+		Crc32cTables() {
+			for(uint32_t i = 0; i < 256; i++) {
+				uint32_t crc = i;
+				for(int bit = 0; bit < 8; bit++) {
+					crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+				}
+				bytes[i] = crc;
+			}
+			for(int k = 0; k < 4; k++) {
+				for(uint32_t v = 0; v < 256; v++) {
+					uint32_t crc = v << (8 * k);
+					for(size_t i = 0; i < CRC32C_LANE; i++) {
+						crc = bytes[crc & 0xFF] ^ (crc >> 8);
+					}
+					shift[k][v] = crc;
+				}
+			}
+		}
+		
+		uint32_t extend(uint32_t crc) const {
+			return shift[0][crc & 0xFF] ^ shift[1][(crc >> 8) & 0xFF] ^
+				shift[2][(crc >> 16) & 0xFF] ^ shift[3][crc >> 24];
+		}
+	};
+	
+	const Crc32cTables& crc32c_tables() {
+		static const Crc32cTables tables;
+		return tables;
+	}
+	
+	uint32_t crc32c_soft(uint32_t crc, const char* p, size_t n) {
+		const Crc32cTables& tables = crc32c_tables();
+		while(n--) {
+			crc = tables.bytes[(crc ^ static_cast<uint8_t>(*p++)) & 0xFF] ^ (crc >> 8);
+		}
+		return crc;
+	}
+	
+#if defined(__x86_64__)
+	// crc32 指令延迟 3 个周期、吞吐 1 个周期，三路独立计算后用查表移位合并
+	__attribute__((target("sse4.2")))
+	uint32_t crc32c_hw(uint32_t crc, const char* p, size_t n) {
+		const Crc32cTables& tables = crc32c_tables();
+		while(n >= 3 * CRC32C_LANE) {
+			uint64_t c0 = crc, c1 = 0, c2 = 0;
+			for(size_t i = 0; i < CRC32C_LANE; i += 8) {
+				uint64_t a, b, c;
+				memcpy(&a, p + i, 8);
+				memcpy(&b, p + CRC32C_LANE + i, 8);
+				memcpy(&c, p + 2 * CRC32C_LANE + i, 8);
+				c0 = _mm_crc32_u64(c0, a);
+				c1 = _mm_crc32_u64(c1, b);
+				c2 = _mm_crc32_u64(c2, c);
+			}
+			crc = tables.extend(tables.extend(static_cast<uint32_t>(c0)) ^ static_cast<uint32_t>(c1)) ^
+				static_cast<uint32_t>(c2);
+			p += 3 * CRC32C_LANE;
+			n -= 3 * CRC32C_LANE;
+		}
+		
+		uint64_t c = crc;
+		for(; n >= 8; p += 8, n -= 8) {
+			uint64_t v;
+			memcpy(&v, p, 8);
+			c = _mm_crc32_u64(c, v);
+		}
+		crc = static_cast<uint32_t>(c);
+		for(; n > 0; n--) {
+			crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*p++));
+		}
+		return crc;
+	}
+#endif
+	
+	uint32_t crc32c(const void* data, size_t size) {
+		const char* p = static_cast<const char*>(data);
+#if defined(__x86_64__)
+		static const bool hardware = __builtin_cpu_supports("sse4.2");
+		if(hardware) {
+			return ~crc32c_hw(~0u, p, size);
+		}
+#endif
+		return ~crc32c_soft(~0u, p, size);
+	}
+	
+	bool pread_full(int fd, void* buffer, size_t size, size_t offset) {
+		char* ptr = static_cast<char*>(buffer);
+		while(size > 0) {
+			ssize_t n = pread(fd, ptr, size, offset);
+			if(n < 0) {
+				if(errno == EINTR) continue;
+				return false;
+			}
+			if(n == 0) {
+				return false; // 超出磁盘文件末尾
+			}
+			ptr += n;
+			offset += n;
+			size -= n;
+		}
+		return true;
+	}
+}
 
 DiskManager::DiskManager(const std::string& file, size_t size, size_t bs) 
-: disk_file(file), total_size(size), block_size(bs) {
+: disk_file(file), disk_fd(-1), total_size(size), block_size(bs), generation(1),
+inline_limit(128), tail_limit(bs / 2), disk_reads(0), disk_writes(0),
+cache_capacity(256), compress_input_bytes(0), compress_output_bytes(0),
+compress_ns(0), decompress_ns(0), cache_hits(0), cache_misses(0), logger(nullptr),
+checksum_ns(0), read_ns(0), verified_bytes(0), checksum_errors(0), verify_reads(true) {
 	
-	// 打开或创建磁盘文件
-	std::fstream disk(disk_file, std::ios::in | std::ios::out | std::ios::binary);
-	if(!disk) {
-		disk.open(disk_file, std::ios::out | std::ios::binary);
-		// 初始化磁盘文件
-		std::vector<char> empty(size, 0);
-		disk.write(empty.data(), size);
+	// 打开或创建磁盘文件；用 ftruncate 扩展到目标大小，避免在内存中构造整盘数据
+	disk_fd = ::open(disk_file.c_str(), O_RDWR | O_CREAT, 0644);
+	if(disk_fd >= 0) {
+		struct stat st;
+		if(fstat(disk_fd, &st) == 0 && static_cast<size_t>(st.st_size) < size) {
+			if(ftruncate(disk_fd, size) != 0) {
+				::close(disk_fd);
+				disk_fd = -1;
+			}
+		}
 	}
-	disk.close();
 	
 	// 初始化块映射
 	size_t total_blocks = total_size / block_size;
 	block_map.resize(total_blocks);
 	for(size_t i = 0; i < total_blocks; i++) {
-		block_map[i] = {i, true, block_size};
+		block_map[i] = {i, true, block_size, 0, 0, false};
 	}
 	
 	// 创建根分区
@@ -56,32 +196,139 @@ DiskManager::~DiskManager() {
 			unmount_partition(partition.name);
 		}
 	}
+	
+	if(disk_fd >= 0) {
+		::close(disk_fd);
+	}
 }
 
+// 以下两个函数由已持有 disk_mutex 的调用者使用
 bool DiskManager::write_to_disk(size_t offset, const void* data, size_t size) {
-	std::lock_guard<std::mutex> lock(disk_mutex);
-	
-	std::fstream disk(disk_file, std::ios::in | std::ios::out | std::ios::binary);
-	if(!disk) {
+	if(disk_fd < 0) {
 		return false;
 	}
 	
-	disk.seekp(offset);
-	disk.write(static_cast<const char*>(data), size);
-	return disk.good();
+	if(size == 0) {
+		return true;
+	}
+	
+	disk_writes++;
+	size_t start_offset = offset;
+	size_t start_size = size;
+	const char* ptr = static_cast<const char*>(data);
+	while(size > 0) {
+		ssize_t n = pwrite(disk_fd, ptr, size, offset);
+		if(n < 0) {
+			if(errno == EINTR) continue;
+			return false;
+		}
+		ptr += n;
+		offset += n;
+		size -= n;
+	}
+	update_checksums(start_offset, static_cast<const char*>(data), start_size);
+	return true;
 }
 
 bool DiskManager::read_from_disk(size_t offset, void* buffer, size_t size) {
-	std::lock_guard<std::mutex> lock(disk_mutex);
-	
-	std::fstream disk(disk_file, std::ios::in | std::ios::binary);
-	if(!disk) {
+	if(disk_fd < 0) {
 		return false;
 	}
+	if(size == 0) {
+		return true;
+	}
+	
+	disk_reads++;
+	if(!verify_reads) {
+		auto start = std::chrono::steady_clock::now();
+		bool read = pread_full(disk_fd, buffer, size, offset);
+		read_ns += elapsed_ns(start);
+		return read;
+	}
+	
+	// 校验以整块为单位：块对齐时直接读入调用者的缓冲区，
+	// 否则把覆盖这段数据的整块读入暂存区，校验后再复制出所需部分
+	size_t first = offset / block_size;
+	size_t count = (offset + size - 1) / block_size - first + 1;
+	bool aligned = offset % block_size == 0 && size % block_size == 0;
+	char* data = static_cast<char*>(buffer);
+	if(!aligned) {
+		read_scratch.resize(count * block_size);
+		data = read_scratch.data();
+	}
 	
-	disk.seekg(offset);
-	disk.read(static_cast<char*>(buffer), size);
-	return disk.good();
+	// 按 STREAM_CHUNK 分段读取并立即校验，趁数据还在缓存中
+	size_t chunk_blocks = std::max<size_t>(1, STREAM_CHUNK / block_size);
+	bool ok = true;
+	for(size_t done = 0; done < count; done += chunk_blocks) {
+		size_t n = std::min(chunk_blocks, count - done);
+		auto start = std::chrono::steady_clock::now();
+		bool read = pread_full(disk_fd, data + done * block_size, n * block_size, (first + done) * block_size);
+		read_ns += elapsed_ns(start);
+		if(!read) {
+			return false;
+		}
+		ok = verify_blocks(first + done, data + done * block_size, n) && ok;
+	}
+	if(!ok) {
+		return false;
+	}
+	if(!aligned) {
+		memcpy(buffer, data + offset % block_size, size);
+	}
+	return true;
+}
+
+void DiskManager::update_checksums(size_t offset, const char* data, size_t size) {
+	// 整块被覆盖时按写入的数据计算，部分覆盖或 data 为空时读回整块再计算
+	auto start = std::chrono::steady_clock::now();
+	size_t first = offset / block_size;
+	size_t last = (offset + size - 1) / block_size;
+	std::vector<char> block;
+	for(size_t b = first; b <= last && b < block_map.size(); b++) {
+		size_t begin = b * block_size;
+		BlockInfo& info = block_map[b];
+		if(data && begin >= offset && begin + block_size <= offset + size) {
+			info.checksum = crc32c(data + (begin - offset), block_size);
+			info.checksummed = true;
+			continue;
+		}
+		block.resize(block_size);
+		info.checksummed = pread_full(disk_fd, block.data(), block_size, begin);
+		if(info.checksummed) {
+			info.checksum = crc32c(block.data(), block_size);
+		}
+	}
+	checksum_ns += elapsed_ns(start);
+}
+
+bool DiskManager::verify_blocks(size_t first_block, const char* data, size_t count) {
+	auto start = std::chrono::steady_clock::now();
+	bool ok = true;
+	for(size_t i = 0; i < count && first_block + i < block_map.size(); i++) {
+		const BlockInfo& info = block_map[first_block + i];
+		if(!info.checksummed) continue;
+		verified_bytes += block_size;
+		if(crc32c(data + i * block_size, block_size) == info.checksum) continue;
+		
+		checksum_errors++;
+		ok = false;
+		if(logger) {
+			SLOGF_ERROR(*logger, "DiskManager", "块 {} 校验和不符，数据已损坏（{}）", first_block + i, disk_file);
+		}
+	}
+	checksum_ns += elapsed_ns(start);
+	return ok;
+}
+
+void DiskManager::set_logger(SystemLogger* log) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	logger = log;
+}
+
+void DiskManager::set_read_verification(bool enabled) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	verify_reads = enabled;
 }
 
 size_t DiskManager::allocate_blocks(size_t size) {
@@ -101,6 +348,7 @@ size_t DiskManager::allocate_blocks(size_t size) {
 				// 标记这些块为已使用
 				for(size_t j = start_block; j < start_block + blocks_needed; j++) {
 					block_map[j].is_free = false;
+					block_map[j].birth = generation;
 				}
 				return start_block;
 			}
@@ -118,194 +366,1257 @@ void DiskManager::free_blocks(size_t start_block, size_t count) {
 	}
 }
 
-bool DiskManager::create_partition(const std::string& name, size_t size) {
-	std::lock_guard<std::mutex> lock(disk_mutex);
-	
-	// 检查分区名是否已存在
+std::string DiskManager::find_mount_point(const std::string& path) const {
+	// 选择与路径前缀匹配的最长挂载点
+	std::string mount_point = "/";
 	for(const auto& part : partitions) {
-		if(part.name == name) {
-			return false;
+		if(path.find(part.mount_point) == 0 && 
+			part.mount_point.length() > mount_point.length()) {
+			mount_point = part.mount_point;
+		}
+	}
+	return mount_point;
+}
+
+DiskManager::Partition* DiskManager::find_partition_by_mount(const std::string& mount_point) {
+	for(auto& part : partitions) {
+		if(part.is_mounted && part.mount_point == mount_point) {
+			return &part;
 		}
 	}
+	return nullptr;
+}
+
+std::shared_ptr<DiskManager::Tree>& DiskManager::tree_for(const std::string& path) {
+	Partition* part = find_partition_by_mount(find_mount_point(path));
+	return part ? part->tree : detached_tree;
+}
+
+DiskManager::Directory& DiskManager::directory(const std::string& path) {
+	// 写时复制：与快照共享的目录树和条目表在首次修改前各复制一份
+	std::shared_ptr<Tree>& tree = tree_for(path);
+	if(!tree) {
+		tree = std::make_shared<Tree>();
+	} else if(tree.use_count() > 1) {
+		tree = std::make_shared<Tree>(*tree);
+	}
 	
-	// 检查是否有足够的空间
-	size_t total_used = 0;
-	for(const auto& part : partitions) {
-		total_used += part.size;
+	std::shared_ptr<Directory>& dir = (*tree)[path];
+	if(!dir) {
+		dir = std::make_shared<Directory>();
+	} else if(dir.use_count() > 1) {
+		dir = std::make_shared<Directory>(*dir);
+	}
+	return *dir;
+}
+
+const DiskManager::Directory* DiskManager::find_directory(const std::string& path) {
+	std::shared_ptr<Tree>& tree = tree_for(path);
+	if(!tree) {
+		return nullptr;
+	}
+	auto it = tree->find(path);
+	return it != tree->end() ? it->second.get() : nullptr;
+}
+
+void DiskManager::erase_directory(const std::string& path) {
+	std::shared_ptr<Tree>& tree = tree_for(path);
+	if(!tree || tree->find(path) == tree->end()) {
+		return;
+	}
+	if(tree.use_count() > 1) {
+		tree = std::make_shared<Tree>(*tree);
+	}
+	tree->erase(path);
+}
+
+DiskManager::FileEntry* DiskManager::find_entry(const std::string& filename) {
+	std::string mount_point = find_mount_point(filename);
+	if(!find_directory(mount_point)) {
+		return nullptr;
 	}
 	
-	if(total_used + size > total_size) {
-		return false;
+	// 调用者可能修改返回的条目，因此取可写的目录表；只读的路径应使用 lookup_entry
+	std::string name = filename.substr(filename.find_last_of("/") + 1);
+	for(auto& entry : directory(mount_point)) {
+		if(entry.name == name) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+const DiskManager::FileEntry* DiskManager::lookup_entry(const std::string& filename) {
+	// 不触发写时复制，快照之后的读取不会复制目录树和条目表
+	const Directory* dir = find_directory(find_mount_point(filename));
+	if(!dir) {
+		return nullptr;
 	}
 	
-	// 创建新分区
-	partitions.push_back(Partition(name, size));
-	return true;
+	std::string name = filename.substr(filename.find_last_of("/") + 1);
+	for(const auto& entry : *dir) {
+		if(entry.name == name) {
+			return &entry;
+		}
+	}
+	return nullptr;
 }
 
-bool DiskManager::delete_partition(const std::string& name) {
-	std::lock_guard<std::mutex> lock(disk_mutex);
+DiskManager::FileEntry* DiskManager::create_entry(const std::string& filename,
+	const std::string& type) {
 	
-	for(auto it = partitions.begin(); it != partitions.end(); ++it) {
-		if(it->name == name) {
-			if(it->is_mounted) {
-				return false; // 不能删除已挂载的分区
-			}
-			partitions.erase(it);
-			return true;
+	FileEntry entry;
+	entry.name = filename.substr(filename.find_last_of("/") + 1);
+	entry.type = type;
+	entry.size = 0;
+	entry.modified_time = std::time(nullptr);
+	
+	std::string mount_point = find_mount_point(filename);
+	Partition* part = find_partition_by_mount(mount_point);
+	entry.compressed = part && part->compressed;
+	
+	Directory& files = directory(mount_point);
+	files.push_back(entry);
+	return &files.back();
+}
+
+size_t DiskManager::map_offset(const FileEntry& entry, size_t offset, size_t& run) const {
+	// 将文件内偏移映射为磁盘偏移，run 返回从该位置起物理连续的字节数
+	size_t extent_offset = 0;
+	for(const auto& ext : entry.extents) {
+		size_t extent_bytes = ext.block_count * block_size;
+		if(offset < extent_offset + extent_bytes) {
+			run = extent_offset + extent_bytes - offset;
+			return ext.start_block * block_size + (offset - extent_offset);
 		}
+		extent_offset += extent_bytes;
 	}
-	return false;
+	run = 0;
+	return (size_t)-1;
 }
 
-bool DiskManager::mount_partition(const std::string& name, 
-	const std::string& mount_point) {
-		std::lock_guard<std::mutex> lock(disk_mutex);
-		
-		// 检查挂载点是否已被使用
-		for(const auto& part : partitions) {
-			if(part.is_mounted && part.mount_point == mount_point) {
-				return false;
-			}
+size_t DiskManager::allocated_bytes(const FileEntry& entry) const {
+	size_t blocks = 0;
+	for(const auto& ext : entry.extents) {
+		blocks += ext.block_count;
+	}
+	return blocks * block_size;
+}
+
+bool DiskManager::reserve_space(FileEntry& entry, size_t size, const std::string& mount_point) {
+	size_t have = allocated_bytes(entry) / block_size;
+	size_t need = (size + block_size - 1) / block_size;
+	if(need <= have) {
+		return true;
+	}
+	
+	size_t missing = need - have;
+	size_t added = 0;
+	
+	// 优先原地扩展最后一个 extent，使顺序追加的文件保持连续
+	if(!entry.extents.empty()) {
+		Extent& last = entry.extents.back();
+		size_t next = last.start_block + last.block_count;
+		while(missing > 0 && next < block_map.size() && block_map[next].is_free) {
+			block_map[next].is_free = false;
+			block_map[next].birth = generation;
+			last.block_count++;
+			next++;
+			missing--;
+			added++;
+		}
+	}
+	
+	// 其余部分按能找到的最大连续区间分配，找不到时逐步减半
+	size_t chunk = missing;
+	while(missing > 0) {
+		size_t count = std::min(chunk, missing);
+		size_t start = allocate_blocks(count * block_size);
+		if(start == (size_t)-1) {
+			if(chunk == 1) break;
+			chunk /= 2;
+			continue;
 		}
 		
-		// 查找并挂载分区
-		for(auto& part : partitions) {
-			if(part.name == name) {
-				if(part.is_mounted) {
-					return false; // 已经被挂载
+		if(!entry.extents.empty() && 
+			entry.extents.back().start_block + entry.extents.back().block_count == start) {
+			entry.extents.back().block_count += count;
+		} else {
+			entry.extents.push_back({start, count});
+		}
+		missing -= count;
+		added += count;
+	}
+	
+	Partition* part = find_partition_by_mount(mount_point);
+	if(part) {
+		part->used_space += added * block_size;
+	}
+	
+	return missing == 0;
+}
+
+void DiskManager::release_extents(FileEntry& entry, const std::string& mount_point) {
+	size_t released = 0;
+	for(const auto& ext : entry.extents) {
+		released += release_blocks(ext.start_block, ext.block_count, mount_point) * block_size;
+	}
+	entry.extents.clear();
+	for(auto& cluster : entry.clusters) {
+		free_cluster(cluster, mount_point);
+	}
+	entry.clusters.clear();
+	released += entry.tail.length;
+	free_tail(entry.tail, mount_point);
+	entry.inline_data.clear();
+	entry.size = 0;
+	
+	// 截断后的文件按分区当前设置决定是否压缩
+	Partition* part = find_partition_by_mount(mount_point);
+	entry.compressed = part && part->compressed;
+	if(part) {
+		part->used_space -= std::min(part->used_space, released);
+	}
+}
+
+size_t DiskManager::packed_length(const FileEntry& entry) const {
+	// 内联数据与尾部互斥，二者都位于文件末尾
+	return entry.inline_data.size() + entry.tail.length;
+}
+
+bool DiskManager::allocate_tail(size_t length, TailSlot& slot, const std::string& mount_point) {
+	// 首次适配：在本分区的尾块中寻找足够大的空闲段；
+	// 仍被快照引用的尾块不再写入新数据
+	Partition* part = find_partition_by_mount(mount_point);
+	uint64_t frozen = part ? part->snapshot_generation : 0;
+	for(auto& tb : tail_blocks) {
+		if(tb.second.mount_point != mount_point || block_map[tb.first].birth <= frozen) {
+			continue;
+		}
+		auto& ranges = tb.second.free_ranges;
+		for(auto it = ranges.begin(); it != ranges.end(); ++it) {
+			if(it->second >= length) {
+				slot = {tb.first, it->first, length};
+				if(it->second > length) {
+					ranges[it->first + length] = it->second - length;
 				}
-				part.mount_point = mount_point;
-				part.is_mounted = true;
-				filesystem[mount_point] = std::vector<FileEntry>();
+				ranges.erase(it);
+				tb.second.live_bytes += length;
 				return true;
 			}
 		}
-		return false;
 	}
-
-bool DiskManager::unmount_partition(const std::string& name) {
-	std::lock_guard<std::mutex> lock(disk_mutex);
 	
-	for(auto& part : partitions) {
-		if(part.name == name && part.is_mounted) {
-			filesystem.erase(part.mount_point);
-			part.is_mounted = false;
-			part.mount_point.clear();
-			return true;
-		}
+	// 没有合适的空闲段时分配新的尾块
+	size_t block = allocate_blocks(block_size);
+	if(block == (size_t)-1) {
+		return false;
 	}
-	return false;
+	TailBlock tb;
+	tb.live_bytes = length;
+	tb.mount_point = mount_point;
+	if(length < block_size) {
+		tb.free_ranges[length] = block_size - length;
+	}
+	tail_blocks[block] = tb;
+	slot = {block, 0, length};
+	return true;
 }
 
-bool DiskManager::format_partition(const std::string& name) {
-	std::lock_guard<std::mutex> lock(disk_mutex);
+void DiskManager::free_tail(TailSlot& slot, const std::string& mount_point) {
+	if(slot.length == 0) return;
 	
-	for(auto& part : partitions) {
-		if(part.name == name) {
-			if(!part.is_mounted) {
-				return false; // 分区必须先挂载才能格式化
+	Partition* part = find_partition_by_mount(mount_point);
+	uint64_t frozen = part ? part->snapshot_generation : 0;
+	auto it = tail_blocks.find(slot.block);
+	if(it != tail_blocks.end()) {
+		TailBlock& tb = it->second;
+		tb.live_bytes -= slot.length;
+		if(tb.live_bytes == 0) {
+			// 尾块中已没有数据，整块归还
+			retire_blocks(slot.block, 1, mount_point);
+			tail_blocks.erase(it);
+		} else if(block_map[slot.block].birth > frozen) {
+			// 插入空闲段并与相邻段合并
+			auto& ranges = tb.free_ranges;
+			size_t offset = slot.offset;
+			size_t length = slot.length;
+			auto next = ranges.lower_bound(offset);
+			if(next != ranges.end() && offset + length == next->first) {
+				length += next->second;
+				next = ranges.erase(next);
 			}
-			
-			// 清除文件系统中该分区的所有文件
-			filesystem[part.mount_point].clear();
-			
-			// 重置使用空间
-			part.used_space = 0;
-			
-			// 释放所有块
-			size_t start_block = (part.mount_point == "/") ? 0 : 
-			allocate_blocks(part.size);
-			size_t block_count = part.size / block_size;
-			free_blocks(start_block, block_count);
-			
-			return true;
+			if(next != ranges.begin()) {
+				auto prev = std::prev(next);
+				if(prev->first + prev->second == offset) {
+					offset = prev->first;
+					length += prev->second;
+				}
+			}
+			ranges[offset] = length;
 		}
 	}
-	return false;
+	slot = TailSlot();
 }
 
-std::vector<DiskManager::FileInfo> DiskManager::list_files(const std::string& path) {
-	std::lock_guard<std::mutex> lock(disk_mutex);
-	std::vector<FileInfo> files;
-	
-	// 查找对应目录的文件列表
-	auto it = filesystem.find(path.empty() ? "/" : path);
-	if(it != filesystem.end()) {
-		for(const auto& entry : it->second) {
-			FileInfo info;
-			info.name = entry.name;
-			info.type = entry.type;
-			info.size = entry.size;
-			info.modified_time = entry.modified_time;
-			info.path = path;
-			files.push_back(info);
+void DiskManager::trim_extents(FileEntry& entry, size_t keep_blocks, const std::string& mount_point) {
+	size_t kept = 0;
+	size_t released = 0;
+	for(auto it = entry.extents.begin(); it != entry.extents.end(); ) {
+		if(kept + it->block_count <= keep_blocks) {
+			kept += it->block_count;
+			++it;
+			continue;
+		}
+		
+		size_t keep = keep_blocks - kept;
+		released += release_blocks(it->start_block + keep, it->block_count - keep, mount_point);
+		kept += keep;
+		if(keep == 0) {
+			it = entry.extents.erase(it);
+		} else {
+			it->block_count = keep;
+			++it;
 		}
 	}
 	
-	return files;
+	Partition* part = find_partition_by_mount(mount_point);
+	if(part) {
+		part->used_space -= std::min(part->used_space, released * block_size);
+	}
 }
 
-bool DiskManager::create_file(const std::string& filename, const std::string& content) {
-	std::lock_guard<std::mutex> lock(disk_mutex);
+void DiskManager::pack_tail(FileEntry& entry, const std::string& mount_point) {
+	if(packed_length(entry) > 0 || entry.size == 0) {
+		return;
+	}
 	
-	// 查找文件所在分区
-	std::string mount_point = "/";
-	for(const auto& part : partitions) {
-		if(filename.find(part.mount_point) == 0 && 
-			part.mount_point.length() > mount_point.length()) {
-			mount_point = part.mount_point;
+	if(entry.size <= inline_limit) {
+		// 整个文件移入条目，不再占用任何块
+		std::string data(entry.size, '\0');
+		if(read_at(entry, 0, &data[0], entry.size) != entry.size) return;
+		trim_extents(entry, 0, mount_point);
+		for(auto& cluster : entry.clusters) {
+			free_cluster(cluster, mount_point);
 		}
+		entry.clusters.clear();
+		entry.inline_data = data;
+		return;
 	}
 	
-	// 创建文件条目
-	FileEntry entry;
-	entry.name = filename.substr(filename.find_last_of("/") + 1);
-	entry.type = "file";
-	entry.size = content.length();
-	entry.modified_time = std::time(nullptr);
+	// 压缩簇本身按字节存放，无需尾部打包
+	if(entry.compressed) {
+		return;
+	}
 	
-	// 分配空间
-	entry.start_block = allocate_blocks(entry.size);
-	if(entry.start_block == (size_t)-1) {
-		return false;
+	size_t tail = entry.size % block_size;
+	if(tail == 0 || tail > tail_limit) {
+		return;
 	}
-	entry.block_count = (entry.size + block_size - 1) / block_size;
 	
-	// 写入数据
-	if(!write_to_disk(entry.start_block * block_size, 
-		content.c_str(), content.length())) {
-		free_blocks(entry.start_block, entry.block_count);
-		return false;
+	// 把最后一块的有效部分搬进共享尾块，释放该块
+	size_t full_blocks = entry.size / block_size;
+	std::vector<char> data(tail);
+	TailSlot slot;
+	if(read_at(entry, full_blocks * block_size, data.data(), tail) != tail ||
+		!allocate_tail(tail, slot, mount_point)) {
+		return;
+	}
+	if(!write_to_disk(slot.block * block_size + slot.offset, data.data(), tail)) {
+		free_tail(slot, mount_point);
+		return;
 	}
 	
-	// 添加文件条目
-	filesystem[mount_point].push_back(entry);
+	trim_extents(entry, full_blocks, mount_point);
+	entry.tail = slot;
 	
-	// 更新分区使用空间
-	for(auto& part : partitions) {
-		if(part.mount_point == mount_point) {
-			part.used_space += entry.block_count * block_size;
-			break;
+	Partition* part = find_partition_by_mount(mount_point);
+	if(part) {
+		part->used_space += tail;
+	}
+}
+
+bool DiskManager::unpack_tail(FileEntry& entry, const std::string& mount_point) {
+	size_t packed = packed_length(entry);
+	if(packed == 0) {
+		return true;
+	}
+	
+	// 写入前把打包的数据还原到普通块中
+	std::string data = entry.inline_data;
+	if(entry.tail.length > 0) {
+		data.resize(entry.tail.length);
+		if(!read_from_disk(entry.tail.block * block_size + entry.tail.offset,
+			&data[0], entry.tail.length)) {
+			return false;
+		}
+		Partition* part = find_partition_by_mount(mount_point);
+		if(part) {
+			part->used_space -= std::min(part->used_space, entry.tail.length);
 		}
+		free_tail(entry.tail, mount_point);
 	}
+	entry.inline_data.clear();
+	entry.size -= packed;
 	
-	return true;
+	return write_at(entry, mount_point, entry.size, data.data(), data.size()) == data.size();
 }
 
-bool DiskManager::create_directory(const std::string& dirname) {
+bool DiskManager::store_content(FileEntry& entry, const std::string& mount_point,
+	const char* data, size_t size) {
+	
+	// 小文件直接内联，不产生任何磁盘 I/O
+	if(size <= inline_limit) {
+		entry.inline_data.assign(data, size);
+		entry.size = size;
+		entry.modified_time = std::time(nullptr);
+		return true;
+	}
+	
+	if(entry.compressed) {
+		return write_at(entry, mount_point, 0, data, size) == size;
+	}
+	
+	size_t tail = size % block_size;
+	size_t full = size - tail;
+	Partition* part = find_partition_by_mount(mount_point);
+	if(part && part->deduplicated) {
+		// 整块逐块查重后写入
+		for(size_t off = 0; off < full; off += block_size) {
+			if(!append_block(entry, mount_point, data + off)) {
+				return false;
+			}
+			entry.size = off + block_size;
+		}
+		entry.modified_time = std::time(nullptr);
+	} else if(write_at(entry, mount_point, 0, data, full) != full) {
+		return false;
+	}
+	
+	if(tail == 0) {
+		return true;
+	}
+	if(tail > tail_limit) {
+		return write_at(entry, mount_point, full, data + full, tail) == tail;
+	}
+	
+	// 尾部直接写入共享尾块
+	TailSlot slot;
+	if(!allocate_tail(tail, slot, mount_point)) {
+		return write_at(entry, mount_point, full, data + full, tail) == tail;
+	}
+	if(!write_to_disk(slot.block * block_size + slot.offset, data + full, tail)) {
+		free_tail(slot, mount_point);
+		return false;
+	}
+	entry.tail = slot;
+	entry.size = size;
+	
+	if(part) {
+		part->used_space += tail;
+	}
+	return true;
+}
+
+std::string DiskManager::dedup_key(const std::string& mount_point, char kind,
+	const char* data, size_t length) const {
+	
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digest_length = 0;
+	EVP_Digest(data, length, digest, &digest_length, EVP_sha256(), nullptr);
+	
+	// 去重范围限定在分区内，整块与压缩簇的存储格式不同，分开索引
+	std::string key = mount_point;
+	key += '\0';
+	key += kind;
+	key.append(reinterpret_cast<const char*>(digest), digest_length);
+	return key;
+}
+
+size_t DiskManager::release_blocks(size_t start_block, size_t count, const std::string& mount_point) {
+	if(block_hash.empty()) {
+		retire_blocks(start_block, count, mount_point);
+		return count;
+	}
+	
+	// 共享单元只减少引用计数，最后一个引用释放时才归还块
+	Partition* part = find_partition_by_mount(mount_point);
+	size_t freed = 0;
+	for(size_t block = start_block; block < start_block + count; ) {
+		auto it = block_hash.find(block);
+		if(it == block_hash.end()) {
+			retire_blocks(block, 1, mount_point);
+			freed++;
+			block++;
+			continue;
+		}
+		
+		std::string key = it->second;
+		DedupEntry& unit = dedup_index[key];
+		size_t unit_blocks = unit.block_count;
+		if(part) {
+			part->dedup_logical_blocks -= std::min(part->dedup_logical_blocks, unit_blocks);
+		}
+		if(--unit.refs == 0) {
+			retire_blocks(block, unit_blocks, mount_point);
+			freed += unit_blocks;
+			if(part) {
+				part->dedup_physical_blocks -= std::min(part->dedup_physical_blocks, unit_blocks);
+			}
+			dedup_index.erase(key);
+			block_hash.erase(it);
+		}
+		block += unit_blocks;
+	}
+	return freed;
+}
+
+void DiskManager::replace_block(FileEntry& entry, size_t file_block, size_t new_block) {
+	// 将文件的第 file_block 块映射到 new_block，必要时拆分所在的 extent
+	size_t base = 0;
+	for(size_t i = 0; i < entry.extents.size(); i++) {
+		Extent ext = entry.extents[i];
+		if(file_block < base + ext.block_count) {
+			size_t k = file_block - base;
+			std::vector<Extent> parts;
+			if(k > 0) {
+				parts.push_back({ext.start_block, k});
+			}
+			parts.push_back({new_block, 1});
+			if(k + 1 < ext.block_count) {
+				parts.push_back({ext.start_block + k + 1, ext.block_count - k - 1});
+			}
+			entry.extents.erase(entry.extents.begin() + i);
+			entry.extents.insert(entry.extents.begin() + i, parts.begin(), parts.end());
+			return;
+		}
+		base += ext.block_count;
+	}
+}
+
+bool DiskManager::unshare_range(FileEntry& entry, const std::string& mount_point,
+	size_t begin, size_t end) {
+	
+	Partition* part = find_partition_by_mount(mount_point);
+	uint64_t frozen = part ? part->snapshot_generation : 0;
+	if((block_hash.empty() && frozen == 0) || begin >= end) {
+		return true;
+	}
+	
+	for(size_t fb = begin / block_size; fb <= (end - 1) / block_size; fb++) {
+		size_t run;
+		size_t disk_offset = map_offset(entry, fb * block_size, run);
+		if(run == 0) break;
+		
+		size_t block = disk_offset / block_size;
+		bool in_snapshot = block_map[block].birth <= frozen;
+		auto it = block_hash.find(block);
+		if(it != block_hash.end()) {
+			std::string key = it->second;
+			DedupEntry& unit = dedup_index[key];
+			if(unit.refs == 1) {
+				// 唯一引用：内容即将改变，只需移出索引
+				dedup_index.erase(key);
+				block_hash.erase(it);
+				if(part) {
+					part->dedup_logical_blocks -= std::min<size_t>(part->dedup_logical_blocks, 1);
+					part->dedup_physical_blocks -= std::min<size_t>(part->dedup_physical_blocks, 1);
+				}
+			} else {
+				// 写时复制：为本文件复制一份私有块
+				size_t copy = allocate_blocks(block_size);
+				if(copy == (size_t)-1) {
+					return false;
+				}
+				if(!copy_on_disk(block * block_size, copy * block_size, block_size)) {
+					free_blocks(copy, 1);
+					return false;
+				}
+				unit.refs--;
+				if(part) {
+					part->dedup_logical_blocks -= std::min<size_t>(part->dedup_logical_blocks, 1);
+					part->used_space += block_size;
+				}
+				replace_block(entry, fb, copy);
+				continue;
+			}
+		}
+		if(!in_snapshot) continue;
+		
+		// 旧块仍被快照引用：复制后改写副本，旧块交给快照保管
+		size_t copy = allocate_blocks(block_size);
+		if(copy == (size_t)-1) {
+			return false;
+		}
+		if(!copy_on_disk(block * block_size, copy * block_size, block_size)) {
+			free_blocks(copy, 1);
+			return false;
+		}
+		replace_block(entry, fb, copy);
+		retire_blocks(block, 1, mount_point);
+	}
+	return true;
+}
+
+bool DiskManager::append_block(FileEntry& entry, const std::string& mount_point, const char* data) {
+	Partition* part = find_partition_by_mount(mount_point);
+	std::string key = dedup_key(mount_point, 'B', data, block_size);
+	size_t block = (size_t)-1;
+	
+	auto it = dedup_index.find(key);
+	if(it != dedup_index.end()) {
+		// 命中：引用已有块，不产生写入
+		it->second.refs++;
+		block = it->second.start_block;
+		if(part) {
+			part->dedup_logical_blocks++;
+		}
+	} else {
+		// 优先紧接上一个 extent 分配，保持文件连续
+		if(!entry.extents.empty()) {
+			size_t next = entry.extents.back().start_block + entry.extents.back().block_count;
+			if(next < block_map.size() && block_map[next].is_free) {
+				block_map[next].is_free = false;
+				block_map[next].birth = generation;
+				block = next;
+			}
+		}
+		if(block == (size_t)-1) {
+			block = allocate_blocks(block_size);
+		}
+		if(block == (size_t)-1) {
+			return false;
+		}
+		if(!write_to_disk(block * block_size, data, block_size)) {
+			free_blocks(block, 1);
+			return false;
+		}
+		
+		dedup_index[key] = {block, 1, block_size, false, 1};
+		block_hash[block] = key;
+		if(part) {
+			part->dedup_logical_blocks++;
+			part->dedup_physical_blocks++;
+			part->used_space += block_size;
+		}
+	}
+	
+	if(!entry.extents.empty() && 
+		entry.extents.back().start_block + entry.extents.back().block_count == block) {
+		entry.extents.back().block_count++;
+	} else {
+		entry.extents.push_back({block, 1});
+	}
+	return true;
+}
+
+void DiskManager::dedup_extents(FileEntry& entry, const std::string& mount_point) {
+	Partition* part = find_partition_by_mount(mount_point);
+	if(!part || !part->deduplicated || entry.compressed) {
+		return;
+	}
+	
+	// 只处理完全位于文件内容中的整块，最后不完整的块保持私有
+	size_t full_blocks = (entry.size - packed_length(entry)) / block_size;
+	if(full_blocks == 0) {
+		return;
+	}
+	
+	std::vector<Extent> rebuilt;
+	std::vector<char> buffer(block_size);
+	size_t released = 0;
+	size_t fb = 0;
+	for(const auto& ext : entry.extents) {
+		for(size_t k = 0; k < ext.block_count; k++, fb++) {
+			size_t block = ext.start_block + k;
+			if(fb < full_blocks && block_hash.find(block) == block_hash.end() &&
+				read_from_disk(block * block_size, buffer.data(), block_size)) {
+				std::string key = dedup_key(mount_point, 'B', buffer.data(), block_size);
+				auto it = dedup_index.find(key);
+				if(it != dedup_index.end()) {
+					it->second.refs++;
+					retire_blocks(block, 1, mount_point);
+					block = it->second.start_block;
+					released++;
+				} else {
+					dedup_index[key] = {block, 1, block_size, false, 1};
+					block_hash[block] = key;
+					part->dedup_physical_blocks++;
+				}
+				part->dedup_logical_blocks++;
+			}
+			
+			if(!rebuilt.empty() && rebuilt.back().start_block + rebuilt.back().block_count == block) {
+				rebuilt.back().block_count++;
+			} else {
+				rebuilt.push_back({block, 1});
+			}
+		}
+	}
+	
+	entry.extents.swap(rebuilt);
+	part->used_space -= std::min(part->used_space, released * block_size);
+}
+
+void DiskManager::cache_insert(size_t start_block, const std::vector<char>& data) {
+	cache_erase(start_block);
+	cluster_cache.emplace_front(start_block, data);
+	cache_index[start_block] = cluster_cache.begin();
+	
+	while(cluster_cache.size() > cache_capacity) {
+		cache_index.erase(cluster_cache.back().first);
+		cluster_cache.pop_back();
+	}
+}
+
+void DiskManager::cache_erase(size_t start_block) {
+	auto it = cache_index.find(start_block);
+	if(it != cache_index.end()) {
+		cluster_cache.erase(it->second);
+		cache_index.erase(it);
+	}
+}
+
+const std::vector<char>* DiskManager::cluster_data(const Cluster& cluster) {
+	auto cached = cache_index.find(cluster.start_block);
+	if(cached != cache_index.end()) {
+		cache_hits++;
+		cluster_cache.splice(cluster_cache.begin(), cluster_cache, cached->second);
+		return &cached->second->second;
+	}
+	cache_misses++;
+	
+	std::vector<char> stored(cluster.stored_length);
+	if(!read_from_disk(cluster.start_block * block_size, stored.data(), stored.size())) {
+		return nullptr;
+	}
+	
+	if(cluster.compressed) {
+		// 解压到缓存中，之后对同一簇的读取不再访问磁盘
+		std::vector<char> data(CLUSTER_SIZE);
+		uLongf length = data.size();
+		auto start = std::chrono::steady_clock::now();
+		int rc = uncompress(reinterpret_cast<Bytef*>(data.data()), &length,
+			reinterpret_cast<const Bytef*>(stored.data()), stored.size());
+		decompress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		if(rc != Z_OK) {
+			return nullptr;
+		}
+		data.resize(length);
+		stored.swap(data);
+	}
+	
+	cache_insert(cluster.start_block, stored);
+	return &cluster_cache.front().second;
+}
+
+bool DiskManager::load_cluster(const FileEntry& entry, size_t index, std::vector<char>& data) {
+	if(index >= entry.clusters.size()) {
+		data.clear();  // 尚未写入的簇视为空
+		return true;
+	}
+	
+	const std::vector<char>* cached = cluster_data(entry.clusters[index]);
+	if(!cached) {
+		return false;
+	}
+	data = *cached;
+	return true;
+}
+
+bool DiskManager::store_cluster(FileEntry& entry, const std::string& mount_point,
+	size_t index, const char* data, size_t length) {
+	
+	Partition* part = find_partition_by_mount(mount_point);
+	Cluster cluster;
+	std::string key;
+	bool shared = false;
+	
+	if(part && part->deduplicated) {
+		// 按解压后的内容查重，命中时既不压缩也不写盘
+		key = dedup_key(mount_point, 'C', data, length);
+		auto it = dedup_index.find(key);
+		if(it != dedup_index.end()) {
+			DedupEntry& unit = it->second;
+			unit.refs++;
+			cluster = {unit.start_block, unit.block_count, unit.stored_length, unit.compressed};
+			part->dedup_logical_blocks += unit.block_count;
+			shared = true;
+		}
+	}
+	
+	if(!shared) {
+		std::vector<char> buffer(compressBound(length));
+		uLongf stored_length = buffer.size();
+		auto start = std::chrono::steady_clock::now();
+		int rc = compress2(reinterpret_cast<Bytef*>(buffer.data()), &stored_length,
+			reinterpret_cast<const Bytef*>(data), length, Z_BEST_SPEED);
+		compress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		
+		// 只有能少占块时才保存压缩结果
+		cluster.compressed = rc == Z_OK &&
+			(stored_length + block_size - 1) / block_size < (length + block_size - 1) / block_size;
+		const char* payload = buffer.data();
+		if(!cluster.compressed) {
+			payload = data;
+			stored_length = length;
+		}
+		cluster.stored_length = stored_length;
+		cluster.block_count = std::max<size_t>(1, (stored_length + block_size - 1) / block_size);
+		cluster.start_block = allocate_blocks(cluster.block_count * block_size);
+		if(cluster.start_block == (size_t)-1) {
+			return false;
+		}
+		if(!write_to_disk(cluster.start_block * block_size, payload, stored_length)) {
+			free_blocks(cluster.start_block, cluster.block_count);
+			return false;
+		}
+		
+		compress_input_bytes += length;
+		compress_output_bytes += stored_length;
+		if(part) {
+			part->used_space += cluster.block_count * block_size;
+		}
+		
+		if(!key.empty()) {
+			dedup_index[key] = {cluster.start_block, cluster.block_count,
+				cluster.stored_length, cluster.compressed, 1};
+			block_hash[cluster.start_block] = key;
+			part->dedup_logical_blocks += cluster.block_count;
+			part->dedup_physical_blocks += cluster.block_count;
+		}
+	}
+	
+	// 写时复制：新簇落盘后才释放旧簇
+	if(index < entry.clusters.size()) {
+		free_cluster(entry.clusters[index], mount_point);
+		entry.clusters[index] = cluster;
+	} else {
+		entry.clusters.push_back(cluster);
+	}
+	
+	cache_insert(cluster.start_block, std::vector<char>(data, data + length));
+	return true;
+}
+
+void DiskManager::free_cluster(Cluster& cluster, const std::string& mount_point) {
+	size_t freed = release_blocks(cluster.start_block, cluster.block_count, mount_point);
+	if(freed > 0) {
+		cache_erase(cluster.start_block);
+	}
+	
+	Partition* part = find_partition_by_mount(mount_point);
+	if(part) {
+		part->used_space -= std::min(part->used_space, freed * block_size);
+	}
+	cluster.block_count = 0;
+}
+
+size_t DiskManager::write_clusters(FileEntry& entry, const std::string& mount_point,
+	size_t offset, const char* data, size_t size) {
+	
+	// 从原文件末尾所在的簇开始处理，中间的空洞以零填充
+	size_t end = offset + size;
+	size_t first = std::min(offset, entry.size) / CLUSTER_SIZE;
+	size_t last = (end - 1) / CLUSTER_SIZE;
+	std::vector<char> buffer;
+	
+	for(size_t c = first; c <= last; c++) {
+		size_t cluster_start = c * CLUSTER_SIZE;
+		size_t cluster_end = std::min(cluster_start + CLUSTER_SIZE, std::max(entry.size, end));
+		
+		bool ok = load_cluster(entry, c, buffer);
+		if(ok) {
+			buffer.resize(cluster_end - cluster_start, 0);
+			size_t lo = std::max(offset, cluster_start);
+			size_t hi = std::min(end, cluster_end);
+			if(lo < hi) {
+				memcpy(buffer.data() + (lo - cluster_start), data + (lo - offset), hi - lo);
+			}
+			ok = store_cluster(entry, mount_point, c, buffer.data(), buffer.size());
+		}
+		
+		if(!ok) {
+			// 之前的簇已经写入，文件至少延伸到当前簇的起点
+			if(c > first) {
+				entry.size = std::max(entry.size, cluster_start);
+				entry.modified_time = std::time(nullptr);
+			}
+			return cluster_start > offset ? cluster_start - offset : 0;
+		}
+	}
+	
+	entry.size = std::max(entry.size, end);
+	entry.modified_time = std::time(nullptr);
+	return size;
+}
+
+size_t DiskManager::read_at(const FileEntry& entry, size_t offset, void* buffer, size_t size) {
+	if(offset >= entry.size) {
+		return 0;
+	}
+	size = std::min(size, entry.size - offset);
+	
+	char* out = static_cast<char*>(buffer);
+	size_t done = 0;
+	
+	if(!entry.clusters.empty()) {
+		// 压缩文件从簇缓存中复制
+		while(done < size) {
+			size_t pos = offset + done;
+			size_t c = pos / CLUSTER_SIZE;
+			const std::vector<char>* data = c < entry.clusters.size() ?
+				cluster_data(entry.clusters[c]) : nullptr;
+			size_t in_cluster = pos - c * CLUSTER_SIZE;
+			if(!data || in_cluster >= data->size()) break;
+			
+			size_t len = std::min(size - done, data->size() - in_cluster);
+			memcpy(out + done, data->data() + in_cluster, len);
+			done += len;
+		}
+		return done;
+	}
+	
+	size_t packed_start = entry.size - packed_length(entry);
+	while(done < size) {
+		size_t pos = offset + done;
+		if(pos >= packed_start) {
+			// 文件末尾的数据位于条目内联区或共享尾块
+			size_t len = size - done;
+			if(!entry.inline_data.empty()) {
+				memcpy(out + done, entry.inline_data.data() + (pos - packed_start), len);
+			} else if(!read_from_disk(entry.tail.block * block_size + entry.tail.offset +
+				(pos - packed_start), out + done, len)) {
+				break;
+			}
+			done += len;
+			break;
+		}
+		
+		size_t run;
+		size_t disk_offset = map_offset(entry, pos, run);
+		if(run == 0) break;
+		
+		size_t len = std::min({size - done, run, packed_start - pos});
+		if(!read_from_disk(disk_offset, out + done, len)) break;
+		done += len;
+	}
+	return done;
+}
+
+size_t DiskManager::write_at(FileEntry& entry, const std::string& mount_point,
+	size_t offset, const void* data, size_t size) {
+	
+	if(size == 0 || !unpack_tail(entry, mount_point)) {
+		return 0;
+	}
+	
+	if(entry.compressed) {
+		return write_clusters(entry, mount_point, offset, static_cast<const char*>(data), size);
+	}
+	
+	// 空间不足时尽量写入已分配的部分
+	reserve_space(entry, offset + size, mount_point);
+	size_t capacity = allocated_bytes(entry);
+	if(offset >= capacity) {
+		return 0;
+	}
+	size = std::min(size, capacity - offset);
+	
+	// 与其他文件共享的块先复制一份私有副本
+	if(!unshare_range(entry, mount_point, std::min(offset, entry.size), offset + size)) {
+		return 0;
+	}
+	
+	// 越过文件末尾写入时先将空洞清零，避免暴露已释放块中的旧数据
+	if(offset > entry.size) {
+		std::vector<char> zeros(std::min(offset - entry.size, STREAM_CHUNK), 0);
+		size_t pos = entry.size;
+		while(pos < offset) {
+			size_t run;
+			size_t disk_offset = map_offset(entry, pos, run);
+			size_t len = std::min({offset - pos, run, zeros.size()});
+			if(run == 0 || !write_to_disk(disk_offset, zeros.data(), len)) {
+				return 0;
+			}
+			pos += len;
+		}
+	}
+	
+	const char* in = static_cast<const char*>(data);
+	size_t done = 0;
+	while(done < size) {
+		size_t run;
+		size_t disk_offset = map_offset(entry, offset + done, run);
+		if(run == 0) break;
+		
+		size_t len = std::min(size - done, run);
+		if(!write_to_disk(disk_offset, in + done, len)) break;
+		done += len;
+	}
+	
+	entry.size = std::max(entry.size, offset + done);
+	entry.modified_time = std::time(nullptr);
+	return done;
+}
+
+bool DiskManager::copy_on_disk(size_t src_offset, size_t dst_offset, size_t size) {
+	if(disk_fd < 0) {
+		return false;
+	}
+	
+	// 优先使用 copy_file_range：数据不经过用户态，支持 reflink 的宿主文件系统上可直接共享
+	size_t total = size;
+	loff_t in = src_offset;
+	loff_t out = dst_offset;
+	while(size > 0) {
+		ssize_t n = copy_file_range(disk_fd, &in, disk_fd, &out, size, 0);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) break;
+		size -= n;
+	}
+	if(size == 0) {
+		copy_checksums(src_offset, dst_offset, total);
+		return true;
+	}
+	
+	// 退回 sendfile：它写到 out_fd 的当前位置，因此需要独立的写描述符
+	int out_fd = ::open(disk_file.c_str(), O_WRONLY);
+	if(out_fd >= 0) {
+		if(lseek(out_fd, out, SEEK_SET) == out) {
+			while(size > 0) {
+				off_t in_off = in;
+				ssize_t n = sendfile(out_fd, disk_fd, &in_off, size);
+				if(n < 0 && errno == EINTR) continue;
+				if(n <= 0) break;
+				in += n;
+				out += n;
+				size -= n;
+			}
+		}
+		::close(out_fd);
+	}
+	
+	// 最后退回有界的用户态缓冲复制
+	std::vector<char> buffer(std::min(size, STREAM_CHUNK));
+	while(size > 0) {
+		size_t len = std::min(size, buffer.size());
+		if(!read_from_disk(in, buffer.data(), len) ||
+			!write_to_disk(out, buffer.data(), len)) {
+			return false;
+		}
+		in += len;
+		out += len;
+		size -= len;
+	}
+	copy_checksums(src_offset, dst_offset, total);
+	return true;
+}
+
+void DiskManager::copy_checksums(size_t src_offset, size_t dst_offset, size_t size) {
+	// 绕过 write_to_disk 的复制：源和目标都按块对齐时沿用源块的校验和，
+	// 这样源数据若已损坏，读取副本时同样能发现；否则读回目标块重新计算
+	if(size == 0) {
+		return;
+	}
+	if(src_offset % block_size == 0 && dst_offset % block_size == 0 && size % block_size == 0) {
+		size_t src = src_offset / block_size;
+		size_t dst = dst_offset / block_size;
+		for(size_t i = 0; i < size / block_size && dst + i < block_map.size(); i++) {
+			block_map[dst + i].checksum = block_map[src + i].checksum;
+			block_map[dst + i].checksummed = block_map[src + i].checksummed;
+		}
+	} else {
+		update_checksums(dst_offset, nullptr, size);
+	}
+}
+
+bool DiskManager::create_partition(const std::string& name, size_t size) {
 	std::lock_guard<std::mutex> lock(disk_mutex);
 	
-	// 判断目录是否已存在
-	std::string mount_point = "/";
+	// 检查分区名是否已存在
 	for(const auto& part : partitions) {
-		if(dirname.find(part.mount_point) == 0 && 
-			part.mount_point.length() > mount_point.length()) {
-			mount_point = part.mount_point;
+		if(part.name == name) {
+			return false;
 		}
 	}
 	
-	for(const auto& entry : filesystem[mount_point]) {
+	// 检查是否有足够的空间
+	size_t total_used = 0;
+	for(const auto& part : partitions) {
+		total_used += part.size;
+	}
+	
+	if(total_used + size > total_size) {
+		return false;
+	}
+	
+	// 创建新分区
+	partitions.push_back(Partition(name, size));
+	return true;
+}
+
+bool DiskManager::delete_partition(const std::string& name) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	for(auto it = partitions.begin(); it != partitions.end(); ++it) {
+		if(it->name == name) {
+			if(it->is_mounted) {
+				return false; // 不能删除已挂载的分区
+			}
+			// 分区的快照随分区一起删除，归还其保留的块
+			for(size_t i = snapshots.size(); i-- > 0; ) {
+				if(snapshots[i].partition == name) {
+					drop_snapshot(i);
+				}
+			}
+			partitions.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DiskManager::mount_partition(const std::string& name, 
+	const std::string& mount_point) {
+		std::lock_guard<std::mutex> lock(disk_mutex);
+		
+		// 检查挂载点是否已被使用
+		for(const auto& part : partitions) {
+			if(part.is_mounted && part.mount_point == mount_point) {
+				return false;
+			}
+		}
+		
+		// 查找并挂载分区
+		for(auto& part : partitions) {
+			if(part.name == name) {
+				if(part.is_mounted) {
+					return false; // 已经被挂载
+				}
+				part.mount_point = mount_point;
+				part.is_mounted = true;
+				part.tree = std::make_shared<Tree>();
+				(*part.tree)[mount_point] = std::make_shared<Directory>();
+				return true;
+			}
+		}
+		return false;
+	}
+
+bool DiskManager::unmount_partition(const std::string& name) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	for(auto& part : partitions) {
+		if(part.name == name && part.is_mounted) {
+			part.tree.reset();
+			part.is_mounted = false;
+			part.mount_point.clear();
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DiskManager::format_partition(const std::string& name) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	for(auto& part : partitions) {
+		if(part.name == name) {
+			if(!part.is_mounted) {
+				return false; // 分区必须先挂载才能格式化
+			}
+			
+			// 释放该分区所有文件占用的块，并清除文件系统条目
+			Directory& files = directory(part.mount_point);
+			for(auto& entry : files) {
+				release_extents(entry, part.mount_point);
+			}
+			files.clear();
+			
+			// 重置使用空间
+			part.used_space = 0;
+			
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DiskManager::set_partition_compression(const std::string& name, bool enabled) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	for(auto& part : partitions) {
+		if(part.name == name) {
+			part.compressed = enabled;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DiskManager::set_partition_dedup(const std::string& name, bool enabled) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	for(auto& part : partitions) {
+		if(part.name == name) {
+			part.deduplicated = enabled;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<DiskManager::FileInfo> DiskManager::list_files(const std::string& path) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	std::vector<FileInfo> files;
+	
+	// 查找对应目录的文件列表
+	const Directory* dir = find_directory(path.empty() ? "/" : path);
+	if(dir) {
+		for(const auto& entry : *dir) {
+			FileInfo info;
+			info.name = entry.name;
+			info.type = entry.type;
+			info.size = entry.size;
+			info.modified_time = entry.modified_time;
+			info.path = path;
+			files.push_back(info);
+		}
+	}
+	
+	return files;
+}
+
+bool DiskManager::create_file(const std::string& filename, const std::string& content) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	if(find_entry(filename)) {
+		return false;  // 同名文件或目录已存在
+	}
+	
+	std::string mount_point = find_mount_point(filename);
+	FileEntry* entry = create_entry(filename, "file");
+	
+	// 分配空间并写入数据
+	if(!store_content(*entry, mount_point, content.data(), content.length())) {
+		release_extents(*entry, mount_point);
+		directory(mount_point).pop_back();  // 刚创建的条目位于末尾
+		return false;
+	}
+	
+	return true;
+}
+
+bool DiskManager::create_directory(const std::string& dirname) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	// 判断目录是否已存在
+	std::string mount_point = find_mount_point(dirname);
+	
+	for(const auto& entry : directory(mount_point)) {
 		if(entry.name == dirname) {
 			return false;  // 同名文件或目录已存在
 		}
@@ -317,130 +1628,468 @@ bool DiskManager::create_directory(const std::string& dirname) {
 	entry.type = "directory";
 	entry.size = 0;
 	entry.modified_time = std::time(nullptr);
-	entry.start_block = 0;  // 目录不占用数据块
-	entry.block_count = 0;
+	// 目录不占用数据块，extents 为空
 	
 	// 添加目录条目
-	filesystem[mount_point].push_back(entry);
+	directory(mount_point).push_back(entry);
 	
 	// 为新目录创建文件列表
 	std::string full_path = mount_point;
 	if(full_path != "/") full_path += "/";
 	full_path += entry.name;
-	filesystem[full_path] = std::vector<FileEntry>();
+	directory(full_path).clear();
+	
+	return true;
+}
+
+bool DiskManager::delete_file(const std::string& filename) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	// 查找文件所在分区
+	std::string mount_point = find_mount_point(filename);
+	
+	// 查找并删除文件
+	Directory& files = directory(mount_point);
+	for(auto it = files.begin(); it != files.end(); ++it) {
+		if(it->name == filename.substr(filename.find_last_of("/") + 1) && 
+			it->type == "file") {
+			// 释放文件占用的块并更新分区使用空间
+			release_extents(*it, mount_point);
+			
+			// 删除文件条目
+			files.erase(it);
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+bool DiskManager::delete_directory(const std::string& dirname) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	// 查找目录所在分区
+	std::string mount_point = find_mount_point(dirname);
+	
+	// 构建完整路径
+	std::string full_path = mount_point;
+	if(full_path != "/") full_path += "/";
+	full_path += dirname.substr(dirname.find_last_of("/") + 1);
+	
+	// 检查目录是否为空
+	const Directory* sub = find_directory(full_path);
+	if(sub && !sub->empty()) {
+		return false;  // 不能删除非空目录
+	}
+	
+	// 删除目录条目
+	Directory& entries = directory(mount_point);
+	for(auto it = entries.begin(); it != entries.end(); ++it) {
+		if(it->name == dirname.substr(dirname.find_last_of("/") + 1) && 
+			it->type == "directory") {
+			entries.erase(it);
+			// 删除目录的文件列表
+			erase_directory(full_path);
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+bool DiskManager::write_file(const std::string& filename, const std::string& content) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	std::string mount_point = find_mount_point(filename);
+	FileEntry* entry = find_entry(filename);
+	if(entry && entry->type != "file") {
+		return false;
+	}
+	
+	// 已存在的文件就地截断后重写
+	if(entry) {
+		release_extents(*entry, mount_point);
+	} else {
+		entry = create_entry(filename, "file");
+	}
+	
+	if(!store_content(*entry, mount_point, content.data(), content.length())) {
+		release_extents(*entry, mount_point);
+		Directory& files = directory(mount_point);
+		files.erase(files.begin() + (entry - files.data()));
+		return false;
+	}
+	
+	return true;
+}
+
+// 整个文件读入内存；大文件应使用 open_file 流式读取
+std::string DiskManager::read_file(const std::string& filename) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	const FileEntry* entry = lookup_entry(filename);
+	if(!entry || entry->type != "file") {
+		return "";
+	}
+	
+	std::string content(entry->size, '\0');
+	if(read_at(*entry, 0, &content[0], entry->size) != entry->size) {
+		return "";
+	}
+	return content;
+}
+
+bool DiskManager::get_file_layout(const std::string& filename, std::vector<FileSegment>& segments) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	segments.clear();
+	const FileEntry* entry = lookup_entry(filename);
+	if(!entry || entry->type != "file" || disk_fd < 0) {
+		return false;
+	}
+	
+	// 压缩文件只能解码后发送
+	if(!entry->clusters.empty()) {
+		std::string content(entry->size, '\0');
+		if(read_at(*entry, 0, &content[0], entry->size) != entry->size) {
+			return false;
+		}
+		segments.push_back({0, content.size(), std::move(content)});
+		return true;
+	}
+	
+	// 整块区段按镜像偏移给出，物理相邻的区段合并
+	size_t packed_start = entry->size - packed_length(*entry);
+	size_t pos = 0;
+	while(pos < packed_start) {
+		size_t run;
+		size_t disk_offset = map_offset(*entry, pos, run);
+		if(run == 0) {
+			return false;
+		}
+		size_t len = std::min(run, packed_start - pos);
+		if(!segments.empty() && segments.back().data.empty() &&
+		   segments.back().image_offset + segments.back().length == disk_offset) {
+			segments.back().length += len;
+		} else {
+			segments.push_back({disk_offset, len, std::string()});
+		}
+		pos += len;
+	}
 	
+	if(packed_start < entry->size) {
+		std::string tail(entry->size - packed_start, '\0');
+		if(read_at(*entry, packed_start, &tail[0], tail.size()) != tail.size()) {
+			return false;
+		}
+		segments.push_back({0, tail.size(), std::move(tail)});
+	}
 	return true;
 }
 
-bool DiskManager::delete_file(const std::string& filename) {
+bool DiskManager::copy_file(const std::string& source, const std::string& destination) {
 	std::lock_guard<std::mutex> lock(disk_mutex);
 	
-	// 查找文件所在分区
-	std::string mount_point = "/";
-	for(const auto& part : partitions) {
-		if(filename.find(part.mount_point) == 0 && 
-			part.mount_point.length() > mount_point.length()) {
-			mount_point = part.mount_point;
+	FileEntry* src = find_entry(source);
+	if(!src || src->type != "file" || find_entry(destination)) {
+		return false;
+	}
+	
+	std::string mount_point = find_mount_point(destination);
+	FileEntry* dst = create_entry(destination, "file");
+	src = find_entry(source);  // 新增条目可能使原指针失效
+	
+	if(src->compressed || dst->compressed) {
+		// 涉及压缩文件时解码后按目标分区的方式重新写入，每次处理一个簇
+		std::vector<char> buffer(CLUSTER_SIZE);
+		size_t done = 0;
+		while(done < src->size) {
+			size_t n = read_at(*src, done, buffer.data(), buffer.size());
+			if(n == 0 || write_at(*dst, mount_point, done, buffer.data(), n) != n) {
+				release_extents(*dst, mount_point);
+				directory(mount_point).pop_back();
+				return false;
+			}
+			done += n;
 		}
+		pack_tail(*dst, mount_point);
+		return true;
 	}
 	
-	// 查找并删除文件
-	auto& files = filesystem[mount_point];
-	for(auto it = files.begin(); it != files.end(); ++it) {
-		if(it->name == filename.substr(filename.find_last_of("/") + 1) && 
-			it->type == "file") {
-			// 释放文件占用的块
-			free_blocks(it->start_block, it->block_count);
-			
-			// 更新分区使用空间
-			for(auto& part : partitions) {
-				if(part.mount_point == mount_point) {
-					part.used_space -= it->block_count * block_size;
-					break;
+	// 整块部分在镜像内部复制，打包的尾部单独处理
+	size_t full = src->size - packed_length(*src);
+	Partition* part = find_partition_by_mount(mount_point);
+	
+	if(part && part->deduplicated && find_mount_point(source) == mount_point) {
+		// 同一去重分区内复制：已索引的整块只增加引用计数
+		dedup_extents(*src, mount_point);
+		for(size_t fb = 0; fb * block_size < full; fb++) {
+			size_t run;
+			size_t block = map_offset(*src, fb * block_size, run) / block_size;
+			auto it = block_hash.find(block);
+			if(it != block_hash.end()) {
+				dedup_index[it->second].refs++;
+				part->dedup_logical_blocks++;
+			} else {
+				size_t copy = allocate_blocks(block_size);
+				if(copy != (size_t)-1 && 
+					!copy_on_disk(block * block_size, copy * block_size, block_size)) {
+					free_blocks(copy, 1);
+					copy = (size_t)-1;
 				}
+				if(copy == (size_t)-1) {
+					release_extents(*dst, mount_point);
+					directory(mount_point).pop_back();
+					return false;
+				}
+				part->used_space += block_size;
+				block = copy;
 			}
 			
-			// 删除文件条目
-			files.erase(it);
-			return true;
+			if(!dst->extents.empty() && 
+				dst->extents.back().start_block + dst->extents.back().block_count == block) {
+				dst->extents.back().block_count++;
+			} else {
+				dst->extents.push_back({block, 1});
+			}
+		}
+	} else {
+		if(!reserve_space(*dst, full, mount_point)) {
+			release_extents(*dst, mount_point);
+			directory(mount_point).pop_back();
+			return false;
+		}
+		
+		// 逐段复制，两端都按物理连续区间切分
+		size_t done = 0;
+		while(done < full) {
+			size_t src_run, dst_run;
+			size_t src_offset = map_offset(*src, done, src_run);
+			size_t dst_offset = map_offset(*dst, done, dst_run);
+			size_t len = std::min({full - done, src_run, dst_run});
+			
+			if(len == 0 || !copy_on_disk(src_offset, dst_offset, len)) {
+				release_extents(*dst, mount_point);
+				directory(mount_point).pop_back();
+				return false;
+			}
+			done += len;
 		}
 	}
+	dst->size = full;
 	
-	return false;
+	if(!src->inline_data.empty()) {
+		dst->inline_data = src->inline_data;
+		dst->size = src->size;
+	} else if(src->tail.length > 0) {
+		std::vector<char> tail(src->tail.length);
+		TailSlot slot;
+		bool ok = read_from_disk(src->tail.block * block_size + src->tail.offset,
+			tail.data(), tail.size()) && allocate_tail(tail.size(), slot, mount_point);
+		if(ok && !write_to_disk(slot.block * block_size + slot.offset, tail.data(), tail.size())) {
+			free_tail(slot, mount_point);
+			ok = false;
+		}
+		if(!ok) {
+			release_extents(*dst, mount_point);
+			directory(mount_point).pop_back();
+			return false;
+		}
+		dst->tail = slot;
+		dst->size = src->size;
+		
+		if(part) {
+			part->used_space += slot.length;
+		}
+	}
+	
+	// 从其他分区复制进去重分区时，落盘后再查重
+	dedup_extents(*dst, mount_point);
+	return true;
 }
 
-bool DiskManager::delete_directory(const std::string& dirname) {
+std::unique_ptr<DiskManager::FileHandle> DiskManager::open_file(
+	const std::string& filename, OpenMode mode) {
+	
 	std::lock_guard<std::mutex> lock(disk_mutex);
 	
-	// 查找目录所在分区
-	std::string mount_point = "/";
-	for(const auto& part : partitions) {
-		if(dirname.find(part.mount_point) == 0 && 
-			part.mount_point.length() > mount_point.length()) {
-			mount_point = part.mount_point;
+	// 只在需要截断或创建时取可写的条目
+	const FileEntry* existing = lookup_entry(filename);
+	if(existing && existing->type != "file") {
+		return nullptr;
+	}
+	
+	switch(mode) {
+		case OpenMode::READ:
+		case OpenMode::READ_WRITE:
+		if(!existing) return nullptr;
+		break;
+		
+		case OpenMode::WRITE:
+		if(existing) {
+			FileEntry* entry = find_entry(filename);
+			release_extents(*entry, find_mount_point(filename));
+			entry->modified_time = std::time(nullptr);
+		} else {
+			create_entry(filename, "file");
 		}
+		break;
+		
+		case OpenMode::APPEND:
+		if(!existing) {
+			create_entry(filename, "file");
+		}
+		break;
 	}
 	
-	// 构建完整路径
-	std::string full_path = mount_point;
-	if(full_path != "/") full_path += "/";
-	full_path += dirname.substr(dirname.find_last_of("/") + 1);
+	return std::unique_ptr<FileHandle>(new FileHandle(*this, filename, mode));
+}
+
+DiskManager::FileHandle::FileHandle(DiskManager& dm, const std::string& file, OpenMode m)
+: disk(dm), filename(file), mode(m), position(0), open(true), dirty(false),
+pending_cluster(0), has_pending(false) {
+}
+
+DiskManager::FileHandle::~FileHandle() {
+	close();
+}
+
+size_t DiskManager::FileHandle::read(void* buffer, size_t size) {
+	if(!open) return 0;
 	
-	// 检查目录是否为空
-	if(!filesystem[full_path].empty()) {
-		return false;  // 不能删除非空目录
+	std::lock_guard<std::mutex> lock(disk.disk_mutex);
+	
+	const FileEntry* entry = settled_entry();
+	if(!entry) return 0;
+	
+	size_t n = disk.read_at(*entry, position, buffer, size);
+	position += n;
+	return n;
+}
+
+size_t DiskManager::FileHandle::write(const void* data, size_t size) {
+	if(!open || mode == OpenMode::READ) return 0;
+	
+	std::lock_guard<std::mutex> lock(disk.disk_mutex);
+	
+	FileEntry* entry = disk.find_entry(filename);
+	if(!entry) return 0;
+	
+	std::string mount_point = disk.find_mount_point(filename);
+	if(mode == OpenMode::APPEND) {
+		position = entry->size;
+		if(has_pending) {
+			position = std::max(position, pending_cluster * CLUSTER_SIZE + pending.size());
+		}
 	}
 	
-	// 删除目录条目
-	auto& entries = filesystem[mount_point];
-	for(auto it = entries.begin(); it != entries.end(); ++it) {
-		if(it->name == dirname.substr(dirname.find_last_of("/") + 1) && 
-			it->type == "directory") {
-			entries.erase(it);
-			// 删除目录的文件列表
-			filesystem.erase(full_path);
-			return true;
+	if(!entry->compressed) {
+		size_t n = disk.write_at(*entry, mount_point, position, data, size);
+		position += n;
+		dirty = dirty || n > 0;
+		return n;
+	}
+	
+	// 压缩文件先写入簇缓冲，避免每次小写入都重新压缩整个簇
+	if(!disk.unpack_tail(*entry, mount_point)) return 0;
+	
+	const char* in = static_cast<const char*>(data);
+	size_t done = 0;
+	while(done < size) {
+		size_t pos = position + done;
+		size_t c = pos / CLUSTER_SIZE;
+		if(!has_pending || pending_cluster != c) {
+			flush_pending(*entry, mount_point);
+			if(!disk.load_cluster(*entry, c, pending)) break;
+			pending_cluster = c;
+			has_pending = true;
 		}
+		
+		size_t in_cluster = pos - c * CLUSTER_SIZE;
+		size_t len = std::min(size - done, CLUSTER_SIZE - in_cluster);
+		if(pending.size() < in_cluster + len) {
+			pending.resize(in_cluster + len, 0);
+		}
+		memcpy(pending.data() + in_cluster, in + done, len);
+		done += len;
 	}
 	
-	return false;
+	position += done;
+	dirty = dirty || done > 0;
+	return done;
 }
 
-bool DiskManager::write_file(const std::string& filename, const std::string& content) {
-	// 如果文件已存在，先删除它
-	delete_file(filename);
-	// 创建新文件
-	return create_file(filename, content);
+bool DiskManager::FileHandle::flush_pending(FileEntry& entry, const std::string& mount_point) {
+	if(!has_pending) return true;
+	
+	bool ok = true;
+	if(!pending.empty()) {
+		ok = disk.write_clusters(entry, mount_point, pending_cluster * CLUSTER_SIZE,
+			pending.data(), pending.size()) == pending.size();
+	}
+	pending.clear();
+	has_pending = false;
+	return ok;
 }
 
-std::string DiskManager::read_file(const std::string& filename) {
-	std::lock_guard<std::mutex> lock(disk_mutex);
+const DiskManager::FileEntry* DiskManager::FileHandle::settled_entry() {
+	if(has_pending) {
+		FileEntry* entry = disk.find_entry(filename);
+		if(!entry) return nullptr;
+		flush_pending(*entry, disk.find_mount_point(filename));
+	}
+	return disk.lookup_entry(filename);
+}
+
+bool DiskManager::FileHandle::seek(long long offset, int whence) {
+	if(!open) return false;
 	
-	// 查找文件所在分区
-	std::string mount_point = "/";
-	for(const auto& part : partitions) {
-		if(filename.find(part.mount_point) == 0 && 
-			part.mount_point.length() > mount_point.length()) {
-			mount_point = part.mount_point;
-		}
+	long long base = 0;
+	switch(whence) {
+		case SEEK_SET: base = 0; break;
+		case SEEK_CUR: base = static_cast<long long>(position); break;
+		case SEEK_END: base = static_cast<long long>(size()); break;
+		default: return false;
 	}
 	
-	// 查找文件
-	const auto& files = filesystem[mount_point];
-	for(const auto& entry : files) {
-		if(entry.name == filename.substr(filename.find_last_of("/") + 1) && 
-			entry.type == "file") {
-			// 读取文件内容
-			std::vector<char> buffer(entry.size);
-			if(read_from_disk(entry.start_block * block_size, 
-				buffer.data(), entry.size)) {
-				return std::string(buffer.begin(), buffer.end());
-			}
-			break;
-		}
+	if(base + offset < 0) {
+		return false;
 	}
+	position = static_cast<size_t>(base + offset);
+	return true;
+}
+
+size_t DiskManager::FileHandle::size() {
+	std::lock_guard<std::mutex> lock(disk.disk_mutex);
 	
-	return "";
+	const FileEntry* entry = settled_entry();
+	return entry ? entry->size : 0;
+}
+
+bool DiskManager::FileHandle::flush() {
+	if(!open) return false;
+	
+	std::lock_guard<std::mutex> lock(disk.disk_mutex);
+	if(!has_pending) return true;
+	
+	FileEntry* entry = disk.find_entry(filename);
+	return entry && flush_pending(*entry, disk.find_mount_point(filename));
+}
+
+void DiskManager::FileHandle::close() {
+	if(open && dirty) {
+		// 关闭时重新内联或打包尾部
+		std::lock_guard<std::mutex> lock(disk.disk_mutex);
+		FileEntry* entry = disk.find_entry(filename);
+		if(entry) {
+			std::string mount_point = disk.find_mount_point(filename);
+			flush_pending(*entry, mount_point);
+			disk.pack_tail(*entry, mount_point);
+			disk.dedup_extents(*entry, mount_point);
+		}
+	}
+	open = false;
+	dirty = false;
 }
 
 std::vector<DiskManager::PartitionInfo> DiskManager::list_partitions() const {
@@ -453,6 +2102,10 @@ std::vector<DiskManager::PartitionInfo> DiskManager::list_partitions() const {
 		info.used_space = part.used_space;
 		info.mount_point = part.mount_point;
 		info.is_mounted = part.is_mounted;
+		info.compressed = part.compressed;
+		info.deduplicated = part.deduplicated;
+		info.dedup_ratio = part.dedup_physical_blocks > 0 ?
+			(double)part.dedup_logical_blocks / part.dedup_physical_blocks : 1.0;
 		info_list.push_back(info);
 	}
 	
@@ -468,6 +2121,10 @@ DiskManager::PartitionInfo DiskManager::get_partition_info(const std::string& na
 			info.used_space = part.used_space;
 			info.mount_point = part.mount_point;
 			info.is_mounted = part.is_mounted;
+			info.compressed = part.compressed;
+			info.deduplicated = part.deduplicated;
+			info.dedup_ratio = part.dedup_physical_blocks > 0 ?
+				(double)part.dedup_logical_blocks / part.dedup_physical_blocks : 1.0;
 			return info;
 		}
 	}
@@ -492,3 +2149,368 @@ size_t DiskManager::get_used_space() const {
 size_t DiskManager::get_total_space() const {
 	return total_size;
 }
+
+void DiskManager::set_small_file_policy(size_t inline_bytes, size_t tail_bytes) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	inline_limit = inline_bytes;
+	tail_limit = std::min(tail_bytes, block_size);
+}
+
+DiskManager::StorageStats DiskManager::get_storage_stats() {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	StorageStats stats{};
+	std::vector<const Tree*> trees;
+	for(const auto& part : partitions) {
+		if(part.tree) trees.push_back(part.tree.get());
+	}
+	if(detached_tree) {
+		trees.push_back(detached_tree.get());
+	}
+	for(const Tree* tree : trees) {
+		for(const auto& dir : *tree) {
+			for(const auto& entry : *dir.second) {
+				if(entry.type != "file") continue;
+				
+				stats.total_files++;
+				stats.logical_bytes += entry.size;
+				stats.allocated_bytes += allocated_bytes(entry);
+				for(const auto& cluster : entry.clusters) {
+					stats.allocated_bytes += cluster.block_count * block_size;
+				}
+				if(!entry.clusters.empty()) {
+					stats.compressed_files++;
+				}
+				stats.unpacked_bytes += std::max<size_t>(1,
+					(entry.size + block_size - 1) / block_size) * block_size;
+				if(!entry.inline_data.empty()) {
+					stats.inline_files++;
+				}
+				if(entry.tail.length > 0) {
+					stats.packed_tails++;
+				}
+			}
+		}
+	}
+	
+	// 共享尾块按整块计入实际占用
+	stats.tail_blocks = tail_blocks.size();
+	stats.allocated_bytes += tail_blocks.size() * block_size;
+	stats.disk_reads = disk_reads;
+	stats.disk_writes = disk_writes;
+	stats.compress_input_bytes = compress_input_bytes;
+	stats.compress_output_bytes = compress_output_bytes;
+	stats.compress_ms = compress_ns / 1e6;
+	stats.decompress_ms = decompress_ns / 1e6;
+	stats.verified_bytes = verified_bytes;
+	stats.checksum_errors = checksum_errors;
+	stats.checksum_ms = checksum_ns / 1e6;
+	stats.read_ms = read_ns / 1e6;
+	stats.cache_hits = cache_hits;
+	stats.cache_misses = cache_misses;
+	
+	// 共享单元在每个引用它的文件中都计入了一次
+	stats.dedup_units = dedup_index.size();
+	for(const auto& unit : dedup_index) {
+		size_t saved = (unit.second.refs - 1) * unit.second.block_count * block_size;
+		stats.dedup_saved_bytes += saved;
+		stats.allocated_bytes -= std::min(stats.allocated_bytes, saved);
+	}
+	return stats;
+}
+
+void DiskManager::retire_blocks(size_t start_block, size_t count, const std::string& mount_point) {
+	Partition* part = find_partition_by_mount(mount_point);
+	Snapshot* snap = part && part->snapshot_generation > 0 ? latest_snapshot(part->name) : nullptr;
+	if(!snap) {
+		free_blocks(start_block, count);
+		return;
+	}
+	
+	// 快照创建前分配的块仍被最新快照引用，记入其 deadlist 而不归还
+	for(size_t block = start_block; block < start_block + count && block < block_map.size(); block++) {
+		if(block_map[block].birth <= snap->generation) {
+			snap->deadlist.push_back(block);
+		} else {
+			free_blocks(block, 1);
+		}
+	}
+}
+
+DiskManager::Snapshot* DiskManager::latest_snapshot(const std::string& partition) {
+	for(auto it = snapshots.rbegin(); it != snapshots.rend(); ++it) {
+		if(it->partition == partition) {
+			return &*it;
+		}
+	}
+	return nullptr;
+}
+
+void DiskManager::drop_snapshot(size_t index) {
+	Snapshot& snap = snapshots[index];
+	Snapshot* prev = nullptr;
+	for(size_t i = 0; i < index; i++) {
+		if(snapshots[i].partition == snap.partition) {
+			prev = &snapshots[i];
+		}
+	}
+	
+	// 前一个快照仍引用的块转交给它，其余块已无人引用，直接归还
+	for(size_t block : snap.deadlist) {
+		if(prev && block_map[block].birth <= prev->generation) {
+			prev->deadlist.push_back(block);
+		} else {
+			cache_erase(block);
+			free_blocks(block, 1);
+		}
+	}
+	
+	std::string partition = snap.partition;
+	snapshots.erase(snapshots.begin() + index);
+	for(auto& part : partitions) {
+		if(part.name == partition) {
+			Snapshot* latest = latest_snapshot(partition);
+			part.snapshot_generation = latest ? latest->generation : 0;
+		}
+	}
+}
+
+void DiskManager::collect_blocks(const Tree& tree, std::unordered_map<size_t, size_t>& blocks) const {
+	// 统计目录树引用的每个块（整块、压缩簇与尾块）
+	for(const auto& dir : tree) {
+		for(const auto& entry : *dir.second) {
+			for(const auto& ext : entry.extents) {
+				for(size_t k = 0; k < ext.block_count; k++) {
+					blocks[ext.start_block + k]++;
+				}
+			}
+			for(const auto& cluster : entry.clusters) {
+				for(size_t k = 0; k < cluster.block_count; k++) {
+					blocks[cluster.start_block + k]++;
+				}
+			}
+			if(entry.tail.length > 0) {
+				blocks[entry.tail.block]++;
+			}
+		}
+	}
+}
+
+void DiskManager::rebuild_references(Partition& part) {
+	const std::string& mount_point = part.mount_point;
+	std::string prefix = mount_point;
+	prefix += '\0';
+	
+	// 丢弃本分区原有的去重索引和尾块记录，按新目录树重建
+	for(auto it = dedup_index.begin(); it != dedup_index.end(); ) {
+		if(it->first.compare(0, prefix.size(), prefix) == 0) {
+			block_hash.erase(it->second.start_block);
+			it = dedup_index.erase(it);
+		} else {
+			++it;
+		}
+	}
+	for(auto it = tail_blocks.begin(); it != tail_blocks.end(); ) {
+		if(it->second.mount_point == mount_point) {
+			it = tail_blocks.erase(it);
+		} else {
+			++it;
+		}
+	}
+	part.dedup_logical_blocks = 0;
+	part.dedup_physical_blocks = 0;
+	
+	// 单元起始块 -> (引用次数, 所属压缩簇)
+	std::map<size_t, std::pair<size_t, const Cluster*>> units;
+	for(const auto& dir : *part.tree) {
+		for(const auto& entry : *dir.second) {
+			for(const auto& ext : entry.extents) {
+				for(size_t k = 0; k < ext.block_count; k++) {
+					units[ext.start_block + k].first++;
+				}
+			}
+			for(const auto& cluster : entry.clusters) {
+				auto& unit = units[cluster.start_block];
+				unit.first++;
+				unit.second = &cluster;
+			}
+			if(entry.tail.length > 0) {
+				// 恢复出的尾块都受快照保护，只记录存活字节数，不再分配空闲段
+				TailBlock& tb = tail_blocks[entry.tail.block];
+				tb.live_bytes += entry.tail.length;
+				tb.mount_point = mount_point;
+			}
+		}
+	}
+	
+	// 被多个文件引用的单元必须重新登记，释放时才能按引用计数处理
+	std::vector<char> buffer(block_size);
+	for(const auto& item : units) {
+		size_t refs = item.second.first;
+		if(refs < 2) continue;
+		
+		std::string key;
+		DedupEntry unit;
+		const Cluster* cluster = item.second.second;
+		if(cluster) {
+			const std::vector<char>* data = cluster_data(*cluster);
+			if(!data) continue;
+			key = dedup_key(mount_point, 'C', data->data(), data->size());
+			unit = {cluster->start_block, cluster->block_count, cluster->stored_length,
+				cluster->compressed, refs};
+		} else {
+			if(!read_from_disk(item.first * block_size, buffer.data(), block_size)) continue;
+			key = dedup_key(mount_point, 'B', buffer.data(), block_size);
+			unit = {item.first, 1, block_size, false, refs};
+		}
+		if(dedup_index.find(key) != dedup_index.end()) {
+			// 内容相同的另一单元已登记，本单元只保留引用计数，不参与查重
+			key += '#';
+			key += std::to_string(item.first);
+		}
+		
+		dedup_index[key] = unit;
+		block_hash[item.first] = key;
+		part.dedup_logical_blocks += refs * unit.block_count;
+		part.dedup_physical_blocks += unit.block_count;
+	}
+}
+
+bool DiskManager::create_snapshot(const std::string& partition, const std::string& name) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	Partition* part = nullptr;
+	for(auto& p : partitions) {
+		if(p.name == partition && p.is_mounted && p.tree) {
+			part = &p;
+		}
+	}
+	if(!part || name.empty()) {
+		return false;
+	}
+	for(const auto& snap : snapshots) {
+		if(snap.partition == partition && snap.name == name) {
+			return false;  // 快照名已存在
+		}
+	}
+	
+	// 只共享目录树并记录代数，不复制任何数据
+	Snapshot snap;
+	snap.name = name;
+	snap.partition = partition;
+	snap.generation = generation;
+	snap.created_time = std::time(nullptr);
+	snap.tree = part->tree;
+	snap.used_space = part->used_space;
+	snapshots.push_back(snap);
+	
+	part->snapshot_generation = generation;
+	generation++;
+	return true;
+}
+
+bool DiskManager::delete_snapshot(const std::string& partition, const std::string& name) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	for(size_t i = 0; i < snapshots.size(); i++) {
+		if(snapshots[i].partition == partition && snapshots[i].name == name) {
+			drop_snapshot(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DiskManager::rollback(const std::string& partition, const std::string& name) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	Partition* part = nullptr;
+	for(auto& p : partitions) {
+		if(p.name == partition && p.is_mounted && p.tree) {
+			part = &p;
+		}
+	}
+	size_t index = snapshots.size();
+	for(size_t i = 0; i < snapshots.size(); i++) {
+		if(snapshots[i].partition == partition && snapshots[i].name == name) {
+			index = i;
+		}
+	}
+	if(!part || index == snapshots.size()) {
+		return false;
+	}
+	
+	// 之后的快照先删除，使目标快照成为最新快照
+	for(size_t i = snapshots.size(); i-- > index + 1; ) {
+		if(snapshots[i].partition == partition) {
+			drop_snapshot(i);
+		}
+	}
+	Snapshot& snap = snapshots[index];
+	
+	// 快照之后分配、只被当前版本引用的块直接归还
+	std::unordered_map<size_t, size_t> current;
+	collect_blocks(*part->tree, current);
+	for(const auto& item : current) {
+		size_t block = item.first;
+		if(block_map[block].birth <= snap.generation) continue;
+		
+		auto it = block_hash.find(block);
+		if(it != block_hash.end()) {
+			dedup_index.erase(it->second);
+			block_hash.erase(it);
+		}
+		cache_erase(block);
+		free_blocks(block, 1);
+	}
+	
+	// deadlist 中的块重新由当前版本引用；快照本身保留，可再次回滚
+	snap.deadlist.clear();
+	part->tree = snap.tree;
+	part->used_space = snap.used_space;
+	part->snapshot_generation = snap.generation;
+	rebuild_references(*part);
+	return true;
+}
+
+std::vector<DiskManager::SnapshotInfo> DiskManager::list_snapshots(const std::string& partition) const {
+	std::vector<SnapshotInfo> result;
+	for(const auto& snap : snapshots) {
+		if(!partition.empty() && snap.partition != partition) continue;
+		
+		SnapshotInfo info;
+		info.name = snap.name;
+		info.partition = snap.partition;
+		info.created_time = snap.created_time;
+		info.held_bytes = snap.deadlist.size() * block_size;
+		result.push_back(info);
+	}
+	return result;
+}
+
+std::string DiskManager::read_snapshot_file(const std::string& partition,
+	const std::string& snapshot, const std::string& filename) {
+	std::lock_guard<std::mutex> lock(disk_mutex);
+	
+	for(const auto& snap : snapshots) {
+		if(snap.partition != partition || snap.name != snapshot) continue;
+		
+		auto dir = snap.tree->find(find_mount_point(filename));
+		if(dir == snap.tree->end()) {
+			return "";
+		}
+		std::string name = filename.substr(filename.find_last_of("/") + 1);
+		for(const auto& entry : *dir->second) {
+			if(entry.name == name && entry.type == "file") {
+				std::string content(entry.size, '\0');
+				if(read_at(entry, 0, &content[0], entry.size) != entry.size) {
+					return "";
+				}
+				return content;
+			}
+		}
+		return "";
+	}
+	return "";
+}
@@ -1,11 +1,165 @@
 // filesystem.cpp
 #include "filesystem.h"
+#include "block_device.h"
 #include "memory.h"
+#include <zlib.h>
 #include <cstring>
+#include <cstdarg>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
 
-FileSystem::FileSystem() : mounted(false) {
-	superblock.magic = 0x4D465331;  // "MFS1"
+namespace {
+	// 目录项头部之后紧跟名字，记录长度按 4 字节对齐
+	uint16_t entry_length(size_t name_len) {
+		return static_cast<uint16_t>((sizeof(DirEntry) + name_len + 3) & ~size_t(3));
+	}
+	
+	const uint64_t MAX_FILE_BLOCKS =
+		DIRECT_BLOCKS + POINTERS_PER_BLOCK + (uint64_t)POINTERS_PER_BLOCK * POINTERS_PER_BLOCK;
+	
+	// 文件有 data_blocks 个数据块时连同一级、二级间接块一共占用的块数
+	uint64_t blocks_with_index(uint64_t data_blocks) {
+		uint64_t total = data_blocks;
+		if(data_blocks > DIRECT_BLOCKS) {
+			total++;
+		}
+		if(data_blocks > DIRECT_BLOCKS + POINTERS_PER_BLOCK) {
+			uint64_t rest = data_blocks - DIRECT_BLOCKS - POINTERS_PER_BLOCK;
+			total += 1 + (rest + POINTERS_PER_BLOCK - 1) / POINTERS_PER_BLOCK;
+		}
+		return total;
+	}
+	
+	const uint32_t FS_MAGIC = 0x4D465332;  // "MFS2"
+	const uint32_t INODES_PER_BLOCK = BLOCK_SIZE / sizeof(FileEntry);
+	const uint32_t BITS_PER_BLOCK = BLOCK_SIZE * 8;      // 每个分配组对应一个位图块
+	const uint32_t WORDS_PER_GROUP = BITS_PER_BLOCK / 64;
+	const uint32_t CHECKSUMS_PER_BLOCK = BLOCK_SIZE / sizeof(uint32_t);
+	const uint64_t WALK_TABLE = UINT64_MAX;   // walk_blocks 访问间接块时的逻辑序号
+	const uint32_t INODES_PER_TASK = 4096;    // 检查时每段扫描的 inode 数
+	
+	uint32_t block_checksum(const void* data) {
+		return crc32(crc32(0L, Z_NULL, 0), static_cast<const Bytef*>(data), BLOCK_SIZE);
+	}
+	
+	// 固定数量的工作线程依次领取 0..tasks-1 号任务，调用线程也参与执行
+	void run_parallel(size_t tasks, unsigned threads, const std::function<void(size_t)>& work) {
+		if(threads == 0) {
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		threads = std::min<size_t>(threads, std::max<size_t>(tasks, 1));
+		
+		std::atomic<size_t> next(0);
+		auto worker = [&]() {
+			for(size_t task = next++; task < tasks; task = next++) {
+				work(task);
+			}
+		};
+		std::vector<std::thread> pool;
+		for(unsigned i = 1; i < threads; i++) {
+			pool.emplace_back(worker);
+		}
+		worker();
+		for(auto& thread : pool) {
+			thread.join();
+		}
+	}
+	
+	// 多个线程共享的限速器：按累计字节数推算每次读取最早的开始时间
+	class Throttle {
+	public:
+		explicit Throttle(size_t bytes_per_second)
+		: rate(bytes_per_second), consumed(0), start(std::chrono::steady_clock::now()) {}
+		
+		void acquire(size_t bytes) {
+			if(!rate) return;
+			std::chrono::steady_clock::time_point due;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				due = start + std::chrono::microseconds(consumed * 1000000 / rate);
+				consumed += bytes;
+			}
+			std::this_thread::sleep_until(due);
+		}
+		
+	private:
+		uint64_t rate;
+		uint64_t consumed;
+		std::chrono::steady_clock::time_point start;
+		std::mutex mutex;
+	};
+}
+
+// 一次检查或巡检的共享状态，扫描阶段由多个工作线程并发更新
+struct FileSystem::CheckState {
+	bool repair;
+	bool fixing;                                // 修复阶段：单线程经块缓存读写
+	bool online;                                // 在线检查：持 fs_mutex 逐段扫描，块优先取自块缓存
+	std::vector<std::atomic<uint32_t>> owner;   // 块号 -> 引用它的 inode
+	std::vector<std::atomic<uint32_t>> names;   // inode -> 指向它的目录项数（不含 . 与 ..）
+	std::vector<std::vector<uint32_t>> children;  // 目录 inode -> 子项，只由扫描该目录的线程写入
+	std::vector<uint8_t> damaged;               // inode 含需要修复的块号或目录项
+	std::atomic<size_t> inodes{0};
+	std::atomic<size_t> bad_pointers{0};
+	std::atomic<size_t> duplicate_blocks{0};
+	std::atomic<size_t> unallocated_blocks{0};
+	std::atomic<size_t> leaked_blocks{0};
+	std::atomic<size_t> count_errors{0};
+	std::atomic<size_t> directory_errors{0};
+	std::atomic<size_t> link_errors{0};
+	std::atomic<size_t> orphan_inodes{0};
+	std::atomic<size_t> checksum_errors{0};
+	std::atomic<size_t> bytes_scanned{0};
+	std::atomic<size_t> repaired{0};
+	std::mutex problem_mutex;
+	std::vector<std::string> problems;
+	
+	CheckState(bool repair, size_t blocks, size_t inode_count)
+	: repair(repair), fixing(false), online(false), owner(blocks), names(inode_count),
+	children(inode_count), damaged(inode_count, 0) {}
+	
+	void problem(const char* format, ...) {
+		char text[256];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(text, sizeof(text), format, args);
+		va_end(args);
+		std::lock_guard<std::mutex> lock(problem_mutex);
+		if(problems.size() < FS_CHECK_MAX_PROBLEMS) {
+			problems.push_back(text);
+		}
+	}
+	
+	CheckReport report(bool superblock_ok, size_t groups) {
+		CheckReport result;
+		result.superblock_ok = superblock_ok;
+		result.groups = groups;
+		result.inodes = inodes;
+		result.bad_pointers = bad_pointers;
+		result.duplicate_blocks = duplicate_blocks;
+		result.unallocated_blocks = unallocated_blocks;
+		result.leaked_blocks = leaked_blocks;
+		result.count_errors = count_errors;
+		result.directory_errors = directory_errors;
+		result.link_errors = link_errors;
+		result.orphan_inodes = orphan_inodes;
+		result.checksum_errors = checksum_errors;
+		result.bytes_scanned = bytes_scanned;
+		result.repaired = repaired;
+		result.problems = problems;
+		return result;
+	}
+};
+
+FileSystem::FileSystem()
+: superblock(), alloc_goal(0), pending_bytes(0), reserved_blocks(0), writeback_error(false),
+writeback_errors(0), device(nullptr), cache_capacity(FS_CACHE_BLOCKS),
+cache_hits(0), cache_misses(0), mounted(false), flusher_stop(false), metadata_changes(0), active_scans(0) {
+	superblock.magic = FS_MAGIC;
 	superblock.block_size = BLOCK_SIZE;
 }
 
@@ -16,259 +170,1757 @@ FileSystem::~FileSystem() {
 }
 
 bool FileSystem::mount(const std::string& device, const std::string& mount_point) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
 	if(mounted) {
 		return false;
 	}
 	
-	// 读取超级块
-	// TODO: 实际实现需要从设备读取
+	if(device.empty() || device == "ram") {
+		// 使用 format(size) 创建的内存盘
+		return owned_device && mount_device(*owned_device, mount_point);
+	}
 	
-	// 初始化位图和文件表
-	block_bitmap.resize(superblock.total_blocks, false);
+	std::unique_ptr<FileBlockDevice> image(new FileBlockDevice(device, 0, BLOCK_SIZE));
+	if(!image->is_open() || !mount_device(*image, mount_point)) {
+		return false;
+	}
+	owned_device = std::move(image);
+	return true;
+}
+
+bool FileSystem::mount(BlockDevice& dev, const std::string& mount_point) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
+	return mount_device(dev, mount_point);
+}
+
+bool FileSystem::mount_device(BlockDevice& dev, const std::string& mount_point) {
+	if(mounted || dev.block_size() != BLOCK_SIZE) {
+		return false;
+	}
+	
+	// 读取超级块、位图和 inode 表
+	device = &dev;
+	block_cache.clear();
+	cache_index.clear();
+	dir_index.clear();
+	pending.clear();
+	pending_bytes = 0;
+	reserved_blocks = 0;
+	writeback_error = false;
+	if(!load_metadata()) {
+		device = nullptr;
+		return false;
+	}
 	
 	this->mount_point = mount_point;
 	mounted = true;
+	metadata_changes++;
+	flusher_stop = false;
+	flusher = std::thread(&FileSystem::flusher_loop, this);
 	return true;
 }
 
 bool FileSystem::unmount() {
+	// 后台写回线程需要 fs_mutex，在加锁之前停止；flusher_stop 置位后在线检查与巡检随即退出
+	stop_flusher();
+	
+	std::unique_lock<std::mutex> lock(fs_mutex);
 	if(!mounted) {
 		return false;
 	}
+	scans_done.wait(lock, [this] { return active_scans == 0; });
 	
-	// 保存文件系统状态
-	// TODO: 实际实现需要写回设备
+	bool ok = sync_all();
 	
+	block_cache.clear();
+	cache_index.clear();
+	dir_index.clear();
+	pending.clear();
+	pending_bytes = 0;
+	reserved_blocks = 0;
+	device = nullptr;
 	mounted = false;
-	return true;
+	return ok;
 }
 
 bool FileSystem::format(uint32_t size) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
 	if(mounted) {
 		return false;
 	}
 	
-	// 计算块数量
-	superblock.total_blocks = size / BLOCK_SIZE;
-	superblock.free_blocks = superblock.total_blocks - 1;  // 减去超级块
-	superblock.first_data_block = 1;
+	// 在新的内存盘上格式化，之后可用 mount("ram", ...) 挂载
+	owned_device.reset(new RamBlockDevice(size / BLOCK_SIZE, BLOCK_SIZE));
+	return format_device(*owned_device);
+}
+
+bool FileSystem::format(BlockDevice& dev) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
+	return format_device(dev);
+}
+
+bool FileSystem::format_device(BlockDevice& dev) {
+	if(mounted || dev.block_size() != BLOCK_SIZE || dev.block_count() < 8) {
+		return false;
+	}
+	
+	// 布局：超级块、空闲位图、校验和表、inode 表，之后为数据块
+	uint32_t total = std::min<uint64_t>(dev.block_count(), UINT32_MAX);
+	superblock = SuperBlock();
+	superblock.magic = FS_MAGIC;
+	superblock.block_size = BLOCK_SIZE;
+	superblock.total_blocks = total;
+	superblock.bitmap_block = 1;
+	superblock.bitmap_blocks = (total + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK;
+	superblock.checksum_block = superblock.bitmap_block + superblock.bitmap_blocks;
+	superblock.checksum_blocks = (total + CHECKSUMS_PER_BLOCK - 1) / CHECKSUMS_PER_BLOCK;
+	superblock.inode_table_block = superblock.checksum_block + superblock.checksum_blocks;
+	superblock.inode_count = std::max<uint32_t>(16, total / 4);  // 每 16KB 一个 inode
+	superblock.first_data_block = superblock.inode_table_block +
+		(superblock.inode_count + INODES_PER_BLOCK - 1) / INODES_PER_BLOCK;
+	if(superblock.first_data_block >= total) {
+		return false;
+	}
+	superblock.free_blocks = total - superblock.first_data_block;
+	
+	// 初始化位图，元数据区标记为已使用；末尾不存在的块保持为 0
+	bitmap_words.assign(superblock.bitmap_blocks * WORDS_PER_GROUP, 0);
+	group_free.assign(superblock.bitmap_blocks, 0);
+	superblock.free_blocks = 0;
+	mark_run(superblock.first_data_block, total - superblock.first_data_block, true);
+	alloc_goal = superblock.first_data_block;
+	block_crc.assign(total, 0);
+	
+	// 清空 inode 表，0 号 inode 保留不用，空闲 inode 从小到大分配
+	inode_table.assign(superblock.inode_count, FileEntry());
+	free_inodes.clear();
+	for(uint32_t i = superblock.inode_count - 1; i > 0; i--) {
+		free_inodes.push_back(i);
+	}
+	
+	device = &dev;
+	block_cache.clear();
+	cache_index.clear();
+	dir_index.clear();
+	
+	// 创建根目录，其 . 与 .. 都指向自身
+	uint32_t root = allocate_inode(INODE_DIRECTORY | 0755);
+	bool ok = add_entry(root, ".", root, 2) && add_entry(root, "..", root, 2) &&
+		flush_cache() && store_metadata() && dev.flush();
+	
+	block_cache.clear();
+	cache_index.clear();
+	dir_index.clear();
+	device = nullptr;
+	return ok;
+}
+
+bool FileSystem::load_metadata() {
+	alignas(FileEntry) char block[BLOCK_SIZE];
+	if(!device->read(0, block)) {
+		return false;
+	}
+	
+	SuperBlock sb;
+	memcpy(&sb, block, sizeof(sb));
+	if(sb.magic != FS_MAGIC || sb.block_size != BLOCK_SIZE ||
+		sb.total_blocks > device->block_count() || sb.first_data_block >= sb.total_blocks ||
+		sb.inode_table_block + (sb.inode_count + INODES_PER_BLOCK - 1) / INODES_PER_BLOCK >
+		sb.first_data_block) {
+		return false;  // 不是本文件系统格式化的设备
+	}
+	
+	// 位图每位对应一块，1 表示空闲；按组重新统计空闲块数
+	if(sb.bitmap_blocks != (sb.total_blocks + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK ||
+		sb.checksum_blocks != (sb.total_blocks + CHECKSUMS_PER_BLOCK - 1) / CHECKSUMS_PER_BLOCK ||
+		sb.checksum_block + sb.checksum_blocks > sb.inode_table_block) {
+		return false;
+	}
+	bitmap_words.assign(sb.bitmap_blocks * WORDS_PER_GROUP, 0);
+	group_free.assign(sb.bitmap_blocks, 0);
+	sb.free_blocks = 0;
+	for(uint32_t i = 0; i < sb.bitmap_blocks; i++) {
+		if(!device->read(sb.bitmap_block + i, block)) {
+			return false;
+		}
+		memcpy(&bitmap_words[i * WORDS_PER_GROUP], block, BLOCK_SIZE);
+	}
+	for(uint64_t bit = sb.total_blocks; bit < bitmap_words.size() * 64; bit++) {
+		bitmap_words[bit / 64] &= ~(1ULL << (bit % 64));
+	}
+	for(size_t w = 0; w < bitmap_words.size(); w++) {
+		uint32_t count = __builtin_popcountll(bitmap_words[w]);
+		group_free[w / WORDS_PER_GROUP] += count;
+		sb.free_blocks += count;
+	}
 	
-	// 初始化位图
-	block_bitmap.clear();
-	block_bitmap.resize(superblock.total_blocks, true);
-	block_bitmap[0] = false;  // 超级块已使用
+	block_crc.assign(sb.checksum_blocks * CHECKSUMS_PER_BLOCK, 0);
+	for(uint32_t i = 0; i < sb.checksum_blocks; i++) {
+		if(!device->read(sb.checksum_block + i, &block_crc[i * CHECKSUMS_PER_BLOCK])) {
+			return false;
+		}
+	}
+	block_crc.resize(sb.total_blocks);
 	
-	// 清空文件表
-	file_table.clear();
+	inode_table.assign(sb.inode_count, FileEntry());
+	for(uint32_t ino = 0; ino < sb.inode_count; ino += INODES_PER_BLOCK) {
+		if(!device->read(sb.inode_table_block + ino / INODES_PER_BLOCK, block)) {
+			return false;
+		}
+		uint32_t count = std::min(INODES_PER_BLOCK, sb.inode_count - ino);
+		memcpy(&inode_table[ino], block, count * sizeof(FileEntry));
+	}
 	
-	// 创建根目录
-	FileEntry root;
-	strcpy(root.name, "/");
-	root.size = 0;
-	root.block_count = 0;
-	root.is_directory = true;
-	root.permissions = 0755;
-	root.created_time = root.modified_time = root.accessed_time = time(nullptr);
-	file_table.push_back(root);
+	free_inodes.clear();
+	for(uint32_t i = sb.inode_count - 1; i > 0; i--) {
+		if(inode_table[i].links == 0) {
+			free_inodes.push_back(i);
+		}
+	}
 	
+	superblock = sb;
+	alloc_goal = sb.first_data_block;
 	return true;
 }
 
-uint32_t FileSystem::allocate_block() {
-	for(uint32_t i = 0; i < block_bitmap.size(); i++) {
-		if(block_bitmap[i]) {
-			block_bitmap[i] = false;
-			superblock.free_blocks--;
-			return i;
+bool FileSystem::store_metadata() {
+	// 元数据直接写设备，不占用数据块缓存
+	char block[BLOCK_SIZE];
+	memset(block, 0, BLOCK_SIZE);
+	memcpy(block, &superblock, sizeof(superblock));
+	if(!device->write(0, block)) {
+		return false;
+	}
+	
+	for(uint32_t i = 0; i < superblock.bitmap_blocks; i++) {
+		memcpy(block, &bitmap_words[i * WORDS_PER_GROUP], BLOCK_SIZE);
+		if(!device->write(superblock.bitmap_block + i, block)) {
+			return false;
+		}
+	}
+	
+	for(uint32_t i = 0; i < superblock.checksum_blocks; i++) {
+		uint32_t first = i * CHECKSUMS_PER_BLOCK;
+		uint32_t count = std::min(CHECKSUMS_PER_BLOCK, superblock.total_blocks - first);
+		memset(block, 0, BLOCK_SIZE);
+		memcpy(block, &block_crc[first], count * sizeof(uint32_t));
+		if(!device->write(superblock.checksum_block + i, block)) {
+			return false;
+		}
+	}
+	
+	for(uint32_t ino = 0; ino < superblock.inode_count; ino += INODES_PER_BLOCK) {
+		uint32_t count = std::min(INODES_PER_BLOCK, superblock.inode_count - ino);
+		memset(block, 0, BLOCK_SIZE);
+		memcpy(block, &inode_table[ino], count * sizeof(FileEntry));
+		if(!device->write(superblock.inode_table_block + ino / INODES_PER_BLOCK, block)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool FileSystem::block_is_free(uint32_t block_number) const {
+	return block_number < superblock.total_blocks &&
+		((bitmap_words[block_number / 64] >> (block_number % 64)) & 1);
+}
+
+uint32_t FileSystem::find_free(uint32_t from, uint32_t end) const {
+	// 按 64 位字扫描，跳过全满的字，用 ctz 定位第一个空闲位
+	for(uint32_t w = from / 64; (uint64_t)w * 64 < end; w++) {
+		uint64_t word = bitmap_words[w];
+		if(w == from / 64) {
+			word &= ~0ULL << (from % 64);
+		}
+		if(word) {
+			uint32_t block = w * 64 + __builtin_ctzll(word);
+			return block < end ? block : (uint32_t)-1;
 		}
 	}
 	return (uint32_t)-1;
 }
 
+uint32_t FileSystem::free_run_length(uint32_t start, uint32_t limit) const {
+	// 统计从 start 起连续的空闲块，每次处理一个字中剩余的位
+	uint32_t length = 0;
+	uint32_t block = start;
+	while(length < limit && block < superblock.total_blocks) {
+		uint32_t bit = block % 64;
+		uint64_t word = bitmap_words[block / 64] >> bit;
+		uint32_t avail = 64 - bit;
+		uint32_t ones = ~word ? std::min<uint32_t>(__builtin_ctzll(~word), avail) : 64;
+		length += ones;
+		block += ones;
+		if(ones < avail) break;
+	}
+	return std::min(length, limit);
+}
+
+void FileSystem::mark_run(uint32_t start, uint32_t count, bool free) {
+	// 逐字置位或清位，同时维护所在组与超级块的空闲计数
+	metadata_changes++;
+	uint32_t block = start;
+	uint32_t end = start + count;
+	while(block < end) {
+		uint32_t bit = block % 64;
+		uint32_t n = std::min<uint32_t>(64 - bit, end - block);
+		uint64_t mask = (n == 64 ? ~0ULL : ((1ULL << n) - 1)) << bit;
+		uint64_t& word = bitmap_words[block / 64];
+		uint32_t changed = __builtin_popcountll(free ? (~word & mask) : (word & mask));
+		uint32_t& group = group_free[block / BITS_PER_BLOCK];
+		if(free) {
+			word |= mask;
+			group += changed;
+			superblock.free_blocks += changed;
+		} else {
+			word &= ~mask;
+			group -= changed;
+			superblock.free_blocks -= changed;
+		}
+		block += n;
+	}
+}
+
+uint32_t FileSystem::allocate_run(uint32_t goal, uint32_t max_count, uint32_t& count) {
+	uint32_t groups = group_free.size();
+	count = 0;
+	// 页缓存中的文件预留的块不分给其他请求
+	if(groups == 0 || max_count == 0 || superblock.free_blocks <= reserved_blocks) {
+		return (uint32_t)-1;
+	}
+	max_count = std::min<uint64_t>(max_count, superblock.free_blocks - reserved_blocks);
+	if(goal < superblock.first_data_block || goal >= superblock.total_blocks) {
+		goal = superblock.first_data_block;
+	}
+	
+	// 第一遍只接受能满足整个请求的连续区间，第二遍取找到的第一个空闲区间；
+	// 每遍从 goal 所在组开始轮转，最后回到起始组 goal 之前的部分
+	uint32_t want = std::min(max_count, BITS_PER_BLOCK);
+	uint32_t first_group = goal / BITS_PER_BLOCK;
+	for(int pass = 0; pass < 2; pass++) {
+		for(uint32_t i = 0; i <= groups; i++) {
+			uint32_t g = (first_group + i) % groups;
+			if(group_free[g] == 0) continue;
+			
+			uint32_t begin = g * BITS_PER_BLOCK;
+			uint32_t end = std::min<uint64_t>(superblock.total_blocks, (uint64_t)begin + BITS_PER_BLOCK);
+			if(i == 0) {
+				begin = goal;
+			} else if(i == groups) {
+				end = goal;
+			}
+			
+			uint32_t pos = begin;
+			while(pos < end) {
+				uint32_t start = find_free(pos, end);
+				if(start == (uint32_t)-1) break;
+				uint32_t length = free_run_length(start, max_count);
+				if(pass == 1 || length >= want) {
+					mark_run(start, length, false);
+					count = length;
+					alloc_goal = start + length;
+					return start;
+				}
+				pos = start + length;
+			}
+		}
+	}
+	return (uint32_t)-1;
+}
+
+uint32_t FileSystem::allocate_block() {
+	uint32_t count;
+	return allocate_run(alloc_goal, 1, count);
+}
+
 void FileSystem::free_block(uint32_t block_number) {
-	if(block_number < block_bitmap.size() && !block_bitmap[block_number]) {
-		block_bitmap[block_number] = true;
-		superblock.free_blocks++;
+	if(block_number < superblock.total_blocks && !block_is_free(block_number)) {
+		mark_run(block_number, 1, true);
+		drop_cached(block_number);
 	}
 }
 
-bool FileSystem::create_file(const std::string& path) {
-	if(!mounted) return false;
+char* FileSystem::cache_block(uint32_t block_number, bool load) {
+	if(!device) {
+		return nullptr;
+	}
+	
+	auto it = cache_index.find(block_number);
+	if(it != cache_index.end()) {
+		cache_hits++;
+		block_cache.splice(block_cache.begin(), block_cache, it->second);
+		return block_cache.front().data.data();
+	}
+	cache_misses++;
+	
+	// 缓存已满时复用最久未用的缓存项，脏块先写回
+	if(block_cache.size() >= cache_capacity) {
+		CachedBlock& victim = block_cache.back();
+		if(victim.dirty && !write_back(victim.block, victim.data.data())) {
+			return nullptr;
+		}
+		cache_index.erase(victim.block);
+		block_cache.splice(block_cache.begin(), block_cache, std::prev(block_cache.end()));
+	} else {
+		block_cache.push_front(CachedBlock{0, false, std::vector<char>(BLOCK_SIZE)});
+	}
+	
+	CachedBlock& entry = block_cache.front();
+	entry.block = block_number;
+	entry.dirty = false;
+	if(load && !device->read(block_number, entry.data.data())) {
+		block_cache.pop_front();
+		return nullptr;
+	}
+	cache_index[block_number] = block_cache.begin();
+	return entry.data.data();
+}
+
+const char* FileSystem::cached_data(uint32_t block_number) const {
+	auto it = cache_index.find(block_number);
+	return it != cache_index.end() ? it->second->data.data() : nullptr;
+}
+
+void FileSystem::drop_cached(uint32_t block_number) {
+	// 释放的块无需写回
+	auto it = cache_index.find(block_number);
+	if(it != cache_index.end()) {
+		block_cache.erase(it->second);
+		cache_index.erase(it);
+	}
+}
+
+bool FileSystem::flush_cache() {
+	// 按块号顺序写回脏块
+	std::vector<CachedBlock*> dirty;
+	for(auto& entry : block_cache) {
+		if(entry.dirty) dirty.push_back(&entry);
+	}
+	std::sort(dirty.begin(), dirty.end(), [](const CachedBlock* a, const CachedBlock* b) {
+		return a->block < b->block;
+	});
+	
+	bool ok = true;
+	for(CachedBlock* entry : dirty) {
+		if(write_back(entry->block, entry->data.data())) {
+			entry->dirty = false;
+		} else {
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+bool FileSystem::write_back(uint32_t block_number, const char* data) {
+	// 数据块写入设备时记录其校验和，供巡检核对
+	if(!device->write(block_number, data)) {
+		return false;
+	}
+	block_crc[block_number] = block_checksum(data);
+	return true;
+}
+
+bool FileSystem::read_block(uint32_t block_number, void* buffer) {
+	char* data = cache_block(block_number, true);
+	if(!data) {
+		memset(buffer, 0, BLOCK_SIZE);
+		return false;
+	}
+	memcpy(buffer, data, BLOCK_SIZE);
+	return true;
+}
+
+bool FileSystem::write_block(uint32_t block_number, const void* buffer) {
+	// 整块覆盖，未命中时不必先从设备读入
+	char* data = cache_block(block_number, false);
+	if(!data) {
+		return false;
+	}
+	memcpy(data, buffer, BLOCK_SIZE);
+	block_cache.front().dirty = true;
+	return true;
+}
+
+FileSystem::CacheStats FileSystem::get_cache_stats() const {
+	std::lock_guard<std::mutex> lock(fs_mutex);
+	CacheStats stats;
+	stats.hits = cache_hits;
+	stats.misses = cache_misses;
+	stats.cached_blocks = block_cache.size();
+	stats.dirty_blocks = 0;
+	for(const auto& entry : block_cache) {
+		if(entry.dirty) stats.dirty_blocks++;
+	}
+	stats.pending_files = pending.size();
+	stats.pending_bytes = pending_bytes;
+	stats.reserved_blocks = reserved_blocks;
+	stats.writeback_errors = writeback_errors;
+	return stats;
+}
+
+uint32_t FileSystem::allocate_inode(uint16_t mode) {
+	// inode 表大小在格式化时确定，用尽时返回 0
+	if(free_inodes.empty()) {
+		return 0;
+	}
+	uint32_t ino = free_inodes.back();
+	free_inodes.pop_back();
+	metadata_changes++;
+	
+	FileEntry& inode = inode_table[ino];
+	inode = FileEntry();
+	inode.mode = mode;
+	inode.links = 1;
+	inode.created_time = inode.modified_time = inode.accessed_time = time(nullptr);
+	return ino;
+}
+
+void FileSystem::free_inode(uint32_t ino) {
+	metadata_changes++;
+	discard_pending(ino);
+	release_blocks(inode_table[ino]);
+	inode_table[ino] = FileEntry();
+	free_inodes.push_back(ino);
+}
+
+uint32_t FileSystem::map_indirect(uint32_t& table, uint32_t slot, bool allocate, bool zero_new,
+	uint32_t data_block) {
+	uint32_t pointers[POINTERS_PER_BLOCK];
+	if(!table) {
+		if(!allocate) return 0;
+		uint32_t block = allocate_block();
+		if(block == (uint32_t)-1) return 0;
+		table = block;
+		memset(pointers, 0, sizeof(pointers));
+		write_block(table, pointers);
+	} else {
+		read_block(table, pointers);
+	}
+	
+	if(!pointers[slot] && allocate) {
+		uint32_t block = data_block ? data_block : allocate_block();
+		if(block == (uint32_t)-1) return 0;
+		if(zero_new) {
+			// 新分配的下一级间接块必须清零，否则会把旧数据当作块号
+			uint32_t zero[POINTERS_PER_BLOCK] = {};
+			write_block(block, zero);
+		}
+		pointers[slot] = block;
+		write_block(table, pointers);
+	}
+	return pointers[slot];
+}
+
+uint32_t FileSystem::map_block(FileEntry& inode, uint32_t index, bool allocate, uint32_t data_block) {
+	// 返回文件第 index 块所在的块号，0 表示未分配；
+	// data_block 非 0 时使用调用者预先分配的数据块
+	if(index < DIRECT_BLOCKS) {
+		if(!inode.direct[index] && allocate) {
+			uint32_t block = data_block ? data_block : allocate_block();
+			if(block == (uint32_t)-1) return 0;
+			inode.direct[index] = block;
+		}
+		return inode.direct[index];
+	}
+	
+	index -= DIRECT_BLOCKS;
+	if(index < POINTERS_PER_BLOCK) {
+		return map_indirect(inode.indirect, index, allocate, false, data_block);
+	}
+	
+	index -= POINTERS_PER_BLOCK;
+	if(index < POINTERS_PER_BLOCK * POINTERS_PER_BLOCK) {
+		uint32_t table = map_indirect(inode.double_indirect, index / POINTERS_PER_BLOCK, allocate, true, 0);
+		if(!table) return 0;
+		return map_indirect(table, index % POINTERS_PER_BLOCK, allocate, false, data_block);
+	}
+	return 0;
+}
+
+void FileSystem::release_blocks(FileEntry& inode, uint64_t keep) {
+	// 释放文件第 keep 块及之后的所有数据块，不再需要的间接块一并释放
+	uint32_t pointers[POINTERS_PER_BLOCK];
+	uint32_t inner[POINTERS_PER_BLOCK];
+	
+	for(uint32_t i = 0; i < DIRECT_BLOCKS; i++) {
+		if(i >= keep && inode.direct[i]) {
+			free_block(inode.direct[i]);
+			inode.direct[i] = 0;
+		}
+	}
+	
+	uint64_t base = DIRECT_BLOCKS;
+	if(inode.indirect) {
+		read_block(inode.indirect, pointers);
+		bool changed = false;
+		for(uint32_t i = 0; i < POINTERS_PER_BLOCK; i++) {
+			if(base + i >= keep && pointers[i]) {
+				free_block(pointers[i]);
+				pointers[i] = 0;
+				changed = true;
+			}
+		}
+		if(keep <= base) {
+			free_block(inode.indirect);
+			inode.indirect = 0;
+		} else if(changed) {
+			write_block(inode.indirect, pointers);
+		}
+	}
+	
+	base += POINTERS_PER_BLOCK;
+	if(inode.double_indirect) {
+		read_block(inode.double_indirect, pointers);
+		bool changed = false;
+		for(uint32_t i = 0; i < POINTERS_PER_BLOCK; i++) {
+			uint64_t first = base + (uint64_t)i * POINTERS_PER_BLOCK;
+			if(!pointers[i] || first + POINTERS_PER_BLOCK <= keep) continue;
+			read_block(pointers[i], inner);
+			bool inner_changed = false;
+			for(uint32_t j = 0; j < POINTERS_PER_BLOCK; j++) {
+				if(first + j >= keep && inner[j]) {
+					free_block(inner[j]);
+					inner[j] = 0;
+					inner_changed = true;
+				}
+			}
+			if(keep <= first) {
+				free_block(pointers[i]);
+				pointers[i] = 0;
+				changed = true;
+			} else if(inner_changed) {
+				write_block(pointers[i], inner);
+			}
+		}
+		if(keep <= base) {
+			free_block(inode.double_indirect);
+			inode.double_indirect = 0;
+		} else if(changed) {
+			write_block(inode.double_indirect, pointers);
+		}
+	}
+	
+	if(keep == 0) {
+		inode.size = 0;
+	}
+}
+
+bool FileSystem::flush_file(uint32_t ino) {
+	auto found = pending.find(ino);
+	if(found == pending.end()) {
+		return true;
+	}
+	PendingFile& entry = found->second;
+	FileEntry& file = inode_table[ino];
+	uint64_t blocks_needed = (file.size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	
+	// 本文件的预留交还后再分配，失败时重新预留，页留在缓存中
+	reserved_blocks -= entry.reserved_blocks;
+	auto fail = [&] {
+		reserved_blocks += entry.reserved_blocks;
+		return false;
+	};
+	
+	// 先释放新大小之外的块
+	if(entry.mapped_blocks > blocks_needed) {
+		release_blocks(file, blocks_needed);
+	}
+	entry.mapped_blocks = blocks_needed;
+	
+	// 已有块的页原地覆盖；其余页按最终大小一次分配，从文件已有的前一块之后开始，
+	// 让追加的数据紧接原有数据
+	std::vector<uint32_t> missing;
+	for(const auto& page : entry.pages) {
+		if(!map_block(file, page.first, false)) {
+			missing.push_back(page.first);
+		}
+	}
+	uint32_t goal = alloc_goal;
+	if(!missing.empty() && missing[0] > 0) {
+		uint32_t previous = map_block(file, missing[0] - 1, false);
+		if(previous) goal = previous + 1;
+	}
+	
+	std::vector<uint32_t> targets;
+	targets.reserve(missing.size());
+	while(targets.size() < missing.size()) {
+		uint32_t count;
+		uint32_t start = allocate_run(goal, missing.size() - targets.size(), count);
+		if(start == (uint32_t)-1) {
+			for(uint32_t b : targets) {
+				free_block(b);
+			}
+			return fail();
+		}
+		for(uint32_t j = 0; j < count; j++) {
+			targets.push_back(start + j);
+		}
+		goal = alloc_goal;
+	}
+	
+	// 按块序号顺序写回，间接块在需要时分配
+	size_t next = 0;
+	for(const auto& page : entry.pages) {
+		uint32_t target = 0;
+		if(next < missing.size() && missing[next] == page.first) {
+			target = targets[next++];
+		}
+		uint32_t b = map_block(file, page.first, true, target);
+		if(!b) {
+			// 分配失败，尚未挂到 inode 上的预分配块归还
+			for(size_t j = next; j < targets.size(); j++) {
+				free_block(targets[j]);
+			}
+			if(target) free_block(target);
+			return fail();
+		}
+		if(!write_block(b, page.second.data())) {
+			for(size_t j = next; j < targets.size(); j++) {
+				free_block(targets[j]);
+			}
+			return fail();
+		}
+	}
+	
+	pending_bytes -= entry.pages.size() * BLOCK_SIZE;
+	pending.erase(found);
+	return true;
+}
+
+bool FileSystem::flush_pending() {
+	std::vector<uint32_t> inodes;
+	for(const auto& entry : pending) {
+		inodes.push_back(entry.first);
+	}
+	
+	bool ok = true;
+	for(uint32_t ino : inodes) {
+		if(!flush_file(ino)) ok = false;
+	}
+	return ok;
+}
+
+bool FileSystem::writeback_due() const {
+	if(pending_bytes >= FS_WRITEBACK_BYTES) {
+		return true;
+	}
+	time_t now = time(nullptr);
+	for(const auto& entry : pending) {
+		if(now - entry.second.dirty_since >= FS_WRITEBACK_SECONDS) return true;
+	}
+	return false;
+}
+
+void FileSystem::discard_pending(uint32_t ino) {
+	auto found = pending.find(ino);
+	if(found != pending.end()) {
+		pending_bytes -= found->second.pages.size() * BLOCK_SIZE;
+		reserved_blocks -= found->second.reserved_blocks;
+		pending.erase(found);
+	}
+}
+
+bool FileSystem::sync_all() {
+	// 先为页缓存中的数据分配块并写回数据块，再保存文件系统状态
+	return flush_pending() && flush_cache() && store_metadata() && device->flush();
+}
+
+void FileSystem::flusher_loop() {
+	// 每秒检查一次，页缓存过大或有页停留过久时把数据连同元数据一起写回设备
+	std::unique_lock<std::mutex> lock(fs_mutex);
+	while(!flusher_stop) {
+		flusher_wake.wait_for(lock, std::chrono::seconds(1));
+		if(!flusher_stop && mounted && writeback_due() && !sync_all()) {
+			writeback_error = true;
+			writeback_errors++;
+		}
+	}
+}
+
+void FileSystem::stop_flusher() {
+	{
+		std::lock_guard<std::mutex> lock(fs_mutex);
+		flusher_stop = true;
+	}
+	flusher_wake.notify_all();
+	if(flusher.joinable()) {
+		flusher.join();
+	}
+}
+
+FileSystem::DirIndex& FileSystem::directory_index(uint32_t dir) {
+	auto found = dir_index.find(dir);
+	if(found != dir_index.end()) {
+		return found->second;
+	}
 	
-	// 检查文件是否已存在
-	if(find_file(path)) return false;
+	// 首次访问时扫描一遍目录块建立名字索引，之后的查找为 O(1)
+	DirIndex& index = dir_index[dir];
+	index.search_from = 0;
+	alignas(DirEntry) char block[BLOCK_SIZE];
+	FileEntry& inode = inode_table[dir];
+	uint32_t count = inode.size / BLOCK_SIZE;
 	
-	// 创建新文件条目
-	FileEntry file;
-	std::string filename = get_filename(path);
-	if(filename.length() >= MAX_FILENAME) return false;
+	for(uint32_t i = 0; i < count; i++) {
+		uint32_t b = map_block(inode, i, false);
+		if(!b || !read_block(b, block)) continue;
+		for(uint32_t off = 0; off < BLOCK_SIZE; ) {
+			const DirEntry* e = reinterpret_cast<const DirEntry*>(block + off);
+			if(e->rec_len == 0) break;
+			if(e->inode) {
+				std::string name(block + off + sizeof(DirEntry), e->name_len);
+				index.names[name] = {e->inode, i};
+			}
+			off += e->rec_len;
+		}
+	}
+	return index;
+}
+
+uint32_t FileSystem::lookup(uint32_t dir, const std::string& name) {
+	DirIndex& index = directory_index(dir);
+	auto it = index.names.find(name);
+	return it != index.names.end() ? it->second.first : 0;
+}
+
+bool FileSystem::add_entry(uint32_t dir, const std::string& name, uint32_t ino, uint8_t type) {
+	metadata_changes++;
+	alignas(DirEntry) char block[BLOCK_SIZE];
+	DirIndex& index = directory_index(dir);
+	FileEntry& inode = inode_table[dir];
+	uint16_t need = entry_length(name.size());
+	uint32_t count = inode.size / BLOCK_SIZE;
 	
-	strcpy(file.name, filename.c_str());
-	file.size = 0;
-	file.block_count = 0;
-	file.is_directory = false;
-	file.permissions = 0644;
-	file.created_time = file.modified_time = file.accessed_time = time(nullptr);
+	// 首次适配：从上次放入新项的目录块开始，找一项剩余空间足够的记录拆分
+	for(uint32_t i = index.search_from; i < count; i++) {
+		uint32_t b = map_block(inode, i, false);
+		if(!b || !read_block(b, block)) continue;
+		for(uint32_t off = 0; off < BLOCK_SIZE; ) {
+			DirEntry* e = reinterpret_cast<DirEntry*>(block + off);
+			if(e->rec_len == 0) break;
+			uint16_t used = e->inode ? entry_length(e->name_len) : 0;
+			if(e->rec_len - used >= need) {
+				DirEntry* target = e;
+				if(e->inode) {
+					target = reinterpret_cast<DirEntry*>(block + off + used);
+					target->rec_len = e->rec_len - used;
+					e->rec_len = used;
+				}
+				target->inode = ino;
+				target->name_len = name.size();
+				target->file_type = type;
+				memcpy(reinterpret_cast<char*>(target) + sizeof(DirEntry), name.data(), name.size());
+				if(!write_block(b, block)) return false;
+				index.names[name] = {ino, i};
+				index.search_from = i;
+				inode.modified_time = time(nullptr);
+				return true;
+			}
+			off += e->rec_len;
+		}
+	}
 	
-	// 添加到文件表
-	file_table.push_back(file);
+	// 没有空位时追加一个目录块
+	uint32_t b = map_block(inode, count, true);
+	if(!b) return false;
+	memset(block, 0, BLOCK_SIZE);
+	DirEntry* e = reinterpret_cast<DirEntry*>(block);
+	e->inode = ino;
+	e->rec_len = BLOCK_SIZE;
+	e->name_len = name.size();
+	e->file_type = type;
+	memcpy(block + sizeof(DirEntry), name.data(), name.size());
+	if(!write_block(b, block)) return false;
+	index.names[name] = {ino, count};
+	index.search_from = count;
+	inode.size += BLOCK_SIZE;
+	inode.modified_time = time(nullptr);
+	return true;
+}
+
+bool FileSystem::remove_entry(uint32_t dir, const std::string& name) {
+	DirIndex& index = directory_index(dir);
+	auto it = index.names.find(name);
+	if(it == index.names.end()) {
+		return false;
+	}
+	metadata_changes++;
+	
+	// 索引记录了目录项所在的块，只需改写这一块
+	alignas(DirEntry) char block[BLOCK_SIZE];
+	FileEntry& inode = inode_table[dir];
+	uint32_t i = it->second.second;
+	uint32_t b = map_block(inode, i, false);
+	if(!b || !read_block(b, block)) return false;
+	
+	DirEntry* prev = nullptr;
+	for(uint32_t off = 0; off < BLOCK_SIZE; ) {
+		DirEntry* e = reinterpret_cast<DirEntry*>(block + off);
+		if(e->rec_len == 0) break;
+		if(e->inode && e->name_len == name.size() &&
+			memcmp(block + off + sizeof(DirEntry), name.data(), name.size()) == 0) {
+			// 并入前一项；块内第一项只标记为空闲
+			if(prev) {
+				prev->rec_len += e->rec_len;
+			} else {
+				e->inode = 0;
+			}
+			if(!write_block(b, block)) return false;
+			index.names.erase(it);
+			index.search_from = std::min(index.search_from, i);
+			inode.modified_time = time(nullptr);
+			return true;
+		}
+		prev = e;
+		off += e->rec_len;
+	}
+	return false;
+}
+
+std::vector<std::pair<std::string, uint32_t>> FileSystem::read_entries(uint32_t dir) {
+	std::vector<std::pair<std::string, uint32_t>> entries;
+	alignas(DirEntry) char block[BLOCK_SIZE];
+	FileEntry& inode = inode_table[dir];
+	uint32_t count = inode.size / BLOCK_SIZE;
+	
+	for(uint32_t i = 0; i < count; i++) {
+		uint32_t b = map_block(inode, i, false);
+		if(!b || !read_block(b, block)) continue;
+		for(uint32_t off = 0; off < BLOCK_SIZE; ) {
+			const DirEntry* e = reinterpret_cast<const DirEntry*>(block + off);
+			if(e->rec_len == 0) break;
+			if(e->inode) {
+				entries.emplace_back(std::string(block + off + sizeof(DirEntry), e->name_len), e->inode);
+			}
+			off += e->rec_len;
+		}
+	}
+	return entries;
+}
+
+uint32_t FileSystem::resolve(const std::string& path) {
+	if(inode_table.size() <= ROOT_INODE) return 0;  // 尚未格式化
+	
+	// 从根目录起逐级解析，. 与 .. 由目录项本身处理
+	uint32_t ino = ROOT_INODE;
+	size_t pos = 0;
+	while(pos < path.size()) {
+		size_t next = path.find('/', pos);
+		if(next == std::string::npos) next = path.size();
+		if(next > pos) {
+			if(!(inode_table[ino].mode & INODE_DIRECTORY)) return 0;
+			ino = lookup(ino, path.substr(pos, next - pos));
+			if(!ino) return 0;
+		}
+		pos = next + 1;
+	}
+	return ino;
+}
+
+uint32_t FileSystem::resolve_parent(const std::string& path, std::string& name) {
+	// 去掉末尾的 /，拆出最后一级名字
+	size_t end = path.find_last_not_of('/');
+	if(end == std::string::npos) return 0;
+	size_t pos = path.find_last_of('/', end);
+	name = path.substr(pos == std::string::npos ? 0 : pos + 1,
+		pos == std::string::npos ? end + 1 : end - pos);
+	
+	uint32_t parent = resolve(pos == std::string::npos ? "" : path.substr(0, pos));
+	if(!parent || !(inode_table[parent].mode & INODE_DIRECTORY)) return 0;
+	return parent;
+}
+
+bool FileSystem::create_file(const std::string& path) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
+	if(!mounted) return false;
+	
+	// 父目录必须存在，且其中没有同名项
+	std::string filename;
+	uint32_t parent = resolve_parent(path, filename);
+	if(!parent || lookup(parent, filename)) return false;
+	if(filename.length() >= MAX_FILENAME || filename == "." || filename == "..") return false;
+	
+	// 分配 inode 并在父目录中登记名字
+	uint32_t ino = allocate_inode(0644);
+	if(!ino) return false;
+	if(!add_entry(parent, filename, ino, 1)) {
+		free_inode(ino);
+		return false;
+	}
 	return true;
 }
 
 bool FileSystem::write_file(const std::string& path, const void* data, size_t size) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
 	if(!mounted) return false;
 	
 	FileEntry* file = find_file(path);
-	if(!file || file->is_directory) return false;
+	if(!file || (file->mode & INODE_DIRECTORY)) return false;
+	
+	uint64_t blocks_needed = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	if(blocks_needed > MAX_FILE_BLOCKS) return false;
 	
-	// 释放原有块
-	for(uint32_t i = 0; i < file->block_count; i++) {
-		free_block(file->blocks[i]);
+	uint32_t ino = static_cast<uint32_t>(file - inode_table.data());
+	auto found = pending.find(ino);
+	uint64_t mapped = found != pending.end() ? found->second.mapped_blocks :
+		(file->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	
+	// 写回时要新分配的数据块与间接块此时就从空闲块中预留，空间不足的写入在这里失败，
+	// 而不是留在页缓存中永远写不回去
+	uint64_t reserve = blocks_needed > mapped ? blocks_with_index(blocks_needed) - blocks_with_index(mapped) : 0;
+	uint64_t previous = found != pending.end() ? found->second.reserved_blocks : 0;
+	uint64_t others = reserved_blocks - previous;
+	if(others + reserve > superblock.free_blocks) return false;
+	
+	// 数据先进入页缓存，块在写回时按最终大小一次分配
+	if(found == pending.end()) {
+		PendingFile entry;
+		entry.mapped_blocks = mapped;
+		entry.reserved_blocks = 0;
+		entry.dirty_since = time(nullptr);
+		found = pending.emplace(ino, std::move(entry)).first;
 	}
+	PendingFile& entry = found->second;
+	entry.reserved_blocks = reserve;
+	reserved_blocks = others + reserve;
 	
-	// 分配新块
-	uint32_t blocks_needed = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
-	if(blocks_needed > MAX_BLOCKS_PER_FILE) return false;
+	// 丢弃新大小之外的页
+	for(auto it = entry.pages.lower_bound(blocks_needed); it != entry.pages.end(); ) {
+		pending_bytes -= BLOCK_SIZE;
+		it = entry.pages.erase(it);
+	}
 	
-	file->block_count = 0;
-	for(uint32_t i = 0; i < blocks_needed; i++) {
-		uint32_t new_block = allocate_block();
-		if(new_block == (uint32_t)-1) {
-			// 分配失败，回滚
-			for(uint32_t j = 0; j < file->block_count; j++) {
-				free_block(file->blocks[j]);
-			}
-			file->block_count = 0;
-			file->size = 0;
-			return false;
+	// 已映射的块仍在块缓存中且内容相同时不必写回；不为比较而读设备，
+	// 其余页一律进入页缓存，写回时已映射的块原地覆盖
+	const char* src = static_cast<const char*>(data);
+	char block[BLOCK_SIZE];
+	for(uint64_t i = 0; i < blocks_needed; i++) {
+		size_t offset = i * BLOCK_SIZE;
+		size_t length = std::min<size_t>(BLOCK_SIZE, size - offset);
+		const char* page = src + offset;
+		if(length < BLOCK_SIZE) {
+			memcpy(block, page, length);
+			memset(block + length, 0, BLOCK_SIZE - length);
+			page = block;
+		}
+		
+		auto cached = entry.pages.find(i);
+		if(cached != entry.pages.end()) {
+			memcpy(cached->second.data(), page, BLOCK_SIZE);
+			continue;
+		}
+		uint32_t b = i < entry.mapped_blocks ? map_block(*file, i, false) : 0;
+		const char* current = b ? cached_data(b) : nullptr;
+		if(current && memcmp(current, page, BLOCK_SIZE) == 0) {
+			continue;
 		}
-		file->blocks[file->block_count++] = new_block;
+		entry.pages[i].assign(page, page + BLOCK_SIZE);
+		pending_bytes += BLOCK_SIZE;
 	}
 	
-	// 写入数据
-	// TODO: 实际实现需要写入设备
-	
 	file->size = size;
 	file->modified_time = time(nullptr);
+	
+	// 页缓存过大时立即分配并写回，停留过久的页由后台线程写回
+	if(pending_bytes >= FS_WRITEBACK_BYTES) {
+		return flush_pending();
+	}
 	return true;
 }
 
+bool FileSystem::sync() {
+	std::lock_guard<std::mutex> lock(fs_mutex);
+	if(!mounted) return false;
+	
+	bool background_failed = writeback_error;
+	writeback_error = false;
+	return sync_all() && !background_failed;
+}
+
 bool FileSystem::read_file(const std::string& path, void* buffer, size_t size) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
 	if(!mounted) return false;
 	
 	FileEntry* file = find_file(path);
-	if(!file || file->is_directory) return false;
+	if(!file || (file->mode & INODE_DIRECTORY)) return false;
 	
-	// 读取数据
-	// TODO: 实际实现需要从设备读取
+	// 读取数据，页缓存中的页优先，未分配的块按 0 处理
+	auto found = pending.find(static_cast<uint32_t>(file - inode_table.data()));
+	char* dst = static_cast<char*>(buffer);
+	char block[BLOCK_SIZE];
+	size_t length = std::min<uint64_t>(size, file->size);
+	for(size_t offset = 0; offset < length; offset += BLOCK_SIZE) {
+		size_t n = std::min<size_t>(BLOCK_SIZE, length - offset);
+		if(found != pending.end()) {
+			auto page = found->second.pages.find(offset / BLOCK_SIZE);
+			if(page != found->second.pages.end()) {
+				memcpy(dst + offset, page->second.data(), n);
+				continue;
+			}
+		}
+		uint32_t b = map_block(*file, offset / BLOCK_SIZE, false);
+		if(b) {
+			if(!read_block(b, block)) return false;
+			memcpy(dst + offset, block, n);
+		} else {
+			memset(dst + offset, 0, n);
+		}
+	}
+	// 缓冲区有余量时补结束符，便于按字符串使用
+	if(length < size) {
+		dst[length] = '\0';
+	}
 	
 	file->accessed_time = time(nullptr);
 	return true;
 }
 
 FileEntry* FileSystem::find_file(const std::string& path) {
-	if(path == "/" || path.empty()) return &file_table[0];  // 返回根目录
-	
-	std::string filename = get_filename(path);
-	for(auto& entry : file_table) {
-		if(strcmp(entry.name, filename.c_str()) == 0) {
-			return &entry;
-		}
-	}
-	return nullptr;
+	uint32_t ino = resolve(path);
+	return ino ? &inode_table[ino] : nullptr;
 }
 
 // 新增函数实现
 bool FileSystem::delete_file(const std::string& path) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
 	if(!mounted) return false;
 	
-	// 不允许删除根目录
-	if(path == "/" || path.empty()) return false;
+	// 查找文件；根目录没有父目录，不允许删除
+	std::string filename;
+	uint32_t parent = resolve_parent(path, filename);
+	if(!parent || filename == "." || filename == "..") return false;
+	uint32_t ino = lookup(parent, filename);
+	if(!ino) return false;
 	
-	// 查找文件
-	auto it = std::find_if(file_table.begin(), file_table.end(),
-		[&](const FileEntry& entry) {
-			return strcmp(entry.name, get_filename(path).c_str()) == 0;
-		});
-	
-	if(it == file_table.end()) return false;
-	
-	// 如果是非空目录，不允许删除
-	if(it->is_directory) {
-		for(const auto& entry : file_table) {
-			if(strcmp(entry.name, it->name) != 0) {
-				std::string full_path = std::string(it->name) + "/" + entry.name;
-				if(find_file(full_path)) return false;
-			}
-		}
+	// 如果是非空目录（除 . 与 .. 外还有条目），不允许删除
+	if(inode_table[ino].mode & INODE_DIRECTORY) {
+		if(directory_index(ino).names.size() > 2) return false;
+		dir_index.erase(ino);
 	}
 	
-	// 释放文件占用的所有块
-	for(uint32_t i = 0; i < it->block_count; i++) {
-		free_block(it->blocks[i]);
-	}
-	
-	// 从文件表中移除
-	file_table.erase(it);
+	// 移除目录项并释放 inode 及其占用的所有块
+	if(!remove_entry(parent, filename)) return false;
+	free_inode(ino);
 	return true;
 }
 
 bool FileSystem::create_directory(const std::string& path) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
+	return make_directory(path);
+}
+
+bool FileSystem::make_directory(const std::string& path) {
 	if(!mounted) return false;
 	
-	// 检查目录是否已存在
-	if(find_file(path)) return false;
-	
-	// 创建新目录条目
-	FileEntry dir;
-	std::string dirname = get_filename(path);
-	if(dirname.length() >= MAX_FILENAME) return false;
+	// 父目录必须存在，且其中没有同名项
+	std::string dirname;
+	uint32_t parent = resolve_parent(path, dirname);
+	if(!parent || lookup(parent, dirname)) return false;
+	if(dirname.length() >= MAX_FILENAME || dirname == "." || dirname == "..") return false;
 	
-	strcpy(dir.name, dirname.c_str());
-	dir.size = 0;
-	dir.block_count = 0;
-	dir.is_directory = true;
-	dir.permissions = 0755;
-	dir.created_time = dir.modified_time = dir.accessed_time = time(nullptr);
-	
-	// 添加到文件表
-	file_table.push_back(dir);
+	// 新目录的数据块中包含 . 与 ..，.. 指向父目录
+	uint32_t ino = allocate_inode(INODE_DIRECTORY | 0755);
+	if(!ino) return false;
+	if(!add_entry(ino, ".", ino, 2) || !add_entry(ino, "..", parent, 2) ||
+		!add_entry(parent, dirname, ino, 2)) {
+		dir_index.erase(ino);
+		free_inode(ino);
+		return false;
+	}
 	return true;
 }
 
 bool FileSystem::is_directory(const std::string& path) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
 	if(!mounted) return false;
 	
 	FileEntry* entry = find_file(path);
-	return entry && entry->is_directory;
+	return entry && (entry->mode & INODE_DIRECTORY);
 }
 
 std::vector<std::string> FileSystem::list_directory(const std::string& path) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
 	std::vector<std::string> files;
 	if(!mounted) return files;
 	
 	// 检查路径是否是目录
 	FileEntry* dir = find_file(path);
-	if(!dir || !dir->is_directory) return files;
+	if(!dir || !(dir->mode & INODE_DIRECTORY)) return files;
 	
-	// 收集目录下的所有文件和子目录
-	for(const auto& entry : file_table) {
-		// 先添加当前目录和父目录
-		if(path == "/") {
-			files.push_back(".");
-			files.push_back("..");
+	// 按目录块中的顺序只列出真正的子项，子目录名后加 /
+	uint32_t ino = static_cast<uint32_t>(dir - inode_table.data());
+	for(const auto& entry : read_entries(ino)) {
+		if(entry.first == "." || entry.first == "..") continue;
+		std::string file_name = entry.first;
+		if(inode_table[entry.second].mode & INODE_DIRECTORY) {
+			file_name += "/";
+		}
+		files.push_back(file_name);
+	}
+	
+	return files;
+}
+
+bool FileSystem::check_read(CheckState& state, uint32_t block_number, void* buffer) {
+	if(state.fixing) {
+		return read_block(block_number, buffer);
+	}
+	// 在线检查时块缓存中的块可能尚未写回，先从缓存取，且不改变其 LRU 位置
+	const char* cached = state.online ? cached_data(block_number) : nullptr;
+	if(cached) {
+		memcpy(buffer, cached, BLOCK_SIZE);
+		return true;
+	}
+	return device->read(block_number, buffer);
+}
+
+void FileSystem::walk_blocks(FileEntry& inode, CheckState& state, const BlockVisitor& visit) {
+	// 依次访问 inode 引用的块，数据块带逻辑块序号，间接块的序号为 WALK_TABLE；
+	// visit 返回 false 的块号视为无效，不再深入，修复阶段将其清零
+	uint32_t pointers[POINTERS_PER_BLOCK];
+	uint32_t inner[POINTERS_PER_BLOCK];
+	
+	for(uint32_t i = 0; i < DIRECT_BLOCKS; i++) {
+		if(inode.direct[i] && !visit(inode.direct[i], i) && state.fixing) {
+			inode.direct[i] = 0;
+		}
+	}
+	
+	uint64_t base = DIRECT_BLOCKS;
+	if(inode.indirect && !visit(inode.indirect, WALK_TABLE)) {
+		if(state.fixing) inode.indirect = 0;
+	} else if(inode.indirect && check_read(state, inode.indirect, pointers)) {
+		bool changed = false;
+		for(uint32_t i = 0; i < POINTERS_PER_BLOCK; i++) {
+			if(pointers[i] && !visit(pointers[i], base + i)) {
+				pointers[i] = 0;
+				changed = true;
+			}
+		}
+		if(changed && state.fixing) {
+			write_block(inode.indirect, pointers);
+		}
+	}
+	
+	base += POINTERS_PER_BLOCK;
+	if(inode.double_indirect && !visit(inode.double_indirect, WALK_TABLE)) {
+		if(state.fixing) inode.double_indirect = 0;
+	} else if(inode.double_indirect && check_read(state, inode.double_indirect, pointers)) {
+		bool changed = false;
+		for(uint32_t i = 0; i < POINTERS_PER_BLOCK; i++) {
+			if(!pointers[i]) continue;
+			if(!visit(pointers[i], WALK_TABLE)) {
+				pointers[i] = 0;
+				changed = true;
+				continue;
+			}
+			if(!check_read(state, pointers[i], inner)) continue;
+			
+			uint64_t first = base + (uint64_t)i * POINTERS_PER_BLOCK;
+			bool inner_changed = false;
+			for(uint32_t j = 0; j < POINTERS_PER_BLOCK; j++) {
+				if(inner[j] && !visit(inner[j], first + j)) {
+					inner[j] = 0;
+					inner_changed = true;
+				}
+			}
+			if(inner_changed && state.fixing) {
+				write_block(pointers[i], inner);
+			}
+		}
+		if(changed && state.fixing) {
+			write_block(inode.double_indirect, pointers);
+		}
+	}
+}
+
+bool FileSystem::check_superblock(CheckState& state) {
+	// 布局字段损坏时无法继续检查，也不尝试修复
+	const SuperBlock& sb = superblock;
+	if(sb.magic != FS_MAGIC || sb.block_size != BLOCK_SIZE) {
+		state.problem("超级块魔数或块大小错误");
+		return false;
+	}
+	if(sb.total_blocks > device->block_count() ||
+		sb.bitmap_blocks != (sb.total_blocks + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK ||
+		sb.checksum_block != sb.bitmap_block + sb.bitmap_blocks ||
+		sb.checksum_blocks != (sb.total_blocks + CHECKSUMS_PER_BLOCK - 1) / CHECKSUMS_PER_BLOCK ||
+		sb.inode_table_block != sb.checksum_block + sb.checksum_blocks ||
+		sb.first_data_block != sb.inode_table_block + (sb.inode_count + INODES_PER_BLOCK - 1) / INODES_PER_BLOCK ||
+		sb.first_data_block >= sb.total_blocks) {
+		state.problem("超级块中的布局字段不一致");
+		return false;
+	}
+	if(ROOT_INODE >= sb.inode_count || !inode_table[ROOT_INODE].links ||
+		!(inode_table[ROOT_INODE].mode & INODE_DIRECTORY)) {
+		state.problem("根目录 inode 损坏");
+		return false;
+	}
+	return true;
+}
+
+void FileSystem::check_inode(uint32_t ino, CheckState& state) {
+	// 登记 inode 引用的每个块，块号越界或已被其他 inode 占用时记为错误
+	FileEntry& inode = inode_table[ino];
+	bool directory = inode.mode & INODE_DIRECTORY;
+	uint64_t dir_blocks = directory ? inode.size / BLOCK_SIZE : 0;
+	unsigned dots = 0;
+	alignas(DirEntry) char block[BLOCK_SIZE];
+	state.inodes++;
+	
+	walk_blocks(inode, state, [&](uint32_t b, uint64_t index) {
+		if(b < superblock.first_data_block || b >= superblock.total_blocks) {
+			state.bad_pointers++;
+			state.problem("inode %u 引用了无效块 %u", ino, b);
+			state.damaged[ino] = 1;
+			return false;
+		}
+		uint32_t expected = 0;
+		if(!state.owner[b].compare_exchange_strong(expected, ino)) {
+			state.duplicate_blocks++;
+			state.problem("inode %u 引用的块 %u 已属于 inode %u", ino, b, expected);
+			state.damaged[ino] = 1;
+			return false;
+		}
+		if(index < dir_blocks && check_read(state, b, block) && check_dir_block(block, ino, state, dots)) {
+			state.damaged[ino] = 1;
+		}
+		return true;
+	});
+	
+	if(directory && dots != 3) {
+		state.directory_errors++;
+		state.problem("目录 %u 缺少 . 或 ..", ino);
+	}
+}
+
+bool FileSystem::check_dir_block(char* block, uint32_t dir, CheckState& state, unsigned& dots) {
+	// 扫描阶段统计错误并登记子项，修复阶段就地改正；返回块中是否有错误
+	bool damaged = false;
+	DirEntry* prev = nullptr;
+	for(uint32_t off = 0; off < BLOCK_SIZE; ) {
+		DirEntry* e = reinterpret_cast<DirEntry*>(block + off);
+		if(e->rec_len < sizeof(DirEntry) || e->rec_len % 4 || off + e->rec_len > BLOCK_SIZE ||
+			(e->inode && entry_length(e->name_len) > e->rec_len)) {
+			// 记录长度损坏后块内其余部分无法解析，并入前一项或整块置空
+			if(!state.fixing) {
+				state.directory_errors++;
+				state.problem("目录 %u 在块内偏移 %u 处的记录长度损坏", dir, off);
+			} else if(prev) {
+				prev->rec_len = BLOCK_SIZE - (reinterpret_cast<char*>(prev) - block);
+			} else {
+				e->inode = 0;
+				e->rec_len = BLOCK_SIZE;
+			}
+			return true;
 		}
 		
-		// 在实际实现中，这里需要考虑路径的层次结构
-		// 当前简化版本只列出直接子文件和子目录
-		if(strcmp(entry.name, dir->name) != 0) {  // 不包含目录自身
-			std::string file_name = entry.name;
-			if(entry.is_directory) {
-				file_name += "/";
+		if(e->inode) {
+			std::string name(block + off + sizeof(DirEntry), e->name_len);
+			bool dot = name == ".";
+			bool dotdot = name == "..";
+			bool valid = e->inode < superblock.inode_count && inode_table[e->inode].links;
+			if(valid && dot) valid = e->inode == dir;
+			if(valid && dotdot) valid = inode_table[e->inode].mode & INODE_DIRECTORY;
+			
+			if(!valid) {
+				// . 指回自身，.. 暂时指向根目录，其余无效名字删除
+				if(!state.fixing) {
+					state.directory_errors++;
+					state.problem("目录 %u 中的 %s 指向无效 inode %u", dir, name.c_str(), e->inode);
+				} else {
+					e->inode = dot ? dir : dotdot ? ROOT_INODE : 0;
+				}
+				damaged = true;
+			} else if(!state.fixing) {
+				if(dot) {
+					dots |= 1;
+				} else if(dotdot) {
+					dots |= 2;
+				} else {
+					state.names[e->inode]++;
+					state.children[dir].push_back(e->inode);
+				}
 			}
-			files.push_back(file_name);
 		}
+		prev = e;
+		off += e->rec_len;
 	}
+	return damaged;
+}
+
+void FileSystem::repair_inode(uint32_t ino, CheckState& state) {
+	// 清除无效或重复的块号，块保留给扫描时最先登记的 inode；同时修正目录块
+	FileEntry& inode = inode_table[ino];
+	uint64_t dir_blocks = (inode.mode & INODE_DIRECTORY) ? inode.size / BLOCK_SIZE : 0;
+	std::unordered_set<uint32_t> seen;
+	unsigned dots = 0;
+	alignas(DirEntry) char block[BLOCK_SIZE];
 	
-	return files;
+	walk_blocks(inode, state, [&](uint32_t b, uint64_t index) {
+		if(b >= superblock.total_blocks || state.owner[b] != ino || !seen.insert(b).second) {
+			state.repaired++;
+			return false;
+		}
+		if(index < dir_blocks && read_block(b, block) && check_dir_block(block, ino, state, dots)) {
+			write_block(b, block);
+			state.repaired++;
+		}
+		return true;
+	});
+}
+
+void FileSystem::check_group(uint32_t group, CheckState& state) {
+	// 逐块比对本组位图与引用情况，修复时按引用重建本组的位图字
+	uint32_t begin = group * BITS_PER_BLOCK;
+	uint32_t end = std::min<uint64_t>(superblock.total_blocks, (uint64_t)begin + BITS_PER_BLOCK);
+	uint32_t free_count = 0;
+	size_t unallocated = 0;
+	size_t leaked = 0;
+	for(uint32_t b = begin; b < end; b++) {
+		bool used = b < superblock.first_data_block || state.owner[b] != 0;
+		bool is_free = block_is_free(b);
+		if(is_free) free_count++;
+		if(used && is_free) {
+			unallocated++;
+		} else if(!used && !is_free) {
+			leaked++;
+		}
+	}
+	
+	bool miscounted = free_count != group_free[group];
+	if(unallocated) {
+		state.unallocated_blocks += unallocated;
+		state.problem("分配组 %u 中有 %zu 个在用块在位图中为空闲", group, unallocated);
+	}
+	if(leaked) {
+		state.leaked_blocks += leaked;
+		state.problem("分配组 %u 中有 %zu 个块已标记为使用但无人引用", group, leaked);
+	}
+	if(miscounted) {
+		state.count_errors++;
+		state.problem("分配组 %u 记录的空闲块数为 %u，实际为 %u", group, group_free[group], free_count);
+	}
+	
+	if(state.repair && (unallocated || leaked || miscounted)) {
+		uint32_t count = 0;
+		for(uint32_t w = begin / 64; (uint64_t)w * 64 < end; w++) {
+			uint64_t word = 0;
+			for(uint32_t bit = 0; bit < 64 && w * 64 + bit < end; bit++) {
+				uint32_t b = w * 64 + bit;
+				if(b >= superblock.first_data_block && state.owner[b] == 0) {
+					word |= 1ULL << bit;
+				}
+			}
+			bitmap_words[w] = word;
+			count += __builtin_popcountll(word);
+		}
+		group_free[group] = count;
+		state.repaired += unallocated + leaked + (miscounted ? 1 : 0);
+	}
+}
+
+void FileSystem::check_tree(CheckState& state) {
+	// 从根目录出发标记可达的 inode，其余在用 inode 为孤立 inode
+	std::vector<uint8_t> reachable(superblock.inode_count, 0);
+	std::vector<uint32_t> queue(1, ROOT_INODE);
+	reachable[ROOT_INODE] = 1;
+	while(!queue.empty()) {
+		uint32_t dir = queue.back();
+		queue.pop_back();
+		for(uint32_t child : state.children[dir]) {
+			if(reachable[child]) continue;
+			reachable[child] = 1;
+			if(inode_table[child].mode & INODE_DIRECTORY) {
+				queue.push_back(child);
+			}
+		}
+	}
+	
+	size_t free_count = 0;
+	std::vector<uint32_t> orphans;
+	for(uint32_t ino = 1; ino < superblock.inode_count; ino++) {
+		if(!inode_table[ino].links) {
+			free_count++;
+			continue;
+		}
+		uint32_t names = state.names[ino];
+		if(names > 1) {
+			state.link_errors++;
+			state.problem("inode %u 被 %u 个目录项引用", ino, names);
+		}
+		if(!reachable[ino]) {
+			state.orphan_inodes++;
+			state.problem("inode %u 从根目录不可达", ino);
+			if(names == 0) orphans.push_back(ino);
+		}
+	}
+	
+	if(free_count != free_inodes.size()) {
+		state.count_errors++;
+		state.problem("空闲 inode 列表有 %zu 项，实际空闲 %zu 个", free_inodes.size(), free_count);
+		if(state.repair) {
+			free_inodes.clear();
+			for(uint32_t i = superblock.inode_count - 1; i > 0; i--) {
+				if(inode_table[i].links == 0) free_inodes.push_back(i);
+			}
+			state.repaired++;
+		}
+	}
+	
+	if(!state.repair || orphans.empty()) return;
+	
+	// 只移入没有任何目录项指向的孤立 inode，其下的子项随之可达
+	uint32_t lost = lookup(ROOT_INODE, "lost+found");
+	if(!lost && make_directory("/lost+found")) {
+		lost = lookup(ROOT_INODE, "lost+found");
+	}
+	if(!lost || !(inode_table[lost].mode & INODE_DIRECTORY)) {
+		state.problem("无法创建 /lost+found");
+		return;
+	}
+	for(uint32_t ino : orphans) {
+		bool directory = inode_table[ino].mode & INODE_DIRECTORY;
+		if(!add_entry(lost, "#" + std::to_string(ino), ino, directory ? 2 : 1)) continue;
+		if(directory) {
+			remove_entry(ino, "..");
+			add_entry(ino, "..", lost, 2);
+		}
+		state.repaired++;
+	}
+}
+
+FileSystem::CheckReport FileSystem::check(bool repair, unsigned threads) {
+	if(!repair) {
+		return check_online(threads);
+	}
+	std::lock_guard<std::mutex> lock(fs_mutex);
+	return check_locked(true, threads);
+}
+
+FileSystem::CheckReport FileSystem::check_locked(bool repair, unsigned threads) {
+	if(!mounted) {
+		CheckState state(false, 0, 0);
+		state.problem("文件系统未挂载");
+		return state.report(false, 0);
+	}
+	
+	// 先写回页缓存与块缓存，扫描阶段的工作线程直接读设备
+	CheckState state(repair, superblock.total_blocks, superblock.inode_count);
+	if(!flush_pending() || !flush_cache()) {
+		state.problem("写回缓存失败，检查结果可能不完整");
+	}
+	if(!check_superblock(state)) {
+		return state.report(false, 0);
+	}
+	
+	// inode 表分段并行扫描，登记每个块的引用者与目录结构
+	run_parallel((superblock.inode_count + INODES_PER_TASK - 1) / INODES_PER_TASK, threads, [&](size_t task) {
+		uint32_t first = std::max<uint32_t>(task * INODES_PER_TASK, 1);
+		uint32_t last = std::min<uint64_t>(superblock.inode_count, (uint64_t)(task + 1) * INODES_PER_TASK);
+		for(uint32_t ino = first; ino < last; ino++) {
+			if(inode_table[ino].links) check_inode(ino, state);
+		}
+	});
+	
+	// 修复在单线程中经块缓存进行：先清理坏块号和目录项，位图随后按引用重建
+	if(repair) {
+		state.fixing = true;
+		for(uint32_t ino = 1; ino < superblock.inode_count; ino++) {
+			if(state.damaged[ino]) repair_inode(ino, state);
+		}
+		dir_index.clear();
+	}
+	
+	// 各分配组并行比对位图
+	run_parallel(group_free.size(), threads, [&](size_t group) {
+		check_group(group, state);
+	});
+	check_free_blocks(state);
+	check_tree(state);
+	
+	if(state.repaired) {
+		metadata_changes++;
+	}
+	if(repair && (!flush_cache() || !store_metadata() || !device->flush())) {
+		state.problem("写回修复结果失败");
+	}
+	return state.report(true, group_free.size());
+}
+
+FileSystem::CheckReport FileSystem::check_online(unsigned threads) {
+	for(int pass = 0; pass < FS_CHECK_ONLINE_PASSES; pass++) {
+		std::unique_lock<std::mutex> lock(fs_mutex);
+		if(!begin_scan()) {
+			CheckState state(false, 0, 0);
+			state.problem("文件系统未挂载");
+			return state.report(false, 0);
+		}
+		CheckState state(false, superblock.total_blocks, superblock.inode_count);
+		state.online = true;
+		uint64_t changes = metadata_changes;
+		if(!check_superblock(state)) {
+			end_scan();
+			return state.report(false, 0);
+		}
+		uint32_t inode_count = superblock.inode_count;
+		size_t groups = group_free.size();
+		lock.unlock();
+		
+		// 每段 inode、每个分配组各持锁一次，段与段之间其他操作照常进行。
+		// 段内持锁扫描，块经块缓存读取，不必先写回缓存
+		bool stopped = false;
+		for(uint32_t first = 0; first < inode_count && !stopped; first += INODES_PER_TASK) {
+			uint32_t last = std::min<uint64_t>(inode_count, (uint64_t)first + INODES_PER_TASK);
+			lock.lock();
+			stopped = flusher_stop;
+			for(uint32_t ino = std::max<uint32_t>(first, 1); ino < last && !stopped; ino++) {
+				if(inode_table[ino].links) check_inode(ino, state);
+			}
+			lock.unlock();
+		}
+		for(size_t group = 0; group < groups && !stopped; group++) {
+			lock.lock();
+			stopped = flusher_stop;
+			if(!stopped) check_group(group, state);
+			lock.unlock();
+		}
+		
+		lock.lock();
+		if(!stopped) {
+			check_free_blocks(state);
+			check_tree(state);
+		}
+		bool consistent = metadata_changes == changes;
+		end_scan();
+		lock.unlock();
+		if(stopped) {
+			state.problem("检查期间文件系统被卸载");
+			return state.report(false, 0);
+		}
+		
+		// 扫描期间没有修改，或者没有发现错误，结果即可采信；否则错误可能只是
+		// 前后几段看到的状态不一致，重新检查
+		CheckReport report = state.report(true, groups);
+		size_t errors = report.bad_pointers + report.duplicate_blocks + report.unallocated_blocks +
+			report.leaked_blocks + report.count_errors + report.directory_errors +
+			report.link_errors + report.orphan_inodes;
+		if(consistent || errors == 0) {
+			return report;
+		}
+	}
+	
+	// 修改持续不断时退回持锁完整检查一遍
+	std::lock_guard<std::mutex> lock(fs_mutex);
+	return check_locked(false, threads);
+}
+
+void FileSystem::check_free_blocks(CheckState& state) {
+	uint32_t free_blocks = 0;
+	for(uint32_t count : group_free) {
+		free_blocks += count;
+	}
+	if(free_blocks != superblock.free_blocks) {
+		state.count_errors++;
+		state.problem("超级块记录的空闲块数为 %u，各组合计为 %u", superblock.free_blocks, free_blocks);
+		if(state.repair) {
+			superblock.free_blocks = free_blocks;
+			state.repaired++;
+		}
+	}
+}
+
+bool FileSystem::begin_scan() {
+	// 卸载开始后不再接受新的扫描
+	if(!mounted || flusher_stop) {
+		return false;
+	}
+	active_scans++;
+	return true;
+}
+
+void FileSystem::end_scan() {
+	active_scans--;
+	scans_done.notify_all();
+}
+
+FileSystem::CheckReport FileSystem::scrub(size_t bytes_per_second, unsigned threads) {
+	CheckState state(false, 0, 0);
+	uint32_t first_data_block;
+	uint32_t total_blocks;
+	size_t groups;
+	{
+		std::lock_guard<std::mutex> lock(fs_mutex);
+		if(!begin_scan()) {
+			state.problem("文件系统未挂载");
+			return state.report(false, 0);
+		}
+		first_data_block = superblock.first_data_block;
+		total_blocks = superblock.total_blocks;
+		groups = group_free.size();
+	}
+	
+	// 校验和在块写入设备时更新，不必先写回块缓存。各分配组并行，每批只在复制位图字与
+	// 校验和时持锁，读设备、计算校验和与限速等待都在锁外
+	Throttle throttle(bytes_per_second);
+	std::atomic<bool> stopped{false};
+	run_parallel(groups, threads, [&](size_t group) {
+		alignas(uint64_t) char block[BLOCK_SIZE];
+		std::vector<uint64_t> words;
+		std::vector<uint32_t> crcs;
+		uint32_t begin = std::max<uint64_t>((uint64_t)group * BITS_PER_BLOCK, first_data_block);
+		uint32_t end = std::min<uint64_t>(total_blocks, (uint64_t)(group + 1) * BITS_PER_BLOCK);
+		for(uint32_t batch = begin; batch < end && !stopped; batch += FS_SCRUB_BATCH) {
+			uint32_t batch_end = std::min<uint32_t>(end, batch + FS_SCRUB_BATCH);
+			{
+				std::lock_guard<std::mutex> lock(fs_mutex);
+				if(flusher_stop) {
+					stopped = true;
+					return;
+				}
+				words.assign(bitmap_words.begin() + batch / 64, bitmap_words.begin() + (batch_end + 63) / 64);
+				crcs.assign(block_crc.begin() + batch, block_crc.begin() + batch_end);
+			}
+			
+			for(uint32_t b = batch; b < batch_end; b++) {
+				uint64_t word = words[b / 64 - batch / 64];
+				if(word == ~0ULL) {
+					b |= 63;   // 整个字都空闲
+					continue;
+				}
+				if(word & (1ULL << (b % 64))) continue;
+				
+				throttle.acquire(BLOCK_SIZE);
+				bool ok = device->read(b, block);
+				if(ok && block_checksum(block) == crcs[b - batch]) {
+					state.bytes_scanned += BLOCK_SIZE;
+					continue;
+				}
+				
+				// 复制之后块可能已被释放或重写，持锁复查：此时设备内容与校验和表一致，
+				// 仍然不符才算损坏。块缓存中的脏块还没写入设备，留给下次巡检
+				std::lock_guard<std::mutex> lock(fs_mutex);
+				auto cached = cache_index.find(b);
+				if(block_is_free(b) || (cached != cache_index.end() && cached->second->dirty)) continue;
+				if(!device->read(b, block)) {
+					state.checksum_errors++;
+					state.problem("读取块 %u 失败", b);
+					continue;
+				}
+				state.bytes_scanned += BLOCK_SIZE;
+				if(block_checksum(block) != block_crc[b]) {
+					state.checksum_errors++;
+					state.problem("块 %u 的校验和不符", b);
+				}
+			}
+		}
+	});
+	
+	std::lock_guard<std::mutex> lock(fs_mutex);
+	end_scan();
+	if(stopped) {
+		state.problem("巡检期间文件系统被卸载");
+		return state.report(false, groups);
+	}
+	return state.report(true, groups);
 }
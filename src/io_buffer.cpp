@@ -0,0 +1,145 @@
+// io_buffer.cpp - 池化 I/O 缓冲与切片
+#include "../include/io_buffer.h"
+#include <algorithm>
+#include <new>
+
+BufferSlice::BufferSlice(PooledBuffer* buffer, uint32_t offset, uint32_t length)
+: buffer(buffer), offset(offset), length(length) {
+	if(buffer) {
+		buffer->refs.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+BufferSlice::BufferSlice(const BufferSlice& other)
+: buffer(other.buffer), offset(other.offset), length(other.length) {
+	if(buffer) {
+		buffer->refs.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+BufferSlice::BufferSlice(BufferSlice&& other) noexcept
+: buffer(other.buffer), offset(other.offset), length(other.length) {
+	other.buffer = nullptr;
+	other.offset = 0;
+	other.length = 0;
+}
+
+BufferSlice& BufferSlice::operator=(BufferSlice other) noexcept {
+	std::swap(buffer, other.buffer);
+	std::swap(offset, other.offset);
+	std::swap(length, other.length);
+	return *this;
+}
+
+BufferSlice::~BufferSlice() {
+	if(buffer) {
+		BufferPool::release(buffer);
+	}
+}
+
+BufferSlice BufferSlice::sub(size_t start, size_t count) const {
+	start = std::min(start, static_cast<size_t>(length));
+	count = std::min(count, length - start);
+	return BufferSlice(buffer, offset + start, count);
+}
+
+void BufferSlice::remove_prefix(size_t count) {
+	count = std::min(count, static_cast<size_t>(length));
+	offset += count;
+	length -= count;
+}
+
+bool BufferSlice::extend(const BufferSlice& next) {
+	if(!buffer || next.buffer != buffer || offset + length != next.offset) {
+		return false;
+	}
+	length += next.length;
+	return true;
+}
+
+BufferPool::BufferPool()
+: free_list(nullptr), total(0), free_count(0), acquired(0), retired(false) {
+}
+
+BufferPool::~BufferPool() {
+	for(void* slab : slabs) {
+		::operator delete(slab, std::align_val_t(alignof(PooledBuffer)));
+	}
+}
+
+BufferPool* BufferPool::create(size_t reserve) {
+	BufferPool* pool = new BufferPool;
+	if(reserve > 0) {
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		pool->grow(reserve);
+	}
+	return pool;
+}
+
+void BufferPool::retire() {
+	std::unique_lock<std::mutex> lock(mutex);
+	retired = true;
+	if(free_count == total) {
+		lock.unlock();
+		delete this;
+	}
+}
+
+bool BufferPool::grow(size_t count) {
+	// 缓冲头部按缓存行对齐，数据区因此同样对齐，相邻缓冲不会共享缓存行
+	const size_t stride = sizeof(PooledBuffer) + IO_BUFFER_SIZE;
+	void* slab = ::operator new(stride * count, std::align_val_t(alignof(PooledBuffer)), std::nothrow);
+	if(!slab) {
+		return false;
+	}
+	slabs.push_back(slab);
+	
+	char* base = static_cast<char*>(slab);
+	for(size_t i = 0; i < count; i++) {
+		PooledBuffer* buffer = new (base + i * stride) PooledBuffer;
+		buffer->refs.store(0, std::memory_order_relaxed);
+		buffer->pool = this;
+		buffer->next_free = free_list;
+		free_list = buffer;
+	}
+	total += count;
+	free_count += count;
+	return true;
+}
+
+PooledBuffer* BufferPool::acquire() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if(!free_list && !grow(IO_SLAB_BUFFERS)) {
+		return nullptr;
+	}
+	
+	PooledBuffer* buffer = free_list;
+	free_list = buffer->next_free;
+	free_count--;
+	acquired++;
+	buffer->refs.store(1, std::memory_order_relaxed);
+	return buffer;
+}
+
+void BufferPool::release(PooledBuffer* buffer) {
+	// 与 shared_ptr 相同：减计数用 acq_rel，最后一个持有者看得到其他持有者的全部访问
+	if(buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		buffer->pool->put(buffer);
+	}
+}
+
+void BufferPool::put(PooledBuffer* buffer) {
+	std::unique_lock<std::mutex> lock(mutex);
+	buffer->next_free = free_list;
+	free_list = buffer;
+	free_count++;
+	if(retired && free_count == total) {
+		lock.unlock();
+		delete this;
+	}
+}
+
+BufferPool::Stats BufferPool::get_stats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return {total, free_count, acquired, slabs.size()};
+}
@@ -5,24 +5,219 @@
 #include <sstream>
 #include <ctime>
 #include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <cctype>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <zlib.h>
 
-SystemLogger::SystemLogger(const std::string& file, size_t max_buffer_size)
-: log_file(file), buffer_size(max_buffer_size) {
+namespace {
+	// 进程内共享的格式串注册表，编号 0 固定为 "{}"，用于普通条目
+	struct FormatRegistry {
+		std::mutex mutex;
+		std::vector<std::string> texts{"{}"};
+		std::unordered_map<std::string, uint32_t> ids{{"{}", 0}};
+	};
 	
-	log_stream.open(log_file, std::ios::app);
-	if(!log_stream) {
+	FormatRegistry& format_registry() {
+		static FormatRegistry registry;
+		return registry;
+	}
+	
+	std::vector<std::string> format_snapshot() {
+		FormatRegistry& registry = format_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		return registry.texts;
+	}
+	
+	template<typename T>
+	void append_raw(std::string& out, T value) {
+		out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+	
+	template<typename T>
+	bool read_raw(const std::string& in, size_t& pos, T& value) {
+		if(pos + sizeof(value) > in.size()) {
+			return false;
+		}
+		memcpy(&value, in.data() + pos, sizeof(value));
+		pos += sizeof(value);
+		return true;
+	}
+	
+	bool ends_with(const std::string& text, const char* suffix) {
+		size_t length = strlen(suffix);
+		return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+	}
+	
+	// 把文本切分为小写的词：ASCII 字母、数字、下划线与非 ASCII 字节组成词
+	void tokenize(const std::string& text, std::vector<std::string>& tokens) {
+		std::string token;
+		for(unsigned char c : text) {
+			if(isalnum(c) || c == '_' || c >= 0x80) {
+				token += static_cast<char>(tolower(c));
+			} else if(!token.empty()) {
+				tokens.push_back(token);
+				token.clear();
+			}
+		}
+		if(!token.empty()) {
+			tokens.push_back(token);
+		}
+	}
+	
+	// 解析 append_text 写出的一行，同一秒的时间戳只转换一次
+	bool parse_line(const char* line, size_t length, SystemLogger::LogEntry& entry,
+		std::string& cached_stamp, time_t& cached_time) {
+		
+		if(length < 24 || line[0] != '[' || line[20] != ']' || line[22] != '[') {
+			return false;
+		}
+		if(cached_stamp.compare(0, std::string::npos, line + 1, 19) != 0) {
+			struct tm timeinfo = {};
+			std::string stamp(line + 1, 19);
+			if(!strptime(stamp.c_str(), "%Y-%m-%d %H:%M:%S", &timeinfo)) {
+				return false;
+			}
+			timeinfo.tm_isdst = -1;
+			cached_time = mktime(&timeinfo);
+			cached_stamp = stamp;
+		}
+		entry.timestamp = cached_time;
+		
+		std::string rest(line + 23, length - 23);
+		size_t close = rest.find("] ");
+		if(close == std::string::npos) {
+			return false;
+		}
+		bool known = false;
+		for(int level = 0; level <= static_cast<int>(SystemLogger::LogLevel::CRITICAL); level++) {
+			auto candidate = static_cast<SystemLogger::LogLevel>(level);
+			if(rest.compare(0, close, SystemLogger::level_to_string(candidate)) == 0) {
+				entry.level = candidate;
+				known = true;
+			}
+		}
+		if(!known) {
+			return false;
+		}
+		
+		// 来源为空时不写方括号，以 [ 开头的消息会被当作来源
+		size_t pos = close + 2;
+		entry.source.clear();
+		if(pos < rest.size() && rest[pos] == '[') {
+			size_t end = rest.find("] ", pos);
+			if(end != std::string::npos) {
+				entry.source = rest.substr(pos + 1, end - pos - 1);
+				pos = end + 2;
+			}
+		}
+		entry.message = rest.substr(pos);
+		return true;
+	}
+	
+	// 把分段压缩为 path.gz 后删除原文件，先写临时文件以免留下不完整的 .gz
+	bool gzip_file(const std::string& path) {
+		int in = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(in < 0) {
+			return false;
+		}
+		std::string temp = path + ".gz.tmp";
+		gzFile out = gzopen(temp.c_str(), "wb6");
+		if(!out) {
+			::close(in);
+			return false;
+		}
+		
+		std::vector<char> chunk(64 * 1024);
+		bool ok = true;
+		ssize_t n;
+		while((n = ::read(in, chunk.data(), chunk.size())) > 0) {
+			if(gzwrite(out, chunk.data(), static_cast<unsigned>(n)) != n) {
+				ok = false;
+				break;
+			}
+		}
+		ok = ok && n == 0;
+		::close(in);
+		ok = gzclose(out) == Z_OK && ok;
+		
+		if(!ok || rename(temp.c_str(), (path + ".gz").c_str()) != 0) {
+			unlink(temp.c_str());
+			return false;
+		}
+		unlink(path.c_str());
+		return true;
+	}
+}
+
+SystemLogger::SystemLogger(const std::string& file, size_t max_buffer_size, LogFormat format)
+: log_file(file), store(std::max<size_t>(max_buffer_size, 1)), store_begin(0), store_end(0),
+last_timestamp(0), postings_swept(0), log_fd(-1), file_format(format),
+log_config{false, true, LogLevel::DEBUG, LOG_ROTATION_BYTES, 0, LOG_MAX_SEGMENTS, true},
+file_bytes(0), segment_started(std::time(nullptr)), clear_requested(false),
+stamp_second(-1), stamp_length(0), write_calls(0), bytes_written(0), rotations(0),
+level_threshold(static_cast<int>(LogLevel::DEBUG)),
+ring(new Slot[LOG_RING_CAPACITY]), enqueue_pos(0), dequeue_pos(0), written_pos(0), dropped(0),
+flush_target(0), stopping(false), compress_stopping(false) {
+	
+	write_buffer.reserve(LOG_BATCH_BYTES * 2);
+	log_fd = ::open(log_file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if(log_fd < 0) {
 		std::cerr << "Failed to open log file: " << log_file << std::endl;
 	}
+	
+	// 新建的二进制日志先写文件头
+	struct stat st;
+	if(log_fd >= 0 && fstat(log_fd, &st) == 0) {
+		file_bytes = st.st_size;
+	}
+	// 已有内容没有索引，查询历史时整体扫描
+	if(file_bytes > 0) {
+		file_index.push_back({INT64_MIN, INT64_MAX, 0, 0, LOG_ALL_LEVELS});
+	}
+	if(file_format == LogFormat::BINARY && log_fd >= 0 && file_bytes == 0) {
+		write_buffer = LOG_BINARY_MAGIC;
+	}
+	
+	for(size_t i = 0; i < LOG_RING_CAPACITY; i++) {
+		ring[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	writer = std::thread(&SystemLogger::writer_loop, this);
 }
 
 SystemLogger::~SystemLogger() {
-	flush_buffer();
-	if(log_stream.is_open()) {
-		log_stream.close();
+	// 后台线程退出前会写完队列中剩余的条目
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	writer.join();
+	
+	// 压缩线程处理完已轮转的分段后退出
+	if(compressor.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(compress_mutex);
+			compress_stopping = true;
+		}
+		compress_wake.notify_one();
+		compressor.join();
+	}
+	
+	if(log_fd >= 0) {
+		::close(log_fd);
 	}
 }
 
-std::string SystemLogger::level_to_string(LogLevel level) const {
+std::string SystemLogger::level_to_string(LogLevel level) {
 	switch(level) {
 		case LogLevel::DEBUG:   return "DEBUG";
 		case LogLevel::INFO:    return "INFO";
@@ -33,46 +228,763 @@ std::string SystemLogger::level_to_string(LogLevel level) const {
 	}
 }
 
-void SystemLogger::write_to_file(const LogEntry& entry) {
-	if(!log_stream) return;
+uint32_t SystemLogger::format_id(const char* format) {
+	// 每个线程按格式串地址缓存编号，命中时不加锁
+	thread_local std::unordered_map<const char*, uint32_t> cache;
+	auto cached = cache.find(format);
+	if(cached != cache.end()) {
+		return cached->second;
+	}
+	
+	FormatRegistry& registry = format_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	auto result = registry.ids.emplace(format, static_cast<uint32_t>(registry.texts.size()));
+	if(result.second) {
+		registry.texts.push_back(format);
+	}
+	cache.emplace(format, result.first->second);
+	return result.first->second;
+}
+
+std::string SystemLogger::format_text(uint32_t id) {
+	FormatRegistry& registry = format_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	return id < registry.texts.size() ? registry.texts[id] : std::string();
+}
+
+void SystemLogger::pack_string(std::string& out, std::string_view value) {
+	uint16_t length = static_cast<uint16_t>(std::min<size_t>(value.size(), 0xFFFF));
+	out += 's';
+	append_raw(out, length);
+	out.append(value.data(), length);
+}
+
+bool SystemLogger::unpack_args(const std::string& args, ArgList& out) {
+	size_t pos = 0;
+	while(pos < args.size()) {
+		char type = args[pos++];
+		if(type == 'i') {
+			int64_t value;
+			if(!read_raw(args, pos, value)) {
+				return false;
+			}
+			out.emplace_back(type, std::to_string(value));
+		} else if(type == 'u') {
+			uint64_t value;
+			if(!read_raw(args, pos, value)) {
+				return false;
+			}
+			out.emplace_back(type, std::to_string(value));
+		} else if(type == 'd') {
+			double value;
+			if(!read_raw(args, pos, value)) {
+				return false;
+			}
+			char text[32];
+			snprintf(text, sizeof(text), "%.15g", value);
+			out.emplace_back(type, text);
+		} else if(type == 's') {
+			uint16_t length;
+			if(!read_raw(args, pos, length) || pos + length > args.size()) {
+				return false;
+			}
+			out.emplace_back(type, args.substr(pos, length));
+			pos += length;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+std::string SystemLogger::render(const std::string& format, const ArgList& args) {
+	std::string text;
+	size_t next = 0;
+	for(size_t i = 0; i < format.size(); i++) {
+		if(format[i] == '{' && i + 1 < format.size() && format[i + 1] == '}' && next < args.size()) {
+			text += args[next++].second;
+			i++;
+		} else {
+			text += format[i];
+		}
+	}
+	return text;
+}
+
+const std::string& SystemLogger::cached_format(uint32_t id) {
+	if(id >= formats.size()) {
+		formats.resize(id + 1);
+	}
+	if(formats[id].empty()) {
+		formats[id] = format_text(id);
+	}
+	return formats[id];
+}
+
+void SystemLogger::store_entry(LogEntry&& entry) {
+	// 存储已满时淘汰最旧的条目，它必然位于所属级别索引的队首
+	if(store_end - store_begin == store.size()) {
+		level_index[static_cast<size_t>(stored(store_begin).level)].pop_front();
+		store_begin++;
+	}
+	
+	uint64_t seq = store_end++;
+	std::string().swap(entry.args);
+	level_index[static_cast<size_t>(entry.level)].push_back(seq);
+	index_entry(seq, entry);
+	store[seq % store.size()] = std::move(entry);
+	
+	if(store_begin - postings_swept >= store.size()) {
+		sweep_postings();
+	}
+}
+
+void SystemLogger::index_entry(uint64_t seq, const LogEntry& entry) {
+	std::vector<std::string> tokens;
+	tokenize(entry.message, tokens);
+	tokenize(entry.source, tokens);
+	for(const auto& token : tokens) {
+		auto& list = postings[token];
+		if(list.empty() || list.back() != seq) {
+			list.push_back(seq);
+		}
+	}
+}
+
+void SystemLogger::sweep_postings() {
+	// 去掉已淘汰条目的序号，删除不再出现的词
+	for(auto it = postings.begin(); it != postings.end();) {
+		auto& list = it->second;
+		list.erase(list.begin(), std::lower_bound(list.begin(), list.end(), store_begin));
+		if(list.empty()) {
+			it = postings.erase(it);
+		} else {
+			++it;
+		}
+	}
+	postings_swept = store_begin;
+}
+
+void SystemLogger::format_entry(LogEntry& entry) {
+	// 出队顺序与时间戳顺序可能相差不到一秒，取不减的时间戳使存储和索引按时间有序
+	if(entry.timestamp < last_timestamp) {
+		entry.timestamp = last_timestamp;
+	}
+	last_timestamp = entry.timestamp;
 	
-	// 格式化时间戳
-	char timestamp[64];
-	struct tm* timeinfo = localtime(&entry.timestamp);
-	strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", timeinfo);
+	// 结构化条目在后台线程中才格式化，供查询和文本文件使用
+	if(entry.format_id != 0 || !entry.args.empty()) {
+		ArgList values;
+		unpack_args(entry.args, values);
+		entry.message = render(cached_format(entry.format_id), values);
+	}
 	
-	// 写入日志条目
-	log_stream << "[" << timestamp << "] "
-	<< "[" << level_to_string(entry.level) << "] ";
+	if(log_config.file_output) {
+		uint64_t offset = file_bytes + write_buffer.size();
+		if(file_format == LogFormat::BINARY) {
+			encode_entry(entry);
+		} else {
+			append_text(entry, write_buffer);
+		}
+		
+		if(file_index.empty() || file_index.back().count == 0 ||
+		   file_index.back().count >= LOG_INDEX_BLOCK) {
+			file_index.push_back({entry.timestamp, entry.timestamp, offset, 0, 0});
+		}
+		IndexBlock& block = file_index.back();
+		block.last_time = entry.timestamp;
+		block.count++;
+		block.level_mask |= 1u << static_cast<unsigned>(entry.level);
+	}
+	if(log_config.console_output) {
+		append_text(entry, console_buffer);
+	}
+}
+
+void SystemLogger::append_text(const LogEntry& entry, std::string& out) {
+	// 时间戳按秒缓存，同一秒内的条目不再调用 localtime_r/strftime
+	if(entry.timestamp != stamp_second) {
+		struct tm timeinfo;
+		localtime_r(&entry.timestamp, &timeinfo);
+		stamp_length = strftime(stamp_text, sizeof(stamp_text), "%Y-%m-%d %H:%M:%S", &timeinfo);
+		stamp_second = entry.timestamp;
+	}
 	
+	out += '[';
+	out.append(stamp_text, stamp_length);
+	out += "] [";
+	out += level_to_string(entry.level);
+	out += "] ";
 	if(!entry.source.empty()) {
-		log_stream << "[" << entry.source << "] ";
+		out += '[';
+		out += entry.source;
+		out += "] ";
+	}
+	out += entry.message;
+	out += '\n';
+}
+
+void SystemLogger::encode_entry(LogEntry& entry) {
+	// 普通条目和参数过长的条目以编号 0 记录格式化好的消息
+	uint32_t id = entry.format_id;
+	std::string plain;
+	const std::string* args = &entry.args;
+	if((id == 0 && entry.args.empty()) || entry.args.size() > 0xFFFF) {
+		id = 0;
+		pack_string(plain, std::string_view(entry.message).substr(0, 0xFFFF - 3));
+		args = &plain;
+	}
+	
+	if(id >= formats_written.size()) {
+		formats_written.resize(id + 1, false);
+	}
+	if(!formats_written[id]) {
+		const std::string& text = cached_format(id);
+		uint16_t length = static_cast<uint16_t>(std::min<size_t>(text.size(), 0xFFFF));
+		write_buffer += 'F';
+		append_raw(write_buffer, id);
+		append_raw(write_buffer, length);
+		write_buffer.append(text.data(), length);
+		formats_written[id] = true;
 	}
 	
-	log_stream << entry.message << std::endl;
-	log_stream.flush();
+	uint16_t source_length = static_cast<uint16_t>(std::min<size_t>(entry.source.size(), 0xFFFF));
+	write_buffer += 'E';
+	append_raw(write_buffer, static_cast<int64_t>(entry.timestamp));
+	append_raw(write_buffer, static_cast<uint8_t>(entry.level));
+	append_raw(write_buffer, id);
+	append_raw(write_buffer, source_length);
+	append_raw(write_buffer, static_cast<uint16_t>(args->size()));
+	write_buffer.append(entry.source.data(), source_length);
+	write_buffer += *args;
 }
 
-void SystemLogger::flush_buffer() {
+void SystemLogger::write_batch() {
 	std::lock_guard<std::mutex> lock(log_mutex);
 	
-	while(!log_buffer.empty()) {
-		write_to_file(log_buffer.front());
-		log_buffer.pop_front();
+	// 通常一次 write 写完整个缓冲，只有被信号打断或部分写入时才重试
+	const char* data = write_buffer.data();
+	size_t remaining = write_buffer.size();
+	while(log_fd >= 0 && remaining > 0) {
+		ssize_t n = ::write(log_fd, data, remaining);
+		write_calls.fetch_add(1, std::memory_order_relaxed);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		data += n;
+		remaining -= n;
+		file_bytes += n;
+		bytes_written.fetch_add(n, std::memory_order_relaxed);
+	}
+	write_buffer.clear();
+	
+	data = console_buffer.data();
+	remaining = console_buffer.size();
+	while(remaining > 0) {
+		ssize_t n = ::write(STDOUT_FILENO, data, remaining);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			break;
+		}
+		data += n;
+		remaining -= n;
+	}
+	console_buffer.clear();
+	
+	// 轮转只在后台线程中进行，记录日志的调用者不会被阻塞
+	bool too_large = log_config.rotation_size > 0 && file_bytes >= log_config.rotation_size;
+	bool too_old = log_config.rotation_interval > 0 &&
+		std::time(nullptr) - segment_started >= log_config.rotation_interval;
+	if(log_fd >= 0 && (too_large || too_old)) {
+		rotate_file();
 	}
 }
 
-void SystemLogger::log(LogLevel level, const std::string& message,
-	const std::string& source) {
-		std::lock_guard<std::mutex> lock(log_mutex);
+void SystemLogger::truncate_file() {
+	std::lock_guard<std::mutex> lock(log_mutex);
+	
+	// 丢弃尚未写出的内容，以追加方式打开的描述符随后从文件头开始写
+	write_buffer.clear();
+	if(log_fd >= 0 && ftruncate(log_fd, 0) != 0) {
+		std::cerr << "Failed to truncate log file: " << log_file << std::endl;
+	}
+	file_bytes = 0;
+	segment_started = std::time(nullptr);
+	file_index.clear();
+	
+	// 二进制日志重新写文件头，格式串定义在下次使用时重新写出
+	if(file_format == LogFormat::BINARY) {
+		write_buffer = LOG_BINARY_MAGIC;
+		formats_written.clear();
+	}
+}
+
+void SystemLogger::rotate_file() {
+	// 调用者持有 log_mutex。分段名带到微秒的时间，按名字排序即按时间排序
+	struct timespec clock;
+	clock_gettime(CLOCK_REALTIME, &clock);
+	time_t now = clock.tv_sec;
+	struct tm timeinfo;
+	localtime_r(&now, &timeinfo);
+	char stamp[32];
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &timeinfo);
+	
+	std::string segment;
+	for(long micros = clock.tv_nsec / 1000; ; micros++) {
+		char suffix[64];   // "." + stamp（至多 31 字符）+ "." + long 的十进制（至多 20 字符）
+		snprintf(suffix, sizeof(suffix), ".%s.%06ld", stamp, micros);
+		segment = log_file + suffix;
+		if(access(segment.c_str(), F_OK) != 0 && access((segment + ".gz").c_str(), F_OK) != 0) {
+			break;
+		}
+	}
+	
+	segment_started = now;
+	if(rename(log_file.c_str(), segment.c_str()) != 0) {
+		std::cerr << "Failed to rotate log file: " << log_file << std::endl;
+		return;
+	}
+	::close(log_fd);
+	log_fd = ::open(log_file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if(log_fd < 0) {
+		std::cerr << "Failed to open log file: " << log_file << std::endl;
+	}
+	if(!write_index(segment)) {
+		std::cerr << "Failed to write log index: " << segment << ".idx" << std::endl;
+	}
+	file_index.clear();
+	file_bytes = 0;
+	rotations.fetch_add(1, std::memory_order_relaxed);
+	
+	if(file_format == LogFormat::BINARY) {
+		write_buffer = LOG_BINARY_MAGIC;
+		formats_written.clear();
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock(compress_mutex);
+		compress_jobs.push_back({segment, log_config.compress, log_config.max_segments});
+		if(!compressor.joinable()) {
+			compressor = std::thread(&SystemLogger::compress_loop, this);
+		}
+	}
+	compress_wake.notify_one();
+}
+
+void SystemLogger::compress_loop() {
+	std::unique_lock<std::mutex> lock(compress_mutex);
+	while(true) {
+		compress_wake.wait(lock, [this] {
+			return compress_stopping || !compress_jobs.empty();
+		});
+		if(compress_jobs.empty()) {
+			break;
+		}
+		
+		SegmentJob job = compress_jobs.front();
+		compress_jobs.pop_front();
+		lock.unlock();
+		
+		if(job.compress && !gzip_file(job.path)) {
+			std::cerr << "Failed to compress log segment: " << job.path << std::endl;
+		}
+		prune_segments(job.max_segments);
+		
+		lock.lock();
+	}
+}
+
+void SystemLogger::prune_segments(size_t max_segments) {
+	if(max_segments == 0) {
+		return;
+	}
+	
+	// 名字以时间开头，排在前面的是最旧的分段；分段的索引随之删除
+	std::vector<std::string> segments = list_segments();
+	for(size_t i = 0; i + max_segments < segments.size(); i++) {
+		std::string base = segments[i];
+		if(ends_with(base, ".gz")) {
+			base.resize(base.size() - 3);
+		}
+		unlink(segments[i].c_str());
+		unlink((base + ".idx").c_str());
+	}
+}
+
+std::vector<std::string> SystemLogger::list_segments() const {
+	size_t slash = log_file.find_last_of('/');
+	std::string dir = slash == std::string::npos ? "." : log_file.substr(0, slash + 1);
+	std::string prefix = (slash == std::string::npos ? log_file : log_file.substr(slash + 1)) + ".";
+	std::string base = slash == std::string::npos ? "" : dir;
+	
+	std::vector<std::string> segments;
+	DIR* handle = opendir(dir.c_str());
+	if(!handle) {
+		return segments;
+	}
+	while(struct dirent* item = readdir(handle)) {
+		std::string name = item->d_name;
+		if(name.compare(0, prefix.size(), prefix) == 0 && name.size() > prefix.size() &&
+		   isdigit(static_cast<unsigned char>(name[prefix.size()])) &&
+		   !ends_with(name, ".tmp") && !ends_with(name, ".idx")) {
+			segments.push_back(base + name);
+		}
+	}
+	closedir(handle);
+	
+	std::sort(segments.begin(), segments.end());
+	return segments;
+}
+
+bool SystemLogger::write_index(const std::string& segment) {
+	// 调用者持有 log_mutex。二进制分段附带格式串表，读取任一块时无需回溯定义
+	std::string data = LOG_INDEX_MAGIC;
+	data += static_cast<char>(file_format == LogFormat::BINARY ? 1 : 0);
+	append_raw(data, static_cast<uint32_t>(file_index.size()));
+	for(const auto& block : file_index) {
+		append_raw(data, block);
+	}
+	
+	std::vector<uint32_t> ids;
+	for(uint32_t id = 0; id < formats_written.size(); id++) {
+		if(formats_written[id]) {
+			ids.push_back(id);
+		}
+	}
+	append_raw(data, static_cast<uint32_t>(ids.size()));
+	for(uint32_t id : ids) {
+		const std::string& text = cached_format(id);
+		uint16_t length = static_cast<uint16_t>(std::min<size_t>(text.size(), 0xFFFF));
+		append_raw(data, id);
+		append_raw(data, length);
+		data.append(text.data(), length);
+	}
+	
+	std::string path = segment + ".idx";
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0) {
+		return false;
+	}
+	bool ok = ::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+	::close(fd);
+	return ok;
+}
+
+bool SystemLogger::read_index(const std::string& path, bool& binary, std::vector<IndexBlock>& blocks,
+	std::vector<std::string>& formats) {
+	
+	std::ifstream file(path, std::ios::binary);
+	if(!file) {
+		return false;
+	}
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	
+	size_t pos = strlen(LOG_INDEX_MAGIC);
+	uint32_t count;
+	if(data.compare(0, pos, LOG_INDEX_MAGIC) != 0 || data.size() <= pos) {
+		return false;
+	}
+	binary = data[pos++] == 1;
+	if(!read_raw(data, pos, count)) {
+		return false;
+	}
+	blocks.resize(count);
+	for(auto& block : blocks) {
+		if(!read_raw(data, pos, block)) {
+			return false;
+		}
+	}
+	
+	if(!read_raw(data, pos, count)) {
+		return false;
+	}
+	for(uint32_t i = 0; i < count; i++) {
+		uint32_t id;
+		uint16_t length;
+		if(!read_raw(data, pos, id) || !read_raw(data, pos, length) || pos + length > data.size()) {
+			return false;
+		}
+		if(id >= formats.size()) {
+			formats.resize(id + 1);
+		}
+		formats[id] = data.substr(pos, length);
+		pos += length;
+	}
+	return true;
+}
+
+void SystemLogger::read_blocks(const std::string& path, bool binary, const std::vector<IndexBlock>& blocks,
+	std::vector<std::string> formats, time_t start, time_t end, uint32_t level_mask, size_t limit,
+	std::vector<LogEntry>& out) {
+	
+	gzFile file = gzopen(path.c_str(), "rb");
+	if(!file) {
+		return;
+	}
+	
+	std::string cached_stamp;
+	time_t cached_time = 0;
+	for(size_t i = 0; i < blocks.size(); i++) {
+		const IndexBlock& first = blocks[i];
+		if(first.last_time < start || first.first_time > end || !(first.level_mask & level_mask)) {
+			continue;
+		}
+		// 相邻的匹配块合并为一次读取
+		size_t last = i;
+		while(last + 1 < blocks.size() && blocks[last + 1].first_time <= end &&
+			  (blocks[last + 1].level_mask & level_mask)) {
+			last++;
+		}
+		uint64_t stop = last + 1 < blocks.size() ? blocks[last + 1].offset : UINT64_MAX;
+		i = last;
+		
+		if(gzseek(file, static_cast<z_off_t>(first.offset), SEEK_SET) < 0) {
+			break;
+		}
+		std::string data;
+		char chunk[64 * 1024];
+		while(data.size() < stop - first.offset) {
+			size_t want = std::min<uint64_t>(sizeof(chunk), stop - first.offset - data.size());
+			int n = gzread(file, chunk, static_cast<unsigned>(want));
+			if(n <= 0) {
+				break;
+			}
+			data.append(chunk, n);
+		}
+		
+		size_t pos = 0;
+		size_t magic = strlen(LOG_BINARY_MAGIC);
+		if(first.offset == 0 && data.compare(0, magic, LOG_BINARY_MAGIC) == 0) {
+			binary = true;
+			pos = magic;
+		}
+		
+		while(pos < data.size()) {
+			LogEntry entry;
+			if(binary) {
+				char type = data[pos++];
+				if(type == 'F') {
+					uint32_t id;
+					uint16_t length;
+					if(!read_raw(data, pos, id) || !read_raw(data, pos, length) || pos + length > data.size()) {
+						break;
+					}
+					if(id >= formats.size()) {
+						formats.resize(id + 1);
+					}
+					formats[id] = data.substr(pos, length);
+					pos += length;
+					continue;
+				}
+				
+				int64_t timestamp;
+				uint8_t level;
+				uint32_t id;
+				uint16_t source_length;
+				uint16_t args_length;
+				if(type != 'E' || !read_raw(data, pos, timestamp) || !read_raw(data, pos, level) ||
+				   !read_raw(data, pos, id) || !read_raw(data, pos, source_length) ||
+				   !read_raw(data, pos, args_length) || pos + source_length + args_length > data.size()) {
+					break;
+				}
+				entry.timestamp = static_cast<time_t>(timestamp);
+				entry.level = static_cast<LogLevel>(level);
+				entry.source = data.substr(pos, source_length);
+				pos += source_length;
+				if(entry.timestamp >= start && entry.timestamp <= end && (level_mask & (1u << level))) {
+					ArgList args;
+					unpack_args(data.substr(pos, args_length), args);
+					entry.message = render(id < formats.size() ? formats[id] : std::string(), args);
+				}
+				pos += args_length;
+			} else {
+				size_t newline = data.find('\n', pos);
+				if(newline == std::string::npos) {
+					break;
+				}
+				bool ok = parse_line(data.data() + pos, newline - pos, entry, cached_stamp, cached_time);
+				pos = newline + 1;
+				if(!ok) {
+					continue;
+				}
+			}
+			
+			if(entry.timestamp > end) {
+				break;
+			}
+			if(entry.timestamp >= start && (level_mask & (1u << static_cast<unsigned>(entry.level)))) {
+				out.push_back(std::move(entry));
+				if(limit && out.size() >= limit) {
+					gzclose(file);
+					return;
+				}
+			}
+		}
+	}
+	gzclose(file);
+}
+
+bool SystemLogger::enqueue(LogEntry&& entry) {
+	size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+	Slot* slot;
+	while(true) {
+		slot = &ring[pos & (LOG_RING_CAPACITY - 1)];
+		size_t seq = slot->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+		if(diff == 0) {
+			// 槽空闲，抢占该位置；失败时 pos 被更新为最新值
+			if(enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if(diff < 0) {
+			// 槽仍未被后台线程取走，队列已满
+			return false;
+		} else {
+			pos = enqueue_pos.load(std::memory_order_relaxed);
+		}
+	}
+	
+	slot->entry = std::move(entry);
+	slot->sequence.store(pos + 1, std::memory_order_release);
+	
+	// 队列过半时提前唤醒后台线程，避免在它休眠期间写满
+	if(pos - written_pos.load(std::memory_order_relaxed) == LOG_RING_CAPACITY / 2) {
+		wake.notify_one();
+	}
+	return true;
+}
+
+bool SystemLogger::dequeue(LogEntry& entry) {
+	Slot& slot = ring[dequeue_pos & (LOG_RING_CAPACITY - 1)];
+	if(slot.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) {
+		return false;
+	}
+	
+	entry = std::move(slot.entry);
+	slot.sequence.store(dequeue_pos + LOG_RING_CAPACITY, std::memory_order_release);
+	dequeue_pos++;
+	return true;
+}
+
+void SystemLogger::writer_loop() {
+	std::vector<LogEntry> batch;
+	LogEntry entry;
+	auto pending_since = std::chrono::steady_clock::now();
+	
+	while(true) {
+		// 先清空文件再取新条目，clear_logs() 之后记录的条目不会被丢弃
+		if(clear_requested.exchange(false, std::memory_order_acquire)) {
+			truncate_file();
+			{
+				std::lock_guard<std::mutex> lock(wake_mutex);
+				written_pos.store(dequeue_pos, std::memory_order_release);
+			}
+			drained.notify_all();
+		}
+		
+		while(batch.size() < LOG_RING_CAPACITY && dequeue(entry)) {
+			batch.push_back(std::move(entry));
+		}
+		bool ring_empty = batch.size() < LOG_RING_CAPACITY;
+		
+		if(!batch.empty()) {
+			if(write_buffer.empty() && console_buffer.empty()) {
+				pending_since = std::chrono::steady_clock::now();
+			}
+			std::lock_guard<std::mutex> lock(log_mutex);
+			for(auto& item : batch) {
+				format_entry(item);
+				store_entry(std::move(item));
+			}
+			batch.clear();
+		}
+		
+		// 写缓冲满、停留超时或有调用者在等待 flush 时写出
+		std::unique_lock<std::mutex> lock(wake_mutex);
+		bool urgent = stopping || flush_target > written_pos.load(std::memory_order_relaxed);
+		auto now = std::chrono::steady_clock::now();
+		auto deadline = pending_since + std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS);
+		bool pending = !write_buffer.empty() || !console_buffer.empty();
+		if(pending &&
+		   (urgent || write_buffer.size() >= LOG_BATCH_BYTES || now >= deadline)) {
+			lock.unlock();
+			write_batch();
+			lock.lock();
+			written_pos.store(dequeue_pos, std::memory_order_release);
+			lock.unlock();
+			drained.notify_all();
+			continue;
+		}
+		if(!pending && written_pos.load(std::memory_order_relaxed) != dequeue_pos) {
+			// 文件与控制台输出都关闭时，条目存入内存即算处理完毕
+			written_pos.store(dequeue_pos, std::memory_order_release);
+			lock.unlock();
+			drained.notify_all();
+			continue;
+		}
 		
-		LogEntry entry(level, message, source);
-		log_buffer.push_back(entry);
+		if(!ring_empty) {
+			continue;
+		}
+		if(stopping && dequeue_pos == enqueue_pos.load(std::memory_order_acquire)) {
+			break;
+		}
+		if(urgent) {
+			// 有条目已占位但生产者尚未写完，稍后重试
+			lock.unlock();
+			std::this_thread::yield();
+			continue;
+		}
 		
-		if(log_buffer.size() >= buffer_size) {
-			flush_buffer();
+		auto sleep = std::chrono::steady_clock::now() + std::chrono::milliseconds(LOG_WRITER_INTERVAL_MS);
+		if(pending && deadline < sleep) {
+			sleep = deadline;
+		}
+		wake.wait_until(lock, sleep);
+	}
+}
+
+void SystemLogger::flush() {
+	size_t target = enqueue_pos.load(std::memory_order_acquire);
+	std::unique_lock<std::mutex> lock(wake_mutex);
+	if(written_pos.load(std::memory_order_acquire) >= target) {
+		return;
+	}
+	
+	flush_target = std::max(flush_target, target);
+	wake.notify_one();
+	drained.wait(lock, [&] {
+		return written_pos.load(std::memory_order_acquire) >= target;
+	});
+}
+
+void SystemLogger::log(LogLevel level, const std::string& message,
+	const std::string& source) {
+	if(!enabled(level)) {
+		return;
+	}
+	submit(LogEntry(level, message, source));
+}
+
+void SystemLogger::submit(LogEntry&& entry) {
+	if(entry.level == LogLevel::CRITICAL) {
+		// 严重错误不可丢弃：队列满时等待后台线程腾出空间，返回前确保已写入文件
+		while(!enqueue(std::move(entry))) {
+			flush();
 		}
+		flush();
+		return;
+	}
+	
+	if(!enqueue(std::move(entry))) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
 	}
+}
 
 void SystemLogger::debug(const std::string& message, const std::string& source) {
 	log(LogLevel::DEBUG, message, source);
@@ -92,69 +1004,304 @@ void SystemLogger::error(const std::string& message, const std::string& source)
 
 void SystemLogger::critical(const std::string& message, const std::string& source) {
 	log(LogLevel::CRITICAL, message, source);
-	flush_buffer(); // 立即写入文件
 }
 
 std::vector<SystemLogger::LogEntry> SystemLogger::get_recent_logs(int count) const {
 	std::lock_guard<std::mutex> lock(log_mutex);
 	
 	std::vector<LogEntry> recent_logs;
-	auto it = log_buffer.rbegin();
-	int num_logs = std::min(count, static_cast<int>(log_buffer.size()));
-	
-	for(int i = 0; i < num_logs; ++i) {
-		recent_logs.push_back(*it++);
+	uint64_t num_logs = std::min<uint64_t>(std::max(count, 0), store_end - store_begin);
+	recent_logs.reserve(num_logs);
+	for(uint64_t i = 1; i <= num_logs; ++i) {
+		recent_logs.push_back(stored(store_end - i));
 	}
 	
 	return recent_logs;
 }
 
-std::vector<SystemLogger::LogEntry> SystemLogger::get_logs_by_level(
-	LogLevel level) const {
-		
-		std::lock_guard<std::mutex> lock(log_mutex);
-		
-		std::vector<LogEntry> filtered_logs;
-		for(const auto& entry : log_buffer) {
-			if(entry.level == level) {
-				filtered_logs.push_back(entry);
-			}
+std::vector<SystemLogger::LogEntry> SystemLogger::get_logs_by_level(LogLevel level) const {
+	std::lock_guard<std::mutex> lock(log_mutex);
+	
+	const auto& index = level_index[static_cast<size_t>(level)];
+	std::vector<LogEntry> filtered_logs;
+	filtered_logs.reserve(index.size());
+	for(uint64_t seq : index) {
+		filtered_logs.push_back(stored(seq));
+	}
+	
+	return filtered_logs;
+}
+
+uint64_t SystemLogger::seq_bound(time_t t, bool after) const {
+	// 存储按时间有序：after 为 false 时返回第一条不早于 t 的序号，否则返回第一条晚于 t 的序号
+	uint64_t low = store_begin, high = store_end;
+	while(low < high) {
+		uint64_t mid = low + (high - low) / 2;
+		time_t stamp = stored(mid).timestamp;
+		if(stamp < t || (after && stamp == t)) {
+			low = mid + 1;
+		} else {
+			high = mid;
 		}
-		
-		return filtered_logs;
 	}
+	return low;
+}
 
 std::vector<SystemLogger::LogEntry> SystemLogger::get_logs_by_timerange(
 	time_t start, time_t end) const {
-		
+	
+	std::lock_guard<std::mutex> lock(log_mutex);
+	
+	uint64_t from = seq_bound(start, false);
+	uint64_t to = seq_bound(end, true);
+	
+	std::vector<LogEntry> filtered_logs;
+	filtered_logs.reserve(to > from ? to - from : 0);
+	for(uint64_t seq = from; seq < to; seq++) {
+		filtered_logs.push_back(stored(seq));
+	}
+	
+	return filtered_logs;
+}
+
+std::vector<SystemLogger::LogEntry> SystemLogger::search(const std::string& query, uint32_t level_mask,
+	time_t start, time_t end, size_t limit) const {
+	
+	// 解析查询：clauses 之间为 OR，每个 clause 内的词与短语为 AND
+	struct Term {
+		std::vector<std::string> tokens;    // 多于一个词时按短语匹配
+	};
+	std::vector<std::vector<Term>> clauses(1);
+	size_t pos = 0;
+	while(pos < query.size()) {
+		if(isspace(static_cast<unsigned char>(query[pos]))) {
+			pos++;
+			continue;
+		}
+		std::string word;
+		if(query[pos] == '"') {
+			size_t close = query.find('"', pos + 1);
+			word = query.substr(pos + 1, close == std::string::npos ? std::string::npos : close - pos - 1);
+			pos = close == std::string::npos ? query.size() : close + 1;
+		} else {
+			size_t space = pos;
+			while(space < query.size() && !isspace(static_cast<unsigned char>(query[space]))) {
+				space++;
+			}
+			word = query.substr(pos, space - pos);
+			pos = space;
+			if(word == "OR") {
+				if(!clauses.back().empty()) {
+					clauses.emplace_back();
+				}
+				continue;
+			}
+			if(word == "AND") {
+				continue;
+			}
+		}
+		Term term;
+		tokenize(word, term.tokens);
+		if(!term.tokens.empty()) {
+			clauses.back().push_back(term);
+		}
+	}
+	if(clauses.back().empty() && clauses.size() > 1) {
+		clauses.pop_back();
+	}
+	
+	// 持锁时只复制时间范围内的倒排表与候选条目，求交集和短语匹配在锁外进行，
+	// 宽泛的查询不会长时间阻塞后台写入线程
+	std::vector<LogEntry> results;
+	std::vector<std::vector<std::vector<uint64_t>>> lists(clauses.size());
+	auto level_matches = [&](uint64_t seq) {
+		return (level_mask & (1u << static_cast<unsigned>(stored(seq).level))) != 0;
+	};
+	{
 		std::lock_guard<std::mutex> lock(log_mutex);
 		
-		std::vector<LogEntry> filtered_logs;
-		for(const auto& entry : log_buffer) {
-			if(entry.timestamp >= start && entry.timestamp <= end) {
-				filtered_logs.push_back(entry);
+		uint64_t from = std::max(seq_bound(start, false), store_begin);
+		uint64_t to = seq_bound(end, true);
+		if(clauses.size() == 1 && clauses[0].empty()) {
+			// 空查询只按级别与时间过滤
+			for(uint64_t seq = to; seq > from && results.size() < limit; seq--) {
+				if(level_matches(seq - 1)) {
+					results.push_back(stored(seq - 1));
+				}
 			}
+			return results;
 		}
 		
-		return filtered_logs;
+		for(size_t c = 0; c < clauses.size(); c++) {
+			bool missing = false;
+			for(const auto& term : clauses[c]) {
+				for(const auto& token : term.tokens) {
+					auto it = postings.find(token);
+					if(it == postings.end()) {
+						missing = true;
+						break;
+					}
+					const auto& list = it->second;
+					lists[c].emplace_back(std::lower_bound(list.begin(), list.end(), from),
+						std::lower_bound(list.begin(), list.end(), to));
+				}
+				if(missing) {
+					break;
+				}
+			}
+			if(missing) {
+				lists[c].clear();
+			}
+		}
 	}
+	
+	// 短语要求各词在消息或来源中连续出现
+	auto phrases_match = [](const std::vector<Term>& clause, const LogEntry& entry) {
+		std::vector<std::string> words;
+		for(const auto& term : clause) {
+			const auto& phrase = term.tokens;
+			if(phrase.size() < 2) {
+				continue;
+			}
+			words.clear();
+			tokenize(entry.message, words);
+			if(std::search(words.begin(), words.end(), phrase.begin(), phrase.end()) != words.end()) {
+				continue;
+			}
+			words.clear();
+			tokenize(entry.source, words);
+			if(std::search(words.begin(), words.end(), phrase.begin(), phrase.end()) == words.end()) {
+				return false;
+			}
+		}
+		return true;
+	};
+	
+	std::vector<std::pair<uint64_t, LogEntry>> matches;
+	for(size_t c = 0; c < clauses.size(); c++) {
+		auto& clause_lists = lists[c];
+		if(clause_lists.empty()) {
+			continue;
+		}
+		std::sort(clause_lists.begin(), clause_lists.end(), [](const auto& a, const auto& b) {
+			return a.size() < b.size();
+		});
+		
+		// 从最短倒排表的末尾往前求交集，每批取够还差的条数后持锁复制条目：
+		// 这期间已被淘汰或级别不符的跳过。每组最多取 limit 条即可保证合并后的最新 limit 条完整
+		const auto& shortest = clause_lists[0];
+		size_t next = shortest.size();
+		size_t found = 0;
+		while(found < limit && next > 0) {
+			std::vector<uint64_t> candidates;
+			while(next > 0 && candidates.size() < limit - found) {
+				uint64_t seq = shortest[--next];
+				bool ok = true;
+				for(size_t i = 1; ok && i < clause_lists.size(); i++) {
+					ok = std::binary_search(clause_lists[i].begin(), clause_lists[i].end(), seq);
+				}
+				if(ok) {
+					candidates.push_back(seq);
+				}
+			}
+			
+			std::vector<std::pair<uint64_t, LogEntry>> batch;
+			{
+				std::lock_guard<std::mutex> lock(log_mutex);
+				for(uint64_t seq : candidates) {
+					if(seq >= store_begin && level_matches(seq)) {
+						batch.emplace_back(seq, stored(seq));
+					}
+				}
+			}
+			for(auto& item : batch) {
+				if(phrases_match(clauses[c], item.second)) {
+					matches.push_back(std::move(item));
+					found++;
+				}
+			}
+		}
+	}
+	
+	// 合并各组结果，取最新的 limit 条
+	std::sort(matches.begin(), matches.end(), [](const auto& a, const auto& b) {
+		return a.first > b.first;
+	});
+	for(size_t i = 0; i < matches.size() && results.size() < limit; i++) {
+		if(i > 0 && matches[i].first == matches[i - 1].first) {
+			continue;
+		}
+		results.push_back(std::move(matches[i].second));
+	}
+	return results;
+}
 
-void SystemLogger::clear_logs() {
-	std::lock_guard<std::mutex> lock(log_mutex);
+std::vector<SystemLogger::LogEntry> SystemLogger::get_history(time_t start, time_t end,
+	uint32_t level_mask, size_t limit) const {
+	
+	std::vector<LogEntry> result;
+	auto remaining = [&] { return limit ? limit - result.size() : 0; };
+	
+	// 已轮转的分段按时间顺序读取，没有索引的分段整体扫描
+	for(const auto& segment : list_segments()) {
+		std::string base = ends_with(segment, ".gz") ? segment.substr(0, segment.size() - 3) : segment;
+		bool binary = false;
+		std::vector<IndexBlock> blocks;
+		std::vector<std::string> formats;
+		if(!read_index(base + ".idx", binary, blocks, formats)) {
+			blocks.assign(1, {INT64_MIN, INT64_MAX, 0, 0, LOG_ALL_LEVELS});
+		}
+		read_blocks(segment, binary, blocks, formats, start, end, level_mask, remaining(), result);
+		if(limit && result.size() >= limit) {
+			return result;
+		}
+	}
 	
-	log_buffer.clear();
+	std::vector<IndexBlock> blocks;
+	bool binary;
+	{
+		std::lock_guard<std::mutex> lock(log_mutex);
+		blocks = file_index;
+		binary = file_format == LogFormat::BINARY;
+	}
+	read_blocks(log_file, binary, blocks, format_snapshot(), start, end, level_mask, remaining(), result);
+	return result;
+}
+
+void SystemLogger::clear_logs() {
+	{
+		std::lock_guard<std::mutex> lock(log_mutex);
+		store_begin = store_end;
+		for(auto& index : level_index) {
+			index.clear();
+		}
+		postings.clear();
+		postings_swept = store_begin;
+	}
 	
-	// 清空日志文件
-	log_stream.close();
-	log_stream.open(log_file, std::ios::out | std::ios::trunc);
+	// 文件由后台线程清空，已轮转的分段保留
+	clear_requested.store(true, std::memory_order_release);
+	wake.notify_one();
 }
 
 void SystemLogger::set_buffer_size(size_t size) {
 	std::lock_guard<std::mutex> lock(log_mutex);
 	
-	buffer_size = size;
-	if(log_buffer.size() >= buffer_size) {
-		flush_buffer();
+	// 保留最新的条目，按新容量重新存放并重建级别索引
+	std::vector<LogEntry> kept;
+	uint64_t count = std::min<uint64_t>(std::max<size_t>(size, 1), store_end - store_begin);
+	for(uint64_t seq = store_end - count; seq < store_end; seq++) {
+		kept.push_back(std::move(store[seq % store.size()]));
+	}
+	
+	store.assign(std::max<size_t>(size, 1), LogEntry());
+	store_begin = store_end = postings_swept = 0;
+	for(auto& index : level_index) {
+		index.clear();
+	}
+	postings.clear();
+	for(auto& entry : kept) {
+		store_entry(std::move(entry));
 	}
 }
 
@@ -166,7 +1313,8 @@ bool SystemLogger::export_logs(const std::string& filename) const {
 	
 	std::lock_guard<std::mutex> lock(log_mutex);
 	
-	for(const auto& entry : log_buffer) {
+	for(uint64_t seq = store_begin; seq < store_end; seq++) {
+		const LogEntry& entry = stored(seq);
 		// 格式化时间戳
 		char timestamp[64];
 		struct tm* timeinfo = localtime(&entry.timestamp);
@@ -185,7 +1333,22 @@ bool SystemLogger::export_logs(const std::string& filename) const {
 	return true;
 }
 
+SystemLogger::LoggerStats SystemLogger::get_stats() const {
+	LoggerStats stats;
+	stats.enqueued = enqueue_pos.load(std::memory_order_relaxed);
+	stats.dropped = dropped.load(std::memory_order_relaxed);
+	stats.written = written_pos.load(std::memory_order_relaxed);
+	stats.queue_depth = stats.enqueued - stats.written;
+	stats.ring_capacity = LOG_RING_CAPACITY;
+	stats.write_calls = write_calls.load(std::memory_order_relaxed);
+	stats.bytes_written = bytes_written.load(std::memory_order_relaxed);
+	stats.rotations = rotations.load(std::memory_order_relaxed);
+	return stats;
+}
+
 void SystemLogger::configure(const LogConfig& config) {
+	// 级别过滤立即生效，其余配置由后台线程在下一批条目时生效
+	set_level(config.min_level);
 	std::lock_guard<std::mutex> lock(log_mutex);
-	// TODO: 实现日志配置功能
+	log_config = config;
 }
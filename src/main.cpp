@@ -5,6 +5,7 @@
 #include "../include/network.h"
 #include "../include/user_auth.h"
 #include "../include/disk_manager.h"
+#include "../include/remote.h"
 
 int main(int argc, char *argv[]) {
 	QApplication app(argc, argv);
@@ -13,10 +14,16 @@ int main(int argc, char *argv[]) {
 	AdvancedKernel kernel;
 	NetworkManager network;
 	UserAuth auth;
-	DiskManager disk("system.disk", 1024 * 1024 * 1024); // 1GB
 	SystemLogger logger("system.log");
+	DiskManager disk("system.disk", 1024 * 1024 * 1024); // 1GB
+	disk.set_logger(&logger);
 	
-	// 启动网络服务
+	// 远程管理协议，须在网络服务启动之前注册回调；除 PING 外的请求须先以 auth 中的用户登录
+	RemoteServer remote(network, kernel, disk, logger, auth);
+	remote.start();
+	
+	// 启动网络服务。协议没有加密，密码以明文传输，只在本机回环地址上监听
+	network.set_listen_address("127.0.0.1");
 	if(!network.start_server(8080)) {
 		logger.error("Failed to start network server");
 		return 1;
@@ -27,5 +34,9 @@ int main(int argc, char *argv[]) {
 	window.show();
 	
 	// 启动应用程序事件循环
-	return app.exec();
+	int result = app.exec();
+	
+	// 先停止反应器，RemoteServer 析构时不再有回调进入
+	network.stop_server();
+	return result;
 }
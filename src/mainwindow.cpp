@@ -39,11 +39,11 @@ MainWindow::MainWindow(AdvancedKernel& k, NetworkManager& n, UserAuth& a,
 	update_timer->start(2000); // 改为2秒更新一次
 	
 	last_update = QDateTime::currentDateTime(); // 初始化上次更新时间
-	logger.info("GUI system started");
+	SLOGF_INFO(logger, "", "GUI system started");
 }
 
 MainWindow::~MainWindow() {
-	logger.info("GUI system shutdown");
+	SLOGF_INFO(logger, "", "GUI system shutdown");
 }
 
 void MainWindow::setup_ui() {
@@ -118,7 +118,7 @@ void MainWindow::create_process_tab() {
 		if(!name.isEmpty()) {
 			QApplication::setOverrideCursor(Qt::WaitCursor);
 			kernel.create_process(name.toStdString());
-			logger.info("Created new process: " + name.toStdString());
+			SLOGF_INFO(logger, "", "Created new process: {}", name.toStdString());
 			update_process_table_efficient();
 			QApplication::restoreOverrideCursor();
 		}
@@ -137,7 +137,7 @@ void MainWindow::create_process_tab() {
 		
 		QApplication::setOverrideCursor(Qt::WaitCursor);
 		kernel.terminate_process(pid);
-		logger.info("Terminated process: " + std::to_string(pid));
+		SLOGF_INFO(logger, "", "Terminated process: {}", pid);
 		update_process_table_efficient();
 		QApplication::restoreOverrideCursor();
 	});
@@ -159,10 +159,11 @@ void MainWindow::create_process_tab() {
 		if(ok) {
 			QApplication::setOverrideCursor(Qt::WaitCursor);
 			if(kernel.change_process_priority(pid, new_priority)) {
-				logger.info("Changed priority of process " + std::to_string(pid) + 
-					" to " + std::to_string(new_priority));
+				SLOGF_INFO(logger, "",
+					"Changed priority of process {} to {}", pid, new_priority);
 			} else {
-				logger.warning("Failed to change priority of process " + std::to_string(pid));
+				SLOGF_WARNING(logger, "",
+					"Failed to change priority of process {}", pid);
 				QMessageBox::warning(this, "Error", "Failed to change process priority");
 			}
 			update_process_table_efficient();
@@ -313,8 +314,8 @@ void MainWindow::create_network_tab() {
 	// 创建数值轴
 	QValueAxis* axisY = new QValueAxis;
 	axisY->setRange(0, 100);
-	axisY->setLabelFormat("%.2f KB");
-	axisY->setTitleText("Data Transfer");
+	axisY->setLabelFormat("%.2f KB/s");
+	axisY->setTitleText("Transfer Rate");
 	
 	// 创建数据系列
 	QLineSeries* sent_series = new QLineSeries;
@@ -486,9 +487,9 @@ void MainWindow::update_network_table() {
 			QDateTime current = QDateTime::currentDateTime();
 			qint64 current_msecs = current.toMSecsSinceEpoch();
 			
-			// 添加新的数据点
-			sent_series->append(current_msecs, stats.total_bytes_sent / 1024.0);
-			received_series->append(current_msecs, stats.total_bytes_received / 1024.0);
+			// 添加新的数据点：最近 1 秒的收发速率
+			sent_series->append(current_msecs, stats.send_rate[0] / 1024.0);
+			received_series->append(current_msecs, stats.receive_rate[0] / 1024.0);
 			
 			// 保持最近30个数据点
 			while (sent_series->count() > 30) {
@@ -521,7 +522,23 @@ void MainWindow::update_network_table() {
 		}
 	}
 	
-	// 更新表格显示（保持原有的表格更新代码）
+	if(stats.latency_samples > 0) {
+		chart->setTitle(QString("Network Traffic (latency p50 %1 ms, p99 %2 ms)")
+			.arg(stats.latency_p50_us / 1000.0, 0, 'f', 2)
+			.arg(stats.latency_p99_us / 1000.0, 0, 'f', 2));
+	}
+	
+	// 更新表格显示
+	network_table->setRowCount(stats.connections.size());
+	for(size_t i = 0; i < stats.connections.size(); i++) {
+		const auto& conn = stats.connections[i];
+		network_table->setItem(i, 0, new QTableWidgetItem(QString::number(conn.client_id)));
+		network_table->setItem(i, 1, new QTableWidgetItem(QString::fromStdString(conn.ip_address)));
+		network_table->setItem(i, 2, new QTableWidgetItem(
+			QString::number(conn.bytes_sent / 1024.0, 'f', 2) + " KB"));
+		network_table->setItem(i, 3, new QTableWidgetItem(
+			QString::number(conn.bytes_received / 1024.0, 'f', 2) + " KB"));
+	}
 	
 	QApplication::restoreOverrideCursor();
 }
@@ -621,7 +638,16 @@ void MainWindow::create_disk_tab() {
 }
 
 void MainWindow::update_log_table() {
-	auto logs = logger.get_recent_logs(100);  // 显示最近100条日志
+	// 有搜索词或级别过滤时走倒排索引，否则显示最近100条日志
+	std::string query = log_search->text().trimmed().toStdString();
+	int min_level = log_level_filter->currentIndex() - 1;
+	std::vector<SystemLogger::LogEntry> logs;
+	if(query.empty() && min_level < 0) {
+		logs = logger.get_recent_logs(100);
+	} else {
+		uint32_t mask = min_level < 0 ? LOG_ALL_LEVELS : LOG_ALL_LEVELS & ~((1u << min_level) - 1);
+		logs = logger.search(query, mask);
+	}
 	log_table->setRowCount(logs.size());
 	
 	for(size_t i = 0; i < logs.size(); i++) {
@@ -652,19 +678,19 @@ void MainWindow::handle_login() {
 	if(password.isEmpty()) return;
 	
 	if(auth.login(username.toStdString(), password.toStdString())) {
-		logger.info("User logged in: " + username.toStdString());
+		SLOGF_INFO(logger, "", "User logged in: {}", username.toStdString());
 		emit login_status_changed(true);
 		statusBar()->showMessage("Logged in as: " + username);
 	} else {
 		QMessageBox::warning(this, "Login Failed", 
 			"Invalid username or password");
-		logger.warning("Login failed for user: " + username.toStdString());
+		SLOGF_WARNING(logger, "", "Login failed for user: {}", username.toStdString());
 	}
 }
 
 void MainWindow::handle_logout() {
 	auth.logout();
-	logger.info("User logged out");
+	SLOGF_INFO(logger, "", "User logged out");
 	emit login_status_changed(false);
 	statusBar()->showMessage("Logged out");
 }
@@ -707,6 +733,17 @@ void MainWindow::create_log_tab() {
 		"Time", "Level", "Message", "Source"
 	});
 	
+	// 搜索栏：空格分隔的词须同时出现，OR 连接多组，引号内为短语
+	QHBoxLayout* search_layout = new QHBoxLayout;
+	log_search = new QLineEdit;
+	log_search->setPlaceholderText("Search logs (e.g. disk error OR \"checksum mismatch\")");
+	log_search->setClearButtonEnabled(true);
+	log_level_filter = new QComboBox;
+	log_level_filter->addItems({"All Levels", "DEBUG+", "INFO+", "WARNING+", "ERROR+", "CRITICAL"});
+	
+	search_layout->addWidget(log_search, 1);
+	search_layout->addWidget(log_level_filter);
+	
 	QHBoxLayout* button_layout = new QHBoxLayout;
 	QPushButton* clear_btn = new QPushButton("Clear Logs");
 	QPushButton* export_btn = new QPushButton("Export Logs");
@@ -714,12 +751,17 @@ void MainWindow::create_log_tab() {
 	button_layout->addWidget(clear_btn);
 	button_layout->addWidget(export_btn);
 	
+	layout->addLayout(search_layout);
 	layout->addWidget(log_table);
 	layout->addLayout(button_layout);
 	
 	log_widget->setLayout(layout);
 	tab_widget->addTab(log_widget, "Logs");
 	
+	connect(log_search, &QLineEdit::textChanged, this, &MainWindow::update_log_table);
+	connect(log_level_filter, QOverload<int>::of(&QComboBox::currentIndexChanged),
+		this, &MainWindow::update_log_table);
+	
 	connect(clear_btn, &QPushButton::clicked, [this]() {
 		logger.clear_logs();
 		update_log_table();
@@ -738,7 +780,7 @@ void MainWindow::execute_command() {
 	QString cmd = command_input->text();
 	if(cmd.isEmpty()) return;
 	
-	logger.info("Executing command: " + cmd.toStdString());
+	SLOGF_INFO(logger, "", "Executing command: {}", cmd.toStdString());
 	// TODO: 实现命令执行逻辑
 	
 	command_input->clear();
@@ -856,7 +898,7 @@ void MainWindow::create_file_tab() {
 				bool success = disk.write_file(filename.toStdString(), 
 					content.toStdString());
 				if(success) {
-					logger.info("Created new file: " + filename.toStdString());
+					SLOGF_INFO(logger, "", "Created new file: {}", filename.toStdString());
 					update_file_table();
 				} else {
 					QMessageBox::warning(this, "Error", "Failed to create file");
@@ -903,7 +945,7 @@ void MainWindow::create_file_tab() {
 				QTimer::singleShot(0, this, [this, dirname, new_dir_btn]() {
 					bool success = disk.create_directory(dirname.toStdString());
 					if(success) {
-						logger.info("Created new directory: " + dirname.toStdString());
+						SLOGF_INFO(logger, "", "Created new directory: {}", dirname.toStdString());
 						// 使用 QTimer::singleShot 延迟刷新界面
 						QTimer::singleShot(0, this, [this]() {
 							update_file_table();
@@ -960,7 +1002,7 @@ void MainWindow::create_file_tab() {
 			}
 			
 			if(success) {
-				logger.info("Deleted " + type.toLower().toStdString() + ": " + name.toStdString());
+				SLOGF_INFO(logger, "", "Deleted {}: {}", type.toLower().toStdString(), name.toStdString());
 				// 使用 QTimer::singleShot 延迟刷新界面
 				QTimer::singleShot(0, this, [this]() {
 					update_file_table();
@@ -968,7 +1010,7 @@ void MainWindow::create_file_tab() {
 			} else {
 				QMessageBox::warning(this, "Error", 
 					QString("Failed to delete %1").arg(name));
-				logger.warning("Failed to delete " + type.toLower().toStdString() + ": " + name.toStdString());
+				SLOGF_WARNING(logger, "", "Failed to delete {}: {}", type.toLower().toStdString(), name.toStdString());
 			}
 			delete_btn->setEnabled(true);
 		});
@@ -1,232 +1,976 @@
 // network.cpp - 网络管理实现
 #include "../include/network.h"
+#include "../include/disk_manager.h"
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <iostream>
 
 NetworkManager::NetworkManager() 
-: server_socket(-1), running(false),
-gen(rd()),
-sent_dist(50.0, 20.0),   // 均值50KB，标准差20KB
-recv_dist(30.0, 15.0),   // 均值30KB，标准差15KB
-last_bytes_sent(0),
-last_bytes_received(0) {
-	// 添加一个模拟客户端
-	auto client = std::make_shared<ClientInfo>(1, "192.168.1.100");
-	clients[1] = client;
+: owner_slots(0), running(false), listen_address(htonl(INADDR_ANY)) {
 }
 
 NetworkManager::~NetworkManager() {
     stop_server();
 }
 
-bool NetworkManager::start_server(int port) {
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if(server_socket < 0) {
-        return false;
-    }
-    
-    // 设置socket选项
-    int opt = 1;
-    if(setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, 
-                  &opt, sizeof(opt)) < 0) {
-        close(server_socket);
-        return false;
-    }
-    
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port);
-    
-    if(bind(server_socket, (struct sockaddr*)&server_addr, 
-            sizeof(server_addr)) < 0) {
-        close(server_socket);
-        return false;
-    }
-    
-    if(listen(server_socket, 5) < 0) {
-        close(server_socket);
-        return false;
-    }
-    
-    running = true;
-    server_thread = std::thread(&NetworkManager::server_loop, this);
-    
-    return true;
+bool NetworkManager::start_server(int port, unsigned threads) {
+	if(running.load(std::memory_order_acquire)) {
+		return false;
+	}
+	
+	if(threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threads = std::min(threads, static_cast<unsigned>(UINT16_MAX));
+	
+	// 描述符不会超过打开文件数上限，按它分配所属反应器表
+	struct rlimit limit;
+	owner_slots = NET_MAX_DESCRIPTORS;
+	if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < NET_MAX_DESCRIPTORS) {
+		owner_slots = limit.rlim_cur;
+	}
+	owners.reset(new std::atomic<uint16_t>[owner_slots]);
+	for(size_t i = 0; i < owner_slots; i++) {
+		owners[i].store(0, std::memory_order_relaxed);
+	}
+	
+	// sendfile 没有 MSG_NOSIGNAL，对端关闭后写入会触发 SIGPIPE；宿主程序未自行处理时忽略它
+	struct sigaction pipe_action;
+	if(sigaction(SIGPIPE, nullptr, &pipe_action) == 0 && pipe_action.sa_handler == SIG_DFL) {
+		signal(SIGPIPE, SIG_IGN);
+	}
+	
+	// 内核不支持 SO_REUSEPORT 时退回单个反应器
+	if(threads > 1) {
+		int probe = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		int opt = 1;
+		if(probe < 0 || setsockopt(probe, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+			threads = 1;
+		}
+		if(probe >= 0) {
+			close(probe);
+		}
+	}
+	
+	for(unsigned i = 0; i < threads; i++) {
+		std::unique_ptr<Reactor> reactor(new Reactor);
+		bool opened = open_reactor(*reactor, port, threads > 1);
+		reactors.push_back(std::move(reactor));
+		if(!opened) {
+			for(auto& created : reactors) {
+				close_reactor(*created);
+			}
+			reactors.clear();
+			return false;
+		}
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock(sample_mutex);
+		samples.clear();
+	}
+	record_sample();
+	
+	running.store(true, std::memory_order_release);
+	for(size_t i = 0; i < reactors.size(); i++) {
+		reactors[i]->thread = std::thread(&NetworkManager::server_loop, this,
+		                                  std::ref(*reactors[i]), static_cast<uint16_t>(i + 1));
+	}
+	
+	return true;
+}
+
+bool NetworkManager::set_listen_address(const std::string& address) {
+	struct in_addr parsed;
+	if(running.load(std::memory_order_acquire) || inet_pton(AF_INET, address.c_str(), &parsed) != 1) {
+		return false;
+	}
+	listen_address = parsed.s_addr;
+	return true;
+}
+
+bool NetworkManager::open_reactor(Reactor& reactor, int port, bool reuse_port) {
+	reactor.pool = BufferPool::create();
+	reactor.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(reactor.listen_fd < 0) {
+		return false;
+	}
+	
+	// 设置socket选项
+	int opt = 1;
+	if(setsockopt(reactor.listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+	   (reuse_port && setsockopt(reactor.listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)) {
+		return false;
+	}
+	
+	struct sockaddr_in server_addr;
+	memset(&server_addr, 0, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = listen_address;
+	server_addr.sin_port = htons(port);
+	
+	if(bind(reactor.listen_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 ||
+	   listen(reactor.listen_fd, NET_LISTEN_BACKLOG) < 0) {
+		return false;
+	}
+	
+	// 监听套接字用水平触发，每次事件只接受有限个连接，不会因 EMFILE 丢失通知；
+	// 唤醒用的 eventfd 同样注册在 epoll 中
+	reactor.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	reactor.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	struct epoll_event listen_event = {};
+	listen_event.events = EPOLLIN;
+	listen_event.data.fd = reactor.listen_fd;
+	struct epoll_event wake_event = {};
+	wake_event.events = EPOLLIN;
+	wake_event.data.fd = reactor.wake_fd;
+	return reactor.epoll_fd >= 0 && reactor.wake_fd >= 0 &&
+		epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, reactor.listen_fd, &listen_event) == 0 &&
+		epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, reactor.wake_fd, &wake_event) == 0;
+}
+
+void NetworkManager::close_reactor(Reactor& reactor) {
+	for(int* fd : {&reactor.listen_fd, &reactor.epoll_fd, &reactor.wake_fd}) {
+		if(*fd != -1) {
+			close(*fd);
+			*fd = -1;
+		}
+	}
+	
+	// 仍被切片引用的缓冲在最后一个切片释放时归还，池随后自行释放
+	if(reactor.receiving) {
+		BufferPool::release(reactor.receiving);
+		reactor.receiving = nullptr;
+	}
+	if(reactor.pool) {
+		reactor.pool->retire();
+		reactor.pool = nullptr;
+	}
 }
 
 void NetworkManager::stop_server() {
-    running = false;
-    if(server_socket != -1) {
-        close(server_socket);
-        server_socket = -1;
-    }
-    
-    if(server_thread.joinable()) {
-        server_thread.join();
-    }
-    
-    // 关闭所有客户端连接
-    std::lock_guard<std::mutex> lock(network_mutex);
-    for(auto& client : clients) {
-        close(client.second->socket_fd);
-    }
-    clients.clear();
-}
-
-void NetworkManager::server_loop() {
-    while(running) {
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        FD_SET(server_socket, &read_fds);
-        
-        struct timeval timeout;
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
-        
-        if(select(server_socket + 1, &read_fds, NULL, NULL, &timeout) > 0) {
-            struct sockaddr_in client_addr;
-            socklen_t client_len = sizeof(client_addr);
-            
-            int client_socket = accept(server_socket, 
-                                     (struct sockaddr*)&client_addr,
-                                     &client_len);
-                                     
-            if(client_socket >= 0) {
-                std::lock_guard<std::mutex> lock(network_mutex);
-                auto client_info = std::make_shared<ClientInfo>(
-                    client_socket,
-                    inet_ntoa(client_addr.sin_addr)
-                );
-                clients[client_socket] = client_info;
-                
-                // 创建客户端处理线程
-                std::thread(&NetworkManager::handle_client, 
-                           this, client_socket).detach();
-            }
-        }
-    }
-}
-
-void NetworkManager::handle_client(int client_socket) {
-    char buffer[1024];
-    
-    while(running) {
-        memset(buffer, 0, sizeof(buffer));
-        int bytes_read = recv(client_socket, buffer, sizeof(buffer)-1, 0);
-        
-        if(bytes_read <= 0) {
-            // 客户端断开连接
-            std::lock_guard<std::mutex> lock(network_mutex);
-            close(client_socket);
-            clients.erase(client_socket);
-            break;
-        }
-        
-        // 更新统计信息
-        std::lock_guard<std::mutex> lock(network_mutex);
-        if(clients.find(client_socket) != clients.end()) {
-            clients[client_socket]->bytes_received += bytes_read;
-        }
-    }
+	running.store(false, std::memory_order_release);
+	for(auto& reactor : reactors) {
+		if(reactor->thread.joinable()) {
+			wake_reactor(*reactor);
+			reactor->thread.join();
+		}
+	}
+	
+	// 关闭所有客户端连接，关闭回调可能再调用 send_data，不能持有连接表的锁
+	for(auto& reactor : reactors) {
+		std::unordered_map<int, std::shared_ptr<ClientInfo>> clients;
+		{
+			std::lock_guard<std::mutex> lock(reactor->clients_mutex);
+			clients.swap(reactor->clients);
+		}
+		for(auto& client : clients) {
+			if(close_handler) {
+				close_handler(client.first);
+			}
+			std::lock_guard<std::mutex> io_lock(client.second->io_mutex);
+			owners[client.first].store(0, std::memory_order_relaxed);
+			close_socket(*client.second);
+		}
+		close_reactor(*reactor);
+	}
+	reactors.clear();
+}
+
+void NetworkManager::set_receive_handler(ReceiveHandler handler) {
+	receive_handler = std::move(handler);
+}
+
+void NetworkManager::wake_reactor(Reactor& reactor) {
+	uint64_t one = 1;
+	if(write(reactor.wake_fd, &one, sizeof(one)) < 0) {
+		// 计数器已满时反应器必然会被唤醒，无需处理
+	}
+}
+
+void NetworkManager::count_received(ClientInfo& client, size_t bytes) {
+	client.bytes_received.fetch_add(bytes, std::memory_order_relaxed);
+	client.reactor->bytes_received.fetch_add(bytes, std::memory_order_relaxed);
+	if(client.request_started.load(std::memory_order_relaxed) == 0) {
+		client.request_started.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+	}
+}
+
+void NetworkManager::count_sent(ClientInfo& client, size_t bytes) {
+	client.bytes_sent.fetch_add(bytes, std::memory_order_relaxed);
+	client.reactor->bytes_sent.fetch_add(bytes, std::memory_order_relaxed);
+	
+	// 应答的第一批字节发出时结束一次延迟计时
+	int64_t started = client.request_started.exchange(0, std::memory_order_relaxed);
+	if(started != 0) {
+		int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+		client.reactor->latency.record(std::max<int64_t>(now - started, 0) / 1000);
+	}
+}
+
+size_t NetworkManager::LatencyHistogram::bucket_of(uint64_t us) {
+	if(us < 8) {
+		return us;
+	}
+	
+	// 最高位决定区间，其后三位决定子桶
+	unsigned power = 63 - __builtin_clzll(us);
+	if(power > 33) {
+		return NET_LATENCY_BUCKETS - 1;
+	}
+	return 8 + (power - 3) * 8 + ((us >> (power - 3)) & 7);
+}
+
+uint64_t NetworkManager::LatencyHistogram::bucket_floor(size_t index) {
+	if(index < 8) {
+		return index;
+	}
+	unsigned power = (index - 8) / 8 + 3;
+	return static_cast<uint64_t>(8 + (index - 8) % 8) << (power - 3);
+}
+
+NetworkManager::TrafficSample NetworkManager::current_totals() const {
+	TrafficSample sample{};
+	sample.time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	for(const auto& reactor : reactors) {
+		sample.bytes_sent += reactor->bytes_sent.load(std::memory_order_relaxed);
+		sample.bytes_received += reactor->bytes_received.load(std::memory_order_relaxed);
+	}
+	return sample;
+}
+
+void NetworkManager::record_sample() {
+	TrafficSample sample = current_totals();
+	std::lock_guard<std::mutex> lock(sample_mutex);
+	samples.push_back(sample);
+	if(samples.size() > NET_SAMPLE_COUNT) {
+		samples.pop_front();
+	}
+}
+
+void NetworkManager::server_loop(Reactor& reactor, uint16_t index) {
+	struct epoll_event events[NET_MAX_EVENTS];
+	
+	// 只有第一个反应器定时醒来采样，其余反应器空闲时一直阻塞
+	bool sampler = index == 1;
+	auto next_sample = std::chrono::steady_clock::now() + std::chrono::milliseconds(NET_SAMPLE_INTERVAL_MS);
+	while(running.load(std::memory_order_acquire)) {
+		int timeout = -1;
+		if(sampler) {
+			auto now = std::chrono::steady_clock::now();
+			if(now >= next_sample) {
+				record_sample();
+				next_sample += std::chrono::milliseconds(NET_SAMPLE_INTERVAL_MS);
+				if(next_sample <= now) {
+					next_sample = now + std::chrono::milliseconds(NET_SAMPLE_INTERVAL_MS);
+				}
+			}
+			timeout = std::chrono::duration_cast<std::chrono::milliseconds>(next_sample - now).count() + 1;
+		}
+		
+		int count = epoll_wait(reactor.epoll_fd, events, NET_MAX_EVENTS, timeout);
+		if(count < 0) {
+			if(errno == EINTR) continue;
+			break;
+		}
+		
+		for(int i = 0; i < count; i++) {
+			int fd = events[i].data.fd;
+			if(fd == reactor.listen_fd) {
+				accept_clients(reactor, index);
+				continue;
+			}
+			
+			if(fd == reactor.wake_fd) {
+				// 恢复 receive_data 已腾出空间的连接，未读的数据不会再触发边沿事件
+				uint64_t value;
+				while(read(reactor.wake_fd, &value, sizeof(value)) > 0) {}
+				// 连接只在本线程上关闭，已关闭的连接 connected 为假，read_client 直接返回，
+				// 不会按被复用的描述符读到别的连接
+				std::vector<std::shared_ptr<ClientInfo>> resumed;
+				{
+					std::lock_guard<std::mutex> lock(reactor.clients_mutex);
+					resumed.swap(reactor.resume_reads);
+				}
+				for(auto& client : resumed) {
+					read_client(reactor, *client);
+				}
+				continue;
+			}
+			
+			std::shared_ptr<ClientInfo> client;
+			{
+				std::lock_guard<std::mutex> lock(reactor.clients_mutex);
+				auto it = reactor.clients.find(fd);
+				if(it == reactor.clients.end()) {
+					continue;
+				}
+				client = it->second;
+			}
+			
+			// 零拷贝完成通知以 EPOLLERR 报告
+			if(events[i].events & EPOLLERR) {
+				std::lock_guard<std::mutex> lock(client->io_mutex);
+				reap_zerocopy(*client);
+			}
+			
+			// 挂断与错误也走读路径，recv 返回 0 或出错时关闭连接
+			if(events[i].events & EPOLLOUT) {
+				write_client(*client);
+			}
+			if(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+				read_client(reactor, *client);
+			}
+		}
+	}
+}
+
+void NetworkManager::accept_clients(Reactor& reactor, uint16_t index) {
+	for(int i = 0; i < NET_MAX_EVENTS; i++) {
+		struct sockaddr_in client_addr;
+		socklen_t client_len = sizeof(client_addr);
+		int client_socket = accept4(reactor.listen_fd, (struct sockaddr*)&client_addr,
+		                            &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(client_socket < 0) {
+			return;
+		}
+		if(static_cast<size_t>(client_socket) >= owner_slots) {
+			// 运行期间调高了打开文件数上限，超出所属反应器表的连接直接拒绝
+			close(client_socket);
+			continue;
+		}
+		
+		// 小消息请求应答为主，关闭 Nagle 以免延迟确认拖慢应答
+		int nodelay = 1;
+		setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+		
+		auto client_info = std::make_shared<ClientInfo>(
+			client_socket,
+			inet_ntoa(client_addr.sin_addr),
+			&reactor
+		);
+		int zerocopy = 1;
+		client_info->zerocopy = setsockopt(client_socket, SOL_SOCKET, SO_ZEROCOPY,
+		                                   &zerocopy, sizeof(zerocopy)) == 0;
+		owners[client_socket].store(index, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> lock(reactor.clients_mutex);
+			reactor.clients[client_socket] = client_info;
+		}
+		reactor.connections.fetch_add(1, std::memory_order_relaxed);
+		reactor.accepted.fetch_add(1, std::memory_order_relaxed);
+		
+		// 读写都用边沿触发：EPOLLOUT 只在发送缓冲由满变为可写时到达
+		struct epoll_event event = {};
+		event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		event.data.fd = client_socket;
+		if(epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, client_socket, &event) < 0) {
+			close_client(reactor, client_socket);
+		}
+	}
+}
+
+void NetworkManager::read_client(Reactor& reactor, ClientInfo& client) {
+	while(client.connected.load(std::memory_order_relaxed)) {
+		if(!receive_handler) {
+			std::lock_guard<std::mutex> lock(client.io_mutex);
+			if(client.input_bytes >= NET_INPUT_LIMIT) {
+				client.read_paused = true;
+				return;
+			}
+		}
+		
+		// 只剩反应器自己引用的缓冲从头复用；被切片占住的缓冲剩余空间不足时换一个
+		if(reactor.receiving && reactor.receiving->refs.load(std::memory_order_acquire) == 1) {
+			reactor.receive_fill = 0;
+		} else if(reactor.receiving && IO_BUFFER_SIZE - reactor.receive_fill < NET_READ_MIN) {
+			BufferPool::release(reactor.receiving);
+			reactor.receiving = nullptr;
+		}
+		if(!reactor.receiving) {
+			reactor.receiving = reactor.pool->acquire();
+			reactor.receive_fill = 0;
+			if(!reactor.receiving) {
+				// 内存耗尽，边沿触发下留着未读的数据不会再有通知，只能关闭连接
+				close_client(reactor, client.socket_fd);
+				return;
+			}
+		}
+		
+		ssize_t bytes_read = recv(client.socket_fd, reactor.receiving->data() + reactor.receive_fill,
+		                          IO_BUFFER_SIZE - reactor.receive_fill, 0);
+		if(bytes_read > 0) {
+			count_received(client, bytes_read);
+			BufferSlice data(reactor.receiving, reactor.receive_fill, bytes_read);
+			reactor.receive_fill += bytes_read;
+			if(receive_handler) {
+				receive_handler(client.socket_fd, data);
+			} else {
+				// 同一缓冲中接续的数据并入上一个切片
+				std::lock_guard<std::mutex> lock(client.io_mutex);
+				client.input_bytes += data.size();
+				if(client.input.empty() || !client.input.back().extend(data)) {
+					client.input.push_back(std::move(data));
+				}
+			}
+			continue;
+		}
+		
+		if(bytes_read < 0 && errno == EINTR) {
+			continue;
+		}
+		if(bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return;
+		}
+		
+		// 客户端断开连接
+		close_client(reactor, client.socket_fd);
+		return;
+	}
+}
+
+void NetworkManager::write_client(ClientInfo& client) {
+	bool drained = false;
+	{
+		std::lock_guard<std::mutex> lock(client.io_mutex);
+		if(!client.connected.load(std::memory_order_relaxed)) {
+			return;
+		}
+		if(!flush_output(client)) {
+			// 发送出错时关闭两个方向，读路径随后关闭连接
+			shutdown(client.socket_fd, SHUT_RDWR);
+			return;
+		}
+		if(client.output_blocked && client.output_memory <= NET_OUTPUT_LIMIT / 2) {
+			client.output_blocked = false;
+			drained = true;
+		}
+	}
+	
+	if(drained && drain_handler) {
+		drain_handler(client.socket_fd);
+	}
+}
+
+bool NetworkManager::flush_output(ClientInfo& client) {
+	while(!client.output.empty()) {
+		SendSegment& front = client.output.front();
+		ssize_t bytes_sent;
+		if(front.file) {
+			// 文件段由内核直接从页缓存发送
+			off_t offset = front.offset;
+			bytes_sent = sendfile(client.socket_fd, *front.file, &offset, front.length);
+			if(bytes_sent == 0) {
+				// 文件比登记的长度短，后续数据已无法按顺序发送
+				return false;
+			}
+			if(bytes_sent > 0) {
+				client.reactor->sendfile_bytes.fetch_add(bytes_sent, std::memory_order_relaxed);
+			}
+		} else if(client.zerocopy && front.length >= NET_ZEROCOPY_THRESHOLD) {
+			// 大内存段让内核直接引用用户页，数据块保留到完成通知到达
+			struct iovec iov = {const_cast<char*>(front.bytes()), front.length};
+			struct msghdr msg = {};
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			bytes_sent = sendmsg(client.socket_fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+			if(bytes_sent < 0 && errno == ENOBUFS) {
+				// 超出可锁定的内存配额，这个连接改为普通发送
+				client.zerocopy = false;
+				continue;
+			}
+			if(bytes_sent > 0) {
+				client.zerocopy_inflight.push_back({client.zerocopy_next++, front});
+				client.reactor->zerocopy_bytes.fetch_add(bytes_sent, std::memory_order_relaxed);
+			}
+		} else {
+			// 连续的内存段聚集成一次 sendmsg，相当于 writev 但可以带 MSG_NOSIGNAL
+			struct iovec iov[NET_IOV_MAX];
+			int count = 0;
+			for(auto it = client.output.begin(); it != client.output.end() && count < NET_IOV_MAX; ++it) {
+				if(it->file || (client.zerocopy && it->length >= NET_ZEROCOPY_THRESHOLD && count > 0)) {
+					break;
+				}
+				iov[count].iov_base = const_cast<char*>(it->bytes());
+				iov[count].iov_len = it->length;
+				count++;
+			}
+			struct msghdr msg = {};
+			msg.msg_iov = iov;
+			msg.msg_iovlen = count;
+			bytes_sent = sendmsg(client.socket_fd, &msg, MSG_NOSIGNAL);
+		}
+		
+		if(bytes_sent < 0) {
+			if(errno == EINTR) continue;
+			// EAGAIN 时等下一次 EPOLLOUT
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		count_sent(client, bytes_sent);
+		consume_output(client, bytes_sent);
+	}
+	return true;
+}
+
+void NetworkManager::consume_output(ClientInfo& client, size_t bytes) {
+	client.output_bytes -= bytes;
+	while(bytes > 0) {
+		SendSegment& front = client.output.front();
+		size_t used = std::min(bytes, front.length);
+		front.offset += used;
+		front.length -= used;
+		if(!front.file) {
+			client.output_memory -= used;
+		}
+		bytes -= used;
+		if(front.length == 0) {
+			client.output.pop_front();
+		}
+	}
+}
+
+void NetworkManager::reap_zerocopy(ClientInfo& client) {
+	// 完成通知在错误队列中，每条覆盖一段连续的发送序号 [ee_info, ee_data]
+	while(!client.zerocopy_inflight.empty()) {
+		char control[128];
+		struct msghdr msg = {};
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if(recvmsg(client.socket_fd, &msg, MSG_ERRQUEUE) < 0) {
+			return;
+		}
+		
+		for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if(!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+			     (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))) {
+				continue;
+			}
+			const struct sock_extended_err* err =
+				reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cmsg));
+			if(err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+				continue;
+			}
+			while(!client.zerocopy_inflight.empty() &&
+			      static_cast<int32_t>(client.zerocopy_inflight.front().first - err->ee_data) <= 0) {
+				client.zerocopy_inflight.pop_front();
+			}
+			// 内核已经复制了数据（例如回环或网卡不支持分散发送），零拷贝只剩开销
+			if(err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+				client.zerocopy = false;
+				client.reactor->zerocopy_copied.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+}
+
+void NetworkManager::close_client(Reactor& reactor, int fd) {
+	std::shared_ptr<ClientInfo> client;
+	{
+		std::lock_guard<std::mutex> lock(reactor.clients_mutex);
+		auto it = reactor.clients.find(fd);
+		if(it == reactor.clients.end()) {
+			return;
+		}
+		client = it->second;
+		reactor.clients.erase(it);
+	}
+	reactor.connections.fetch_sub(1, std::memory_order_relaxed);
+	
+	// 回调在描述符关闭前执行，回调返回后发往这个 client_id 的数据才可能属于新连接
+	if(close_handler) {
+		close_handler(fd);
+	}
+	
+	// 持有 io_mutex 关闭，send_data 不会在描述符被复用后写错连接
+	std::lock_guard<std::mutex> lock(client->io_mutex);
+	owners[fd].store(0, std::memory_order_relaxed);
+	close_socket(*client);
+}
+
+void NetworkManager::close_socket(ClientInfo& client) {
+	// 仍有零拷贝发送未完成时直接复位连接，内核丢弃发送队列，
+	// 不会在数据块释放、内存被复用后继续发送其中的内容
+	if(!client.zerocopy_inflight.empty()) {
+		struct linger abort = {1, 0};
+		setsockopt(client.socket_fd, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+	}
+	client.connected.store(false, std::memory_order_relaxed);
+	close(client.socket_fd);
+	client.output.clear();
+	client.zerocopy_inflight.clear();
+}
+
+NetworkManager::Reactor* NetworkManager::owner_of(int fd) const {
+	if(fd < 0 || static_cast<size_t>(fd) >= owner_slots) {
+		return nullptr;
+	}
+	uint16_t index = owners[fd].load(std::memory_order_acquire);
+	return index == 0 || index > reactors.size() ? nullptr : reactors[index - 1].get();
+}
+
+std::shared_ptr<NetworkManager::ClientInfo> NetworkManager::find_client(int fd) const {
+	Reactor* reactor = owner_of(fd);
+	if(!reactor) {
+		return nullptr;
+	}
+	
+	std::lock_guard<std::mutex> lock(reactor->clients_mutex);
+	auto it = reactor->clients.find(fd);
+	return it == reactor->clients.end() ? nullptr : it->second;
+}
+
+NetworkManager::SendSegment NetworkManager::SendSegment::memory(
+	std::shared_ptr<const std::string> block, size_t offset, size_t length) {
+	SendSegment segment;
+	offset = std::min(offset, block->size());
+	segment.length = std::min(length, block->size() - offset);
+	segment.offset = offset;
+	segment.data = std::move(block);
+	return segment;
+}
+
+NetworkManager::SendSegment NetworkManager::SendSegment::from_slice(const BufferSlice& slice) {
+	SendSegment segment;
+	segment.slice = slice;
+	segment.offset = 0;
+	segment.length = slice.size();
+	return segment;
+}
+
+NetworkManager::SendSegment NetworkManager::SendSegment::from_file(int fd, uint64_t offset, size_t length) {
+	SendSegment segment;
+	int copy = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if(copy >= 0) {
+		segment.file = std::shared_ptr<const int>(new int(copy), [](const int* file) {
+			close(*file);
+			delete file;
+		});
+	}
+	segment.offset = offset;
+	segment.length = length;
+	return segment;
+}
+
+void NetworkManager::set_drain_handler(DrainHandler handler) {
+	drain_handler = std::move(handler);
+}
+
+void NetworkManager::set_close_handler(CloseHandler handler) {
+	close_handler = std::move(handler);
+}
+
+bool NetworkManager::send_chain(int client_id, const SendChain& chain) {
+	return send_segments(client_id, chain.data(), chain.size());
+}
+
+bool NetworkManager::send_segments(int client_id, const SendSegment* segments, size_t count) {
+	auto client = find_client(client_id);
+	if(!client) {
+		return false;
+	}
+	
+	size_t memory = 0;
+	size_t total = 0;
+	bool gather = count <= NET_IOV_MAX;
+	for(size_t i = 0; i < count; i++) {
+		const SendSegment& segment = segments[i];
+		if(!segment.file && !segment.data && segment.slice.empty() && segment.length > 0) {
+			return false;
+		}
+		memory += segment.file ? 0 : segment.length;
+		total += segment.length;
+		if(segment.file || segment.length >= NET_ZEROCOPY_THRESHOLD) {
+			gather = false;
+		}
+	}
+	
+	std::lock_guard<std::mutex> lock(client->io_mutex);
+	if(!client->connected.load(std::memory_order_relaxed)) {
+		return false;
+	}
+	if(client->output_memory > 0 && client->output_memory + memory > NET_OUTPUT_LIMIT) {
+		client->output_blocked = true;
+		return false;
+	}
+	
+	// 队列为空且都是普通内存段时直接从调用者的段聚集发送，只有内核缓冲装不下的部分才排队，
+	// 小应答因此不经过队列，也不用等反应器往返
+	bool idle = client->output.empty();
+	size_t sent = 0;
+	if(idle && gather && total > 0) {
+		struct iovec iov[NET_IOV_MAX];
+		int used = 0;
+		for(size_t i = 0; i < count; i++) {
+			if(segments[i].length > 0) {
+				iov[used].iov_base = const_cast<char*>(segments[i].bytes());
+				iov[used].iov_len = segments[i].length;
+				used++;
+			}
+		}
+		struct msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = used;
+		ssize_t bytes_sent;
+		do {
+			bytes_sent = sendmsg(client->socket_fd, &msg, MSG_NOSIGNAL);
+		} while(bytes_sent < 0 && errno == EINTR);
+		if(bytes_sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			shutdown(client_id, SHUT_RDWR);
+			return false;
+		}
+		if(bytes_sent > 0) {
+			sent = bytes_sent;
+			count_sent(*client, sent);
+		}
+		if(sent == total) {
+			return true;
+		}
+	}
+	
+	for(size_t i = 0; i < count; i++) {
+		size_t skip = std::min(sent, segments[i].length);
+		sent -= skip;
+		if(segments[i].length == skip) {
+			continue;
+		}
+		client->output.push_back(segments[i]);
+		SendSegment& queued = client->output.back();
+		queued.offset += skip;
+		queued.length -= skip;
+		client->output_memory += queued.file ? 0 : queued.length;
+		client->output_bytes += queued.length;
+	}
+	
+	// 含文件段或大内存段时由 flush_output 选择发送方式；否则余下部分由反应器在可写时继续
+	if(idle && !gather && !flush_output(*client)) {
+		shutdown(client_id, SHUT_RDWR);
+		return false;
+	}
+	return true;
 }
 
 bool NetworkManager::send_data(int client_id, const std::string& data) {
-    std::lock_guard<std::mutex> lock(network_mutex);
-    
-    auto it = clients.find(client_id);
-    if(it == clients.end()) {
-        return false;
-    }
-    
-    int bytes_sent = send(client_id, data.c_str(), data.length(), 0);
-    if(bytes_sent > 0) {
-        it->second->bytes_sent += bytes_sent;
-        return true;
-    }
-    return false;
+	return send_chain(client_id, {SendSegment::memory(std::make_shared<const std::string>(data))});
+}
+
+bool NetworkManager::send_data(int client_id, const BufferSlice& data) {
+	SendSegment segment = SendSegment::from_slice(data);
+	return send_segments(client_id, &segment, 1);
+}
+
+bool NetworkManager::send_file(int client_id, int fd, uint64_t offset, size_t length) {
+	SendSegment segment = SendSegment::from_file(fd, offset, length);
+	return segment.file && send_chain(client_id, {segment});
+}
+
+bool NetworkManager::send_disk_file(int client_id, DiskManager& disk, const std::string& filename) {
+	std::vector<DiskManager::FileSegment> layout;
+	if(!disk.get_file_layout(filename, layout)) {
+		return false;
+	}
+	
+	// 镜像区段共享同一个复制出的描述符
+	SendChain chain;
+	std::shared_ptr<const int> image;
+	for(auto& piece : layout) {
+		if(!piece.data.empty()) {
+			chain.push_back(SendSegment::memory(std::make_shared<const std::string>(std::move(piece.data))));
+			continue;
+		}
+		if(!image) {
+			SendSegment first = SendSegment::from_file(disk.image_descriptor(), piece.image_offset, piece.length);
+			if(!first.file) {
+				return false;
+			}
+			image = first.file;
+			chain.push_back(first);
+			continue;
+		}
+		SendSegment segment;
+		segment.file = image;
+		segment.offset = piece.image_offset;
+		segment.length = piece.length;
+		chain.push_back(segment);
+	}
+	return send_chain(client_id, chain);
+}
+
+size_t NetworkManager::pending_output(int client_id) const {
+	auto client = find_client(client_id);
+	if(!client) {
+		return 0;
+	}
+	std::lock_guard<std::mutex> lock(client->io_mutex);
+	return client->output_bytes;
 }
 
 std::string NetworkManager::receive_data(int client_id) {
-    char buffer[1024];
-    std::string received_data;
-    
-    std::lock_guard<std::mutex> lock(network_mutex);
-    
-    auto it = clients.find(client_id);
-    if(it == clients.end()) {
-        return "";
-    }
-    
-    int bytes_read = recv(client_id, buffer, sizeof(buffer)-1, MSG_DONTWAIT);
-    if(bytes_read > 0) {
-        buffer[bytes_read] = '\0';
-        received_data = buffer;
-        it->second->bytes_received += bytes_read;
-    }
-    
-    return received_data;
+	std::vector<BufferSlice> slices;
+	std::string received_data;
+	if(receive_data(client_id, slices)) {
+		size_t total = 0;
+		for(const auto& slice : slices) {
+			total += slice.size();
+		}
+		received_data.reserve(total);
+		for(const auto& slice : slices) {
+			received_data.append(slice.data(), slice.size());
+		}
+	}
+	return received_data;
 }
 
-NetworkManager::NetworkStats NetworkManager::get_stats() const {
-	std::lock_guard<std::mutex> lock(network_mutex);
+bool NetworkManager::receive_data(int client_id, std::vector<BufferSlice>& slices) {
+	auto client = find_client(client_id);
+	if(!client) {
+		return false;
+	}
+	
+	bool received = false;
+	bool resume = false;
+	{
+		std::lock_guard<std::mutex> lock(client->io_mutex);
+		received = !client->input.empty();
+		for(auto& slice : client->input) {
+			slices.push_back(std::move(slice));
+		}
+		client->input.clear();
+		client->input_bytes = 0;
+		resume = client->read_paused;
+		client->read_paused = false;
+	}
 	
+	// 暂停期间到达的数据不会再产生边沿事件，交给所属反应器重新读取
+	if(resume) {
+		Reactor* reactor = client->reactor;
+		{
+			std::lock_guard<std::mutex> lock(reactor->clients_mutex);
+			reactor->resume_reads.push_back(client);
+		}
+		wake_reactor(*reactor);
+	}
+	return received;
+}
+
+NetworkManager::NetworkStats NetworkManager::get_stats() const {
 	NetworkStats stats{};
-	stats.total_connections = clients.size();
+	// 汇总各反应器的原子计数，不需要锁住连接表
+	TrafficSample now = current_totals();
+	stats.total_bytes_sent = now.bytes_sent;
+	stats.total_bytes_received = now.bytes_received;
+	uint64_t buckets[NET_LATENCY_BUCKETS] = {};
+	for(const auto& reactor : reactors) {
+		stats.total_connections += reactor->connections.load(std::memory_order_relaxed);
+		stats.accepted_connections += reactor->accepted.load(std::memory_order_relaxed);
+		stats.sendfile_bytes += reactor->sendfile_bytes.load(std::memory_order_relaxed);
+		stats.zerocopy_bytes += reactor->zerocopy_bytes.load(std::memory_order_relaxed);
+		stats.zerocopy_copied += reactor->zerocopy_copied.load(std::memory_order_relaxed);
+		BufferPool::Stats pool = reactor->pool->get_stats();
+		stats.buffers_allocated += pool.buffers;
+		stats.buffers_in_use += pool.buffers - pool.free;
+		for(size_t i = 0; i < NET_LATENCY_BUCKETS; i++) {
+			buckets[i] += reactor->latency.buckets[i].load(std::memory_order_relaxed);
+		}
+	}
 	
-	// 生成流量数据
-	uint64_t current_bytes_sent, current_bytes_received;
-	generate_traffic_data(current_bytes_sent, current_bytes_received);
+	// 每个窗口取不晚于窗口起点的最新采样，运行时间不足一个窗口时取最早的采样
+	{
+		std::lock_guard<std::mutex> lock(sample_mutex);
+		const int64_t windows[3] = {1000, 10000, 60000};
+		for(int w = 0; w < 3 && !samples.empty(); w++) {
+			const TrafficSample* base = &samples.front();
+			for(auto it = samples.rbegin(); it != samples.rend(); ++it) {
+				if(it->time_ms <= now.time_ms - windows[w]) {
+					base = &*it;
+					break;
+				}
+			}
+			double seconds = (now.time_ms - base->time_ms) / 1000.0;
+			if(seconds > 0) {
+				stats.send_rate[w] = (now.bytes_sent - base->bytes_sent) / seconds;
+				stats.receive_rate[w] = (now.bytes_received - base->bytes_received) / seconds;
+			}
+		}
+	}
 	
-	for(const auto& client : clients) {
-		// 更新每个客户端的流量
-		client.second->bytes_sent = current_bytes_sent;
-		client.second->bytes_received = current_bytes_received;
-		
-		stats.total_bytes_sent = client.second->bytes_sent;
-		stats.total_bytes_received = client.second->bytes_received;
-		stats.client_status.push_back({
-			client.second->ip_address,
-			client.second->connected
-		});
+	for(size_t i = 0; i < NET_LATENCY_BUCKETS; i++) {
+		stats.latency_samples += buckets[i];
+		if(buckets[i] > 0) {
+			stats.latency_histogram.push_back({LatencyHistogram::bucket_floor(i), buckets[i]});
+		}
+	}
+	uint64_t seen = 0;
+	bool have_p50 = false;
+	for(size_t i = 0; i < NET_LATENCY_BUCKETS && stats.latency_samples > 0; i++) {
+		seen += buckets[i];
+		double middle = i + 1 < NET_LATENCY_BUCKETS ?
+			(LatencyHistogram::bucket_floor(i) + LatencyHistogram::bucket_floor(i + 1)) / 2.0 :
+			LatencyHistogram::bucket_floor(i);
+		if(!have_p50 && seen * 2 >= stats.latency_samples) {
+			stats.latency_p50_us = middle;
+			have_p50 = true;
+		}
+		if(seen * 100 >= stats.latency_samples * 99) {
+			stats.latency_p99_us = middle;
+			break;
+		}
+	}
+	
+	for(const auto& reactor : reactors) {
+		std::lock_guard<std::mutex> lock(reactor->clients_mutex);
+		for(const auto& client : reactor->clients) {
+			stats.client_status.push_back({
+				client.second->ip_address,
+				client.second->connected
+			});
+			stats.connections.push_back({
+				client.first,
+				client.second->ip_address,
+				client.second->bytes_sent.load(std::memory_order_relaxed),
+				client.second->bytes_received.load(std::memory_order_relaxed)
+			});
+		}
 	}
 	
 	return stats;
 }
 
 std::vector<int> NetworkManager::get_connected_clients() const {
-	std::lock_guard<std::mutex> lock(network_mutex);
-	
 	std::vector<int> connected_clients;
-	for (const auto& client : clients) {
-		connected_clients.push_back(client.first);
+	for(const auto& reactor : reactors) {
+		std::lock_guard<std::mutex> lock(reactor->clients_mutex);
+		for(const auto& client : reactor->clients) {
+			connected_clients.push_back(client.first);
+		}
 	}
 	
 	return connected_clients;
 }
 
 void NetworkManager::disconnect_client(int client_id) {
-    std::lock_guard<std::mutex> lock(network_mutex);
-    
-    auto it = clients.find(client_id);
-    if(it != clients.end()) {
-        close(it->first);
-        clients.erase(it);
-    }
-}
-
-// 添加这个新函数
-void NetworkManager::generate_traffic_data(uint64_t& sent, uint64_t& received) const {
-	// 生成新的随机增量
-	double sent_increment = std::max(0.0, sent_dist(gen)) * 1024;
-	double recv_increment = std::max(0.0, recv_dist(gen)) * 1024;
-	
-	// 更新发送和接收的字节数
-	sent = last_bytes_sent + static_cast<uint64_t>(sent_increment);
-	received = last_bytes_received + static_cast<uint64_t>(recv_increment);
-	
-	// 更新上次的值
-	last_bytes_sent = sent;
-	last_bytes_received = received;
+	auto client = find_client(client_id);
+	if(!client) {
+		return;
+	}
+	
+	// 只关闭收发方向，反应器读到连接结束后统一关闭描述符并移出连接表
+	std::lock_guard<std::mutex> lock(client->io_mutex);
+	if(client->connected.load(std::memory_order_relaxed)) {
+		shutdown(client_id, SHUT_RDWR);
+	}
 }
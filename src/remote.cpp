@@ -0,0 +1,511 @@
+// remote.cpp - 远程管理协议实现
+#include "../include/remote.h"
+#include "../include/network.h"
+#include "../include/advanced_kernel.h"
+#include "../include/disk_manager.h"
+#include "../include/logger.h"
+#include "../include/user_auth.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <limits>
+#include <sstream>
+
+namespace {
+	void store_u32(char* p, uint32_t value) {
+		for(int i = 0; i < 4; i++) {
+			p[i] = static_cast<char>(value >> (i * 8));
+		}
+	}
+	
+	void append_entries(const std::vector<SystemLogger::LogEntry>& entries, std::string& out) {
+		// 工作线程并发执行，只能用 localtime_r；时间戳按秒缓存
+		char time_str[32];
+		size_t time_length = 0;
+		time_t cached = static_cast<time_t>(-1);
+		for(const auto& entry : entries) {
+			if(entry.timestamp != cached) {
+				struct tm timeinfo;
+				localtime_r(&entry.timestamp, &timeinfo);
+				time_length = strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &timeinfo);
+				cached = entry.timestamp;
+			}
+			out.append(time_str, time_length);
+			out += " [" + SystemLogger::level_to_string(entry.level) + "] ";
+			out += entry.source + ": " + entry.message + "\n";
+		}
+	}
+}
+
+void remote_put_u16(std::string& out, uint16_t value) {
+	out.push_back(static_cast<char>(value));
+	out.push_back(static_cast<char>(value >> 8));
+}
+
+void remote_put_u32(std::string& out, uint32_t value) {
+	char bytes[4];
+	store_u32(bytes, value);
+	out.append(bytes, 4);
+}
+
+uint16_t remote_get_u16(const char* p) {
+	const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+	return static_cast<uint16_t>(u[0] | (u[1] << 8));
+}
+
+uint32_t remote_get_u32(const char* p) {
+	const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+	return static_cast<uint32_t>(u[0]) | (static_cast<uint32_t>(u[1]) << 8) |
+		(static_cast<uint32_t>(u[2]) << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+RemoteFrameBuilder::RemoteFrameBuilder() : data(REMOTE_FRAME_HEADER, '\0'), records(0) {
+}
+
+void RemoteFrameBuilder::add(uint32_t request_id, uint16_t code, const char* body, size_t length) {
+	remote_put_u32(data, request_id);
+	remote_put_u16(data, code);
+	remote_put_u16(data, 0);
+	remote_put_u32(data, length);
+	data.append(body, length);
+	records++;
+}
+
+std::string RemoteFrameBuilder::finish() {
+	std::string frame;
+	frame.swap(data);
+	store_u32(&frame[0], frame.size() - REMOTE_FRAME_HEADER);
+	store_u32(&frame[4], records);
+	data.assign(REMOTE_FRAME_HEADER, '\0');
+	records = 0;
+	return frame;
+}
+
+int remote_parse_frame(const char* data, size_t size, size_t& frame_size,
+                       std::vector<RemoteRecord>& records) {
+	if(size < REMOTE_FRAME_HEADER) {
+		return 0;
+	}
+	
+	// 帧头一到就检查长度，不为超长的帧缓存数据
+	uint32_t length = remote_get_u32(data);
+	uint32_t count = remote_get_u32(data + 4);
+	if(length > REMOTE_MAX_FRAME || count > length / REMOTE_RECORD_HEADER) {
+		return -1;
+	}
+	if(size - REMOTE_FRAME_HEADER < length) {
+		return 0;
+	}
+	
+	records.clear();
+	const char* p = data + REMOTE_FRAME_HEADER;
+	const char* end = p + length;
+	for(uint32_t i = 0; i < count; i++) {
+		if(end - p < REMOTE_RECORD_HEADER) {
+			return -1;
+		}
+		RemoteRecord record;
+		record.request_id = remote_get_u32(p);
+		record.code = remote_get_u16(p + 4);
+		record.flags = remote_get_u16(p + 6);
+		record.length = remote_get_u32(p + 8);
+		p += REMOTE_RECORD_HEADER;
+		if(static_cast<size_t>(end - p) < record.length) {
+			return -1;
+		}
+		record.body = p;
+		p += record.length;
+		records.push_back(record);
+	}
+	if(p != end) {
+		return -1;
+	}
+	
+	frame_size = REMOTE_FRAME_HEADER + length;
+	return 1;
+}
+
+RemoteServer::RemoteServer(NetworkManager& network, AdvancedKernel& kernel, DiskManager& disk,
+                           SystemLogger& logger, UserAuth& auth)
+: network(network), kernel(kernel), disk(disk), logger(logger), auth(auth), running(false),
+  frames_received(0), requests(0), frames_sent(0), responses(0), busy(0), protocol_errors(0), denied(0) {
+}
+
+RemoteServer::~RemoteServer() {
+	stop();
+}
+
+void RemoteServer::start(unsigned worker_count) {
+	if(running) {
+		return;
+	}
+	
+	network.set_receive_handler([this](int client_id, const BufferSlice& data) {
+		handle_data(client_id, data);
+	});
+	network.set_close_handler([this](int client_id) {
+		handle_close(client_id);
+	});
+	network.set_drain_handler([this](int client_id) {
+		handle_drain(client_id);
+	});
+	
+	if(worker_count == 0) {
+		worker_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	running = true;
+	for(unsigned i = 0; i < worker_count; i++) {
+		workers.emplace_back(&RemoteServer::worker_loop, this);
+	}
+}
+
+void RemoteServer::stop() {
+	{
+		std::lock_guard<std::mutex> lock(task_mutex);
+		if(!running) {
+			return;
+		}
+		running = false;
+	}
+	task_ready.notify_all();
+	for(auto& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+	tasks.clear();
+}
+
+void RemoteServer::handle_data(int client_id, const BufferSlice& data) {
+	std::shared_ptr<Session> session;
+	{
+		std::lock_guard<std::mutex> lock(sessions_mutex);
+		std::shared_ptr<Session>& slot = sessions[client_id];
+		if(!slot) {
+			slot = std::make_shared<Session>(client_id);
+		}
+		session = slot;
+	}
+	
+	// 没有残留字节时直接在接收切片上拆帧，只把不足一帧的尾部复制出来
+	size_t consumed = 0;
+	bool valid;
+	if(session->input.empty()) {
+		valid = handle_frames(*session, session, data.data(), data.size(), consumed);
+		if(valid && consumed < data.size()) {
+			session->input.assign(data.data() + consumed, data.size() - consumed);
+		}
+	} else {
+		session->input.append(data.data(), data.size());
+		valid = handle_frames(*session, session, session->input.data(), session->input.size(), consumed);
+		if(valid) {
+			session->input.erase(0, consumed);
+		}
+	}
+	
+	if(!valid) {
+		protocol_errors.fetch_add(1, std::memory_order_relaxed);
+		session->input.clear();
+		SLOGF_WARNING(logger, "RemoteServer", "连接 {} 发来格式错误的帧，已断开", client_id);
+		network.disconnect_client(client_id);
+	}
+}
+
+bool RemoteServer::handle_frames(Session& session, const std::shared_ptr<Session>& owner,
+                                 const char* data, size_t size, size_t& consumed) {
+	// 同一次接收中就地应答的记录合并成一帧，交给工作线程的请求一次入队
+	std::vector<RemoteRecord> records;
+	std::vector<Task> batch;
+	RemoteFrameBuilder replies;
+	consumed = 0;
+	while(true) {
+		// 未登录的连接只接受小帧，帧头一到就检查，不为未认证的对端缓存大量数据
+		if(session.user.empty() && size - consumed >= REMOTE_FRAME_HEADER &&
+		   remote_get_u32(data + consumed) > REMOTE_LOGIN_MAX_FRAME) {
+			return false;
+		}
+		size_t frame_size = 0;
+		int result = remote_parse_frame(data + consumed, size - consumed, frame_size, records);
+		if(result < 0) {
+			return false;
+		}
+		if(result == 0) {
+			break;
+		}
+		consumed += frame_size;
+		frames_received.fetch_add(1, std::memory_order_relaxed);
+		requests.fetch_add(records.size(), std::memory_order_relaxed);
+		
+		for(const auto& record : records) {
+			if(record.code == static_cast<uint16_t>(RemoteOp::PING)) {
+				replies.add(record.request_id, static_cast<uint16_t>(RemoteStatus::OK), record.body, record.length);
+			} else if(record.code == static_cast<uint16_t>(RemoteOp::LOGIN)) {
+				replies.add(record.request_id, static_cast<uint16_t>(handle_login(session, record)), nullptr, 0);
+			} else if(record.code > static_cast<uint16_t>(RemoteOp::LOGIN)) {
+				replies.add(record.request_id, static_cast<uint16_t>(RemoteStatus::UNKNOWN_OP), nullptr, 0);
+			} else if(!permitted(session, record.code)) {
+				denied.fetch_add(1, std::memory_order_relaxed);
+				replies.add(record.request_id, static_cast<uint16_t>(RemoteStatus::DENIED), nullptr, 0);
+			} else if(session.inflight.load(std::memory_order_relaxed) >= REMOTE_MAX_INFLIGHT) {
+				busy.fetch_add(1, std::memory_order_relaxed);
+				replies.add(record.request_id, static_cast<uint16_t>(RemoteStatus::BUSY), nullptr, 0);
+			} else {
+				session.inflight.fetch_add(1, std::memory_order_relaxed);
+				batch.push_back({owner, record.request_id, record.code, std::string(record.body, record.length)});
+			}
+		}
+	}
+	
+	if(!batch.empty()) {
+		{
+			std::lock_guard<std::mutex> lock(task_mutex);
+			for(auto& task : batch) {
+				tasks.push_back(std::move(task));
+			}
+		}
+		if(batch.size() > 1) {
+			task_ready.notify_all();
+		} else {
+			task_ready.notify_one();
+		}
+	}
+	if(replies.count() > 0) {
+		responses.fetch_add(replies.count(), std::memory_order_relaxed);
+		deliver(session, replies.finish());
+	}
+	return true;
+}
+
+RemoteStatus RemoteServer::handle_login(Session& session, const RemoteRecord& record) {
+	// 不论成败先退出原身份，登录失败的连接不保留之前的权限
+	session.user.clear();
+	if(record.length < 2 || record.length - 2 < remote_get_u16(record.body)) {
+		return RemoteStatus::BAD_REQUEST;
+	}
+	size_t name_length = remote_get_u16(record.body);
+	std::string username(record.body + 2, name_length);
+	std::string password(record.body + 2 + name_length, record.length - 2 - name_length);
+	if(username.empty() || !auth.authenticate(username, password)) {
+		denied.fetch_add(1, std::memory_order_relaxed);
+		SLOGF_WARNING(logger, "RemoteServer", "连接 {} 以用户 {} 登录失败", session.client_id, username);
+		return RemoteStatus::DENIED;
+	}
+	session.user = username;
+	SLOGF_INFO(logger, "RemoteServer", "连接 {} 以用户 {} 登录", session.client_id, username);
+	return RemoteStatus::OK;
+}
+
+bool RemoteServer::permitted(const Session& session, uint16_t op) const {
+	if(session.user.empty()) {
+		return false;
+	}
+	const char* permission;
+	switch(static_cast<RemoteOp>(op)) {
+	case RemoteOp::KERNEL_COMMAND:
+		permission = REMOTE_PERM_KERNEL;
+		break;
+	case RemoteOp::DISK_READ:
+	case RemoteOp::DISK_LIST:
+		permission = REMOTE_PERM_DISK_READ;
+		break;
+	case RemoteOp::DISK_WRITE:
+		permission = REMOTE_PERM_DISK_WRITE;
+		break;
+	case RemoteOp::LOG_SEARCH:
+	case RemoteOp::LOG_RECENT:
+		permission = REMOTE_PERM_LOG;
+		break;
+	default:
+		return false;
+	}
+	return auth.has_permission(session.user, permission);
+}
+
+void RemoteServer::worker_loop() {
+	std::vector<Task> batch;
+	std::string result;
+	while(true) {
+		{
+			std::unique_lock<std::mutex> lock(task_mutex);
+			task_ready.wait(lock, [this] { return !running || !tasks.empty(); });
+			if(!running) {
+				return;
+			}
+			size_t count = std::min<size_t>(tasks.size(), REMOTE_WORKER_BATCH);
+			for(size_t i = 0; i < count; i++) {
+				batch.push_back(std::move(tasks.front()));
+				tasks.pop_front();
+			}
+		}
+		
+		// 同一批中属于同一连接的应答合并成一帧，帧长接近上限时先发出已有的部分
+		std::vector<std::pair<std::shared_ptr<Session>, RemoteFrameBuilder>> frames;
+		auto flush = [this](Session& session, RemoteFrameBuilder& builder) {
+			uint32_t count = builder.count();
+			responses.fetch_add(count, std::memory_order_relaxed);
+			deliver(session, builder.finish());
+			session.inflight.fetch_sub(count, std::memory_order_relaxed);
+		};
+		for(const auto& task : batch) {
+			// 任何操作的结果都不能让应答帧超过 REMOTE_MAX_FRAME，否则客户端会把整帧当作格式错误
+			RemoteStatus status = execute(task, result);
+			if(result.size() > REMOTE_MAX_FRAME - REMOTE_RECORD_HEADER) {
+				result = "结果超过单帧上限";
+				status = RemoteStatus::FAILED;
+			}
+			auto it = std::find_if(frames.begin(), frames.end(), [&](const auto& frame) {
+				return frame.first == task.session;
+			});
+			if(it == frames.end()) {
+				frames.emplace_back(task.session, RemoteFrameBuilder());
+				it = frames.end() - 1;
+			}
+			if(it->second.count() > 0 &&
+			   it->second.size() + REMOTE_RECORD_HEADER + result.size() > REMOTE_FRAME_HEADER + REMOTE_MAX_FRAME) {
+				flush(*it->first, it->second);
+			}
+			it->second.add(task.request_id, static_cast<uint16_t>(status), result);
+		}
+		for(auto& frame : frames) {
+			flush(*frame.first, frame.second);
+		}
+		batch.clear();
+	}
+}
+
+RemoteStatus RemoteServer::execute(const Task& task, std::string& result) {
+	result.clear();
+	const std::string& body = task.body;
+	switch(static_cast<RemoteOp>(task.op)) {
+	case RemoteOp::KERNEL_COMMAND: {
+		std::ostringstream out;
+		kernel.execute_command(body, out);
+		result = out.str();
+		break;
+	}
+	
+	case RemoteOp::DISK_READ:
+		// read_file 对空文件和不存在的文件都返回空串，靠打开文件区分
+		result = disk.read_file(body);
+		if(result.empty() && !disk.open_file(body)) {
+			result = "文件不存在";
+			return RemoteStatus::FAILED;
+		}
+		break;
+	
+	case RemoteOp::DISK_WRITE: {
+		if(body.size() < 2 || body.size() - 2 < remote_get_u16(body.data())) {
+			return RemoteStatus::BAD_REQUEST;
+		}
+		size_t name_length = remote_get_u16(body.data());
+		std::string filename = body.substr(2, name_length);
+		if(!disk.write_file(filename, body.substr(2 + name_length))) {
+			result = "写入失败";
+			return RemoteStatus::FAILED;
+		}
+		break;
+	}
+	
+	case RemoteOp::DISK_LIST:
+		for(const auto& file : disk.list_files(body)) {
+			result += file.type + "\t" + std::to_string(file.size) + "\t" + file.name + "\n";
+		}
+		break;
+	
+	case RemoteOp::LOG_SEARCH:
+		if(body.size() < 8) {
+			return RemoteStatus::BAD_REQUEST;
+		}
+		append_entries(logger.search(body.substr(8), remote_get_u32(body.data()), 0,
+			std::numeric_limits<time_t>::max(),
+			std::min<uint32_t>(remote_get_u32(body.data() + 4), REMOTE_MAX_LOG_ENTRIES)), result);
+		break;
+	
+	case RemoteOp::LOG_RECENT:
+		if(body.size() < 4) {
+			return RemoteStatus::BAD_REQUEST;
+		}
+		append_entries(logger.get_recent_logs(std::min<uint32_t>(remote_get_u32(body.data()),
+			REMOTE_MAX_LOG_ENTRIES)), result);
+		break;
+	
+	default:
+		return RemoteStatus::UNKNOWN_OP;
+	}
+	return RemoteStatus::OK;
+}
+
+void RemoteServer::deliver(Session& session, std::string frame) {
+	auto block = std::make_shared<const std::string>(std::move(frame));
+	std::lock_guard<std::mutex> lock(session.mutex);
+	if(session.closed) {
+		return;
+	}
+	frames_sent.fetch_add(1, std::memory_order_relaxed);
+	
+	// 已有暂存的应答时排在它们后面，等发送队列回落后由 handle_drain 依次发出
+	if(session.backlog.empty() &&
+	   network.send_chain(session.client_id, {NetworkManager::SendSegment::memory(block)})) {
+		return;
+	}
+	session.backlog_bytes += block->size();
+	session.backlog.push_back(std::move(block));
+	if(session.backlog_bytes > REMOTE_BACKLOG_LIMIT) {
+		session.closed = true;
+		session.backlog.clear();
+		session.backlog_bytes = 0;
+		SLOGF_WARNING(logger, "RemoteServer", "连接 {} 长时间不读取应答，已断开", session.client_id);
+		network.disconnect_client(session.client_id);
+	}
+}
+
+void RemoteServer::handle_drain(int client_id) {
+	std::shared_ptr<Session> session;
+	{
+		std::lock_guard<std::mutex> lock(sessions_mutex);
+		auto it = sessions.find(client_id);
+		if(it == sessions.end()) {
+			return;
+		}
+		session = it->second;
+	}
+	
+	std::lock_guard<std::mutex> lock(session->mutex);
+	while(!session->closed && !session->backlog.empty()) {
+		if(!network.send_chain(client_id, {NetworkManager::SendSegment::memory(session->backlog.front())})) {
+			break;
+		}
+		session->backlog_bytes -= session->backlog.front()->size();
+		session->backlog.pop_front();
+	}
+}
+
+void RemoteServer::handle_close(int client_id) {
+	std::shared_ptr<Session> session;
+	{
+		std::lock_guard<std::mutex> lock(sessions_mutex);
+		auto it = sessions.find(client_id);
+		if(it == sessions.end()) {
+			return;
+		}
+		session = std::move(it->second);
+		sessions.erase(it);
+	}
+	
+	// 仍在队列或执行中的请求照常完成，应答在 deliver 中丢弃
+	std::lock_guard<std::mutex> lock(session->mutex);
+	session->closed = true;
+	session->backlog.clear();
+	session->backlog_bytes = 0;
+}
+
+RemoteServer::Stats RemoteServer::get_stats() const {
+	Stats stats;
+	stats.frames_received = frames_received.load(std::memory_order_relaxed);
+	stats.requests = requests.load(std::memory_order_relaxed);
+	stats.frames_sent = frames_sent.load(std::memory_order_relaxed);
+	stats.responses = responses.load(std::memory_order_relaxed);
+	stats.busy = busy.load(std::memory_order_relaxed);
+	stats.protocol_errors = protocol_errors.load(std::memory_order_relaxed);
+	stats.denied = denied.load(std::memory_order_relaxed);
+	return stats;
+}
@@ -71,11 +71,21 @@ std::string UserAuth::get_current_user() const {
 	return current_user;
 }
 
-bool UserAuth::has_permission(const std::string& permission) {
+bool UserAuth::authenticate(const std::string& username, const std::string& password) {
 	std::lock_guard<std::mutex> lock(auth_mutex);
 	
-	auto it = users.find(current_user);
-	if (it == users.end() || !is_authenticated()) {
+	auto it = users.find(username);
+	if (it == users.end() || !verify_password(password, it->second.password_hash)) {
+		return false;
+	}
+	
+	it->second.last_login = time(nullptr);
+	return true;
+}
+
+bool UserAuth::permitted(const std::string& username, const std::string& permission) const {
+	auto it = users.find(username);
+	if (it == users.end()) {
 		return false;
 	}
 	
@@ -87,6 +97,17 @@ bool UserAuth::has_permission(const std::string& permission) {
 	return std::find(perms.begin(), perms.end(), permission) != perms.end();
 }
 
+bool UserAuth::has_permission(const std::string& permission) {
+	// 未登录时 current_user 为空，查不到用户
+	std::lock_guard<std::mutex> lock(auth_mutex);
+	return permitted(current_user, permission);
+}
+
+bool UserAuth::has_permission(const std::string& username, const std::string& permission) const {
+	std::lock_guard<std::mutex> lock(auth_mutex);
+	return permitted(username, permission);
+}
+
 bool UserAuth::add_permission(const std::string& username, const std::string& permission) {
 	std::lock_guard<std::mutex> lock(auth_mutex);
 	
@@ -0,0 +1,264 @@
+// diskbench.cpp
+// DiskManager 本机基准。
+// -m small：在两个临时镜像中写入同一组随机大小的小文件，一个按默认策略内联与打包尾部，
+// 另一个关闭内联与打包（每个非空文件至少占一整块），再全部读回校验，
+// 比较占用空间、镜像读写次数与耗时。
+// -m verify：写入一组文件后交替开启与关闭 CRC32C 读校验，多轮读出全部文件，
+// 分别在镜像留在宿主机页缓存中（热读）与每轮前丢弃页缓存（冷读）两种情况下
+// 给出两者的吞吐与校验开销占比
+#include "../../include/disk_manager.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+	
+	struct Options {
+		std::string mode = "small";
+		size_t files = 0;           // 为 0 时按模式取默认值
+		size_t max_size = 0;        // small 模式下文件大小在 [0, max_size] 内均匀分布，verify 模式下为文件大小
+		int passes = 5;             // verify 模式下开启、关闭校验各读的轮数
+	};
+	
+	double seconds_since(Clock::time_point start) {
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	
+	std::string file_name(size_t i) {
+		return "/home/f" + std::to_string(i);
+	}
+	
+	struct SmallResult {
+		DiskManager::StorageStats stats;
+		size_t write_ops;
+		size_t read_ops;
+		double write_seconds;
+		double read_seconds;
+		size_t mismatches;
+	};
+	
+	bool run_small(const Options& options, const std::vector<std::string>& contents, bool packed,
+	               SmallResult& result) {
+		const std::string image_path = packed ? "diskbench-packed.disk" : "diskbench-plain.disk";
+		unlink(image_path.c_str());
+		size_t image_size = std::max<size_t>(64, options.files * 16 / 1024) * 1024 * 1024;
+		std::unique_ptr<DiskManager> disk(new DiskManager(image_path, image_size));
+		if(!packed) {
+			disk->set_small_file_policy(0, 0);
+		}
+		
+		DiskManager::StorageStats before = disk->get_storage_stats();
+		auto start = Clock::now();
+		for(size_t i = 0; i < contents.size(); i++) {
+			if(!disk->write_file(file_name(i), contents[i])) {
+				std::cerr << "写入失败: " << file_name(i) << std::endl;
+				return false;
+			}
+		}
+		result.write_seconds = seconds_since(start);
+		DiskManager::StorageStats written = disk->get_storage_stats();
+		result.write_ops = written.disk_writes - before.disk_writes;
+		
+		result.mismatches = 0;
+		start = Clock::now();
+		for(size_t i = 0; i < contents.size(); i++) {
+			if(disk->read_file(file_name(i)) != contents[i]) {
+				result.mismatches++;
+			}
+		}
+		result.read_seconds = seconds_since(start);
+		result.stats = disk->get_storage_stats();
+		result.read_ops = result.stats.disk_reads - written.disk_reads;
+		
+		disk.reset();
+		unlink(image_path.c_str());
+		return true;
+	}
+	
+	void print_small(const char* label, const SmallResult& result) {
+		const DiskManager::StorageStats& stats = result.stats;
+		printf("%s：占用 %.2f MB（内容 %.2f MB），内联 %zu 个，打包尾部 %zu 个，共享尾块 %zu 个\n",
+			label, stats.allocated_bytes / (1024.0 * 1024), stats.logical_bytes / (1024.0 * 1024),
+			stats.inline_files, stats.packed_tails, stats.tail_blocks);
+		printf("    写入 %.1f ms，镜像写 %zu 次；读回 %.1f ms，镜像读 %zu 次；内容不符 %zu 个\n",
+			result.write_seconds * 1000, result.write_ops, result.read_seconds * 1000,
+			result.read_ops, result.mismatches);
+	}
+	
+	int bench_small(const Options& options) {
+		std::mt19937 rng(27);
+		std::uniform_int_distribution<size_t> size_dist(0, options.max_size);
+		std::vector<std::string> contents(options.files);
+		for(auto& content : contents) {
+			content.resize(size_dist(rng));
+			for(auto& c : content) {
+				c = static_cast<char>('a' + rng() % 26);
+			}
+		}
+		
+		SmallResult packed, plain;
+		if(!run_small(options, contents, true, packed) || !run_small(options, contents, false, plain)) {
+			return 1;
+		}
+		
+		printf("%zu 个文件，大小 0-%zu 字节\n", options.files, options.max_size);
+		print_small("内联与尾部打包", packed);
+		print_small("每文件整块分配", plain);
+		printf("空间节省 %.1f%%，镜像写次数节省 %.1f%%，镜像读次数节省 %.1f%%\n",
+			100.0 * (1.0 - (double)packed.stats.allocated_bytes / std::max<size_t>(1, plain.stats.allocated_bytes)),
+			100.0 * (1.0 - (double)packed.write_ops / std::max<size_t>(1, plain.write_ops)),
+			100.0 * (1.0 - (double)packed.read_ops / std::max<size_t>(1, plain.read_ops)));
+		return packed.mismatches || plain.mismatches ? 1 : 0;
+	}
+	
+	// 经流式句柄读出全部文件，返回耗时秒数；读取失败时返回负数
+	double read_all(DiskManager& disk, size_t files, std::vector<char>& buffer) {
+		auto start = Clock::now();
+		for(size_t i = 0; i < files; i++) {
+			auto handle = disk.open_file(file_name(i), DiskManager::OpenMode::READ);
+			if(!handle) {
+				return -1;
+			}
+			while(handle->read(buffer.data(), buffer.size()) > 0) {
+			}
+			handle->close();
+		}
+		return seconds_since(start);
+	}
+	
+	// 丢弃镜像在宿主机页缓存中的页，下一轮读取来自存储设备
+	void drop_page_cache(DiskManager& disk) {
+		fdatasync(disk.image_descriptor());
+		posix_fadvise(disk.image_descriptor(), 0, 0, POSIX_FADV_DONTNEED);
+	}
+	
+	struct VerifyResult {
+		double on_seconds;      // 开启校验时各轮中的最短耗时
+		double off_seconds;
+		double checksum_ms;     // 开启校验的各轮累计校验耗时
+		double read_ms;         // 开启校验的各轮累计镜像读耗时
+	};
+	
+	// 开启与关闭交替进行，避免先后顺序带来的偏差；各取最快一轮
+	bool run_verify(const Options& options, DiskManager& disk, bool cold, VerifyResult& result) {
+		std::vector<char> buffer(1024 * 1024);
+		result = VerifyResult{1e30, 1e30, 0, 0};
+		for(int pass = 0; pass < options.passes * 2; pass++) {
+			bool verify = (pass % 2 == 0) != (pass / 2 % 2 == 1);
+			disk.set_read_verification(verify);
+			if(cold) {
+				drop_page_cache(disk);
+			}
+			DiskManager::StorageStats before = disk.get_storage_stats();
+			double seconds = read_all(disk, options.files, buffer);
+			if(seconds < 0) {
+				std::cerr << "读取失败" << std::endl;
+				return false;
+			}
+			DiskManager::StorageStats after = disk.get_storage_stats();
+			if(after.checksum_errors != before.checksum_errors) {
+				std::cerr << "校验和不符" << std::endl;
+				return false;
+			}
+			if(verify) {
+				result.on_seconds = std::min(result.on_seconds, seconds);
+				result.checksum_ms += after.checksum_ms - before.checksum_ms;
+				result.read_ms += after.read_ms - before.read_ms;
+			} else {
+				result.off_seconds = std::min(result.off_seconds, seconds);
+			}
+		}
+		disk.set_read_verification(true);
+		return true;
+	}
+	
+	void print_verify(const char* label, const Options& options, const VerifyResult& result) {
+		double mb = options.files * (double)options.max_size / (1024 * 1024);
+		printf("%s：校验 %.0f MB/秒，不校验 %.0f MB/秒，校验使读取耗时增加 %.1f%%"
+			"（校验累计 %.1f ms，镜像读累计 %.1f ms）\n",
+			label, mb / result.on_seconds, mb / result.off_seconds,
+			100.0 * (result.on_seconds - result.off_seconds) / result.off_seconds,
+			result.checksum_ms, result.read_ms);
+	}
+	
+	int bench_verify(const Options& options) {
+		const std::string image_path = "diskbench-verify.disk";
+		unlink(image_path.c_str());
+		size_t data_bytes = options.files * options.max_size;
+		std::unique_ptr<DiskManager> disk(new DiskManager(image_path, data_bytes * 8 + 64 * 1024 * 1024));
+		
+		std::mt19937 rng(37);
+		std::string content(options.max_size, '\0');
+		for(size_t i = 0; i < options.files; i++) {
+			for(auto& c : content) {
+				c = static_cast<char>(rng());
+			}
+			if(!disk->write_file(file_name(i), content)) {
+				std::cerr << "写入失败: " << file_name(i) << std::endl;
+				return 1;
+			}
+		}
+		
+		printf("%zu 个文件，每个 %zu 字节，开启与关闭校验各读 %d 轮\n",
+			options.files, options.max_size, options.passes);
+		VerifyResult warm, cold;
+		bool ok = run_verify(options, *disk, false, warm) && run_verify(options, *disk, true, cold);
+		if(ok) {
+			print_verify("热读（宿主机页缓存）", options, warm);
+			print_verify("冷读（每轮前丢弃页缓存）", options, cold);
+		}
+		disk.reset();
+		unlink(image_path.c_str());
+		return ok ? 0 : 1;
+	}
+	
+	void usage() {
+		std::cerr << "用法: diskbench [-m small|verify] [-n 文件数] [-s 文件字节数] [-p 轮数]" << std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Options options;
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(i + 1 >= argc) {
+			usage();
+			return 1;
+		}
+		std::string value = argv[++i];
+		if(arg == "-m") {
+			options.mode = value;
+		} else if(arg == "-n") {
+			options.files = std::max(1L, strtol(value.c_str(), nullptr, 10));
+		} else if(arg == "-s") {
+			options.max_size = std::max(0L, strtol(value.c_str(), nullptr, 10));
+		} else if(arg == "-p") {
+			options.passes = std::max(1L, strtol(value.c_str(), nullptr, 10));
+		} else {
+			usage();
+			return 1;
+		}
+	}
+	
+	if(options.mode == "small") {
+		options.files = options.files ? options.files : 2000;
+		options.max_size = options.max_size ? options.max_size : 3000;
+		return bench_small(options);
+	}
+	if(options.mode == "verify") {
+		options.files = options.files ? options.files : 64;
+		options.max_size = options.max_size ? options.max_size : 1024 * 1024;
+		return bench_verify(options);
+	}
+	usage();
+	return 1;
+}
@@ -0,0 +1,261 @@
+// fsbench.cpp
+// FileSystem 吞吐基准：在文件镜像、内存盘与 DiskManager 分区三种 BlockDevice 上各格式化一个
+// 文件系统，依次测量顺序写、顺序重写（同样大小、内容全变）、顺序读，以及按随机顺序
+// 写入与读取大量小文件。写入计时包含 sync，读取前重新挂载以清空块缓存
+// （文件镜像仍可能命中宿主机页缓存）。同时给出各阶段设备层实际读写的字节数
+#include "../../include/filesystem.h"
+#include "../../include/block_device.h"
+#include "../../include/disk_manager.h"
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+	
+	struct Options {
+		std::string backend = "all";
+		size_t seq_mb = 32;         // 顺序阶段的数据总量
+		size_t seq_file_mb = 4;     // 顺序阶段每个文件的大小
+		size_t rand_mb = 16;        // 随机阶段的数据总量
+		size_t rand_file_kb = 16;   // 随机阶段每个文件的大小
+	};
+	
+	// 内容由文件序号与轮次决定，读回时无需保存原数据即可校验
+	void fill(std::vector<char>& data, size_t file, size_t round) {
+		uint64_t x = (file + 1) * 0x9E3779B97F4A7C15ull ^ (round + 1) * 0xC2B2AE3D27D4EB4Full;
+		for(size_t i = 0; i + 8 <= data.size(); i += 8) {
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			memcpy(&data[i], &x, 8);
+		}
+	}
+	
+	struct Phase {
+		const char* name;
+		bool ok;
+		double seconds;
+		size_t bytes;
+		BlockDevice::IoStats device;   // 本阶段设备层的读写量
+	};
+	
+	class Runner {
+	public:
+		Runner(const Options& options, FileSystem& fs, BlockDevice& device)
+		: options(options), fs(fs), device(device), errors(0) {}
+		
+		bool run(std::vector<Phase>& phases) {
+			if(!fs.format(device) || !fs.mount(device, "/bench")) {
+				return false;
+			}
+			size_t seq_bytes = options.seq_file_mb * 1024 * 1024;
+			size_t seq_files = std::max<size_t>(1, options.seq_mb / std::max<size_t>(1, options.seq_file_mb));
+			size_t rand_bytes = options.rand_file_kb * 1024;
+			size_t rand_files = std::max<size_t>(1, options.rand_mb * 1024 / std::max<size_t>(1, options.rand_file_kb));
+			
+			std::vector<size_t> order(rand_files);
+			for(size_t i = 0; i < order.size(); i++) {
+				order[i] = i;
+			}
+			std::mt19937 rng(32);
+			
+			phases.push_back(measure("顺序写", seq_files * seq_bytes, [&]() {
+				return write_files("/seq", seq_files, seq_bytes, 0, nullptr);
+			}));
+			phases.push_back(measure("顺序重写", seq_files * seq_bytes, [&]() {
+				return write_files("/seq", seq_files, seq_bytes, 1, nullptr);
+			}));
+			phases.push_back(measure("顺序读", seq_files * seq_bytes, [&]() {
+				return read_files("/seq", seq_files, seq_bytes, 1, nullptr);
+			}));
+			std::shuffle(order.begin(), order.end(), rng);
+			phases.push_back(measure("随机写", rand_files * rand_bytes, [&]() {
+				return write_files("/rand", rand_files, rand_bytes, 0, &order);
+			}));
+			std::shuffle(order.begin(), order.end(), rng);
+			phases.push_back(measure("随机读", rand_files * rand_bytes, [&]() {
+				return read_files("/rand", rand_files, rand_bytes, 0, &order);
+			}));
+			return fs.unmount() && errors == 0;
+		}
+		
+		size_t error_count() const { return errors; }
+	
+	private:
+		const Options& options;
+		FileSystem& fs;
+		BlockDevice& device;
+		size_t errors;
+		
+		template <typename Body>
+		Phase measure(const char* name, size_t bytes, Body body) {
+			BlockDevice::IoStats before = device.get_stats();
+			auto start = Clock::now();
+			Phase phase;
+			phase.ok = body();
+			if(!phase.ok) {
+				errors++;
+			}
+			phase.name = name;
+			phase.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			phase.bytes = bytes;
+			BlockDevice::IoStats after = device.get_stats();
+			phase.device = after;
+			phase.device.bytes_read -= before.bytes_read;
+			phase.device.bytes_written -= before.bytes_written;
+			return phase;
+		}
+		
+		std::string path(const std::string& dir, size_t i) {
+			return dir + "/" + std::to_string(i);
+		}
+		
+		// round 为 0 时先创建目录与文件；order 为空时按序号顺序访问
+		bool write_files(const std::string& dir, size_t count, size_t bytes, size_t round,
+		                 const std::vector<size_t>* order) {
+			if(round == 0 && !fs.create_directory(dir)) {
+				return false;
+			}
+			std::vector<char> data(bytes);
+			for(size_t n = 0; n < count; n++) {
+				size_t i = order ? (*order)[n] : n;
+				fill(data, i, round);
+				if(round == 0 && !fs.create_file(path(dir, i))) {
+					return false;
+				}
+				if(!fs.write_file(path(dir, i), data.data(), data.size())) {
+					return false;
+				}
+			}
+			return fs.sync();
+		}
+		
+		bool read_files(const std::string& dir, size_t count, size_t bytes, size_t round,
+		                const std::vector<size_t>* order) {
+			if(!fs.unmount() || !fs.mount(device, "/bench")) {
+				return false;
+			}
+			std::vector<char> expected(bytes);
+			std::vector<char> data(bytes);
+			for(size_t n = 0; n < count; n++) {
+				size_t i = order ? (*order)[n] : n;
+				if(!fs.read_file(path(dir, i), data.data(), data.size())) {
+					return false;
+				}
+				fill(expected, i, round);
+				if(data != expected) {
+					errors++;
+				}
+			}
+			return true;
+		}
+	};
+	
+	void report(const char* backend, const std::vector<Phase>& phases) {
+		for(const auto& phase : phases) {
+			if(!phase.ok) {
+				printf("%-10s %s：失败\n", backend, phase.name);
+				continue;
+			}
+			printf("%-10s %s：%.1f MB/秒，设备读 %.1f MB，设备写 %.1f MB\n", backend, phase.name,
+				phase.bytes / (1024.0 * 1024) / std::max(phase.seconds, 1e-9),
+				phase.device.bytes_read / (1024.0 * 1024), phase.device.bytes_written / (1024.0 * 1024));
+		}
+	}
+	
+	// 设备容量留出两倍数据量与元数据的余量；format 按每 4 块一个 inode 分配，小文件多时按文件数放大
+	uint64_t device_blocks(const Options& options) {
+		uint64_t blocks = ((options.seq_mb + options.rand_mb) * 2 + 16) * 1024 * 1024 / BLOCK_SIZE;
+		uint64_t files = options.seq_mb / options.seq_file_mb + options.rand_mb * 1024 / options.rand_file_kb;
+		return std::max<uint64_t>(blocks, (files + 64) * 4);
+	}
+	
+	bool bench(const Options& options, const char* backend, BlockDevice& device) {
+		FileSystem fs;
+		Runner runner(options, fs, device);
+		std::vector<Phase> phases;
+		bool ok = runner.run(phases);
+		report(backend, phases);
+		if(!ok) {
+			std::cerr << backend << "：测试失败，出错 " << runner.error_count() << " 处" << std::endl;
+		}
+		return ok;
+	}
+	
+	void usage() {
+		std::cerr << "用法: fsbench [-b file|ram|partition|all] [-s 顺序 MB] [-f 顺序文件 MB]"
+		          << " [-r 随机 MB] [-k 随机文件 KB]" << std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Options options;
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(i + 1 >= argc) {
+			usage();
+			return 1;
+		}
+		std::string value = argv[++i];
+		long number = std::max(1L, strtol(value.c_str(), nullptr, 10));
+		if(arg == "-b") {
+			options.backend = value;
+		} else if(arg == "-s") {
+			options.seq_mb = number;
+		} else if(arg == "-f") {
+			options.seq_file_mb = number;
+		} else if(arg == "-r") {
+			options.rand_mb = number;
+		} else if(arg == "-k") {
+			options.rand_file_kb = number;
+		} else {
+			usage();
+			return 1;
+		}
+	}
+	
+	bool all = options.backend == "all";
+	if(!all && options.backend != "file" && options.backend != "ram" && options.backend != "partition") {
+		usage();
+		return 1;
+	}
+	
+	bool ok = true;
+	uint64_t blocks = device_blocks(options);
+	printf("顺序 %zu MB（每文件 %zu MB），随机 %zu MB（每文件 %zu KB）\n",
+		options.seq_mb, options.seq_file_mb, options.rand_mb, options.rand_file_kb);
+	if(all || options.backend == "file") {
+		const char* image_path = "fsbench.img";
+		unlink(image_path);
+		{
+			FileBlockDevice device(image_path, blocks, BLOCK_SIZE);
+			ok = device.is_open() && bench(options, "file", device) && ok;
+		}
+		unlink(image_path);
+	}
+	if(all || options.backend == "ram") {
+		RamBlockDevice device(blocks, BLOCK_SIZE);
+		ok = bench(options, "ram", device) && ok;
+	}
+	if(all || options.backend == "partition") {
+		// 设备文件放在 /home 分区，该分区占镜像的四分之一
+		const char* image_path = "fsbench.disk";
+		unlink(image_path);
+		{
+			DiskManager disk(image_path, blocks * BLOCK_SIZE * 8);
+			PartitionBlockDevice device(disk, "/home/fsbench.img", blocks, BLOCK_SIZE);
+			ok = device.is_open() && bench(options, "partition", device) && ok;
+		}
+		unlink(image_path);
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+// logbench.cpp
+// SystemLogger 多生产者压测：若干线程同时不间断地记录日志，统计每次调用在调用方的耗时分位数、
+// 总吞吐，以及队列满时丢弃的条目数、写文件的系统调用次数。结束时以 critical() 等待全部落盘。
+// 默认不限速（洪泛），-r 指定所有线程合计的目标速率，用来找出后台线程能持续写入而不丢弃的速率。
+// -m text 经 info() 提交已拼好的消息，-m struct 经 SLOGF_INFO 只提交格式串编号与参数。
+// -m disabled 在运行时级别为 INFO 时单线程测量被过滤的 SLOG_DEBUG / SLOGF_DEBUG 每次调用的开销，
+// 扣除同样次数的空循环
+#include "../../include/logger.h"
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+	
+	struct Options {
+		int threads = 4;
+		size_t entries = 200000;        // 每个线程记录的条目数
+		std::string mode = "text";
+		std::string format = "text";    // 日志文件格式
+		double rate = 0;                // 所有线程合计每秒条目数，0 表示不限速
+	};
+	
+	// 每次调用单独计时；两次读时钟本身约几十纳秒，计入结果
+	void run_producer(const Options& options, SystemLogger& logger, int id, std::vector<uint32_t>& latency_ns) {
+		latency_ns.reserve(options.entries);
+		std::string message = "request handled id=12345 status=ok thread=" + std::to_string(id);
+		bool structured = options.mode == "struct";
+		// 限速时每 64 条对照一次进度，超前则休眠
+		auto begin = Clock::now();
+		double interval = options.rate > 0 ? options.threads / options.rate : 0;
+		for(size_t i = 0; i < options.entries; i++) {
+			if(interval > 0 && i % 64 == 0) {
+				std::this_thread::sleep_until(begin + std::chrono::duration_cast<Clock::duration>(
+					std::chrono::duration<double>(i * interval)));
+			}
+			auto start = Clock::now();
+			if(structured) {
+				SLOGF_INFO(logger, "logbench", "request handled id={} status={} thread={}", i, "ok", id);
+			} else {
+				logger.info(message, "logbench");
+			}
+			latency_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				Clock::now() - start).count());
+		}
+	}
+	
+	// 每种循环跑若干轮取最快一轮，减少调度与中断的干扰
+	const int DISABLED_ROUNDS = 50;
+	
+	template<typename Body>
+	double best_round_ns(size_t iterations, Body body) {
+		double best = 0;
+		for(int round = 0; round < DISABLED_ROUNDS; round++) {
+			auto start = Clock::now();
+			for(size_t i = 0; i < iterations; i++) {
+				body(i);
+			}
+			double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+			if(round == 0 || ns < best) {
+				best = ns;
+			}
+		}
+		return best / iterations;
+	}
+	
+	int run_disabled(const Options& options, const std::string& log_path) {
+		SystemLogger logger(log_path);
+		logger.set_level(SystemLogger::LogLevel::INFO);
+		std::string message = "request handled id=12345 status=ok";
+		// 每次迭代写一次 volatile，防止空循环被整个优化掉
+		volatile size_t sink = 0;
+		
+		double empty_ns = best_round_ns(options.entries, [&](size_t i) {
+			sink = i;
+		});
+		double slog_ns = best_round_ns(options.entries, [&](size_t i) {
+			SLOG_DEBUG(logger, message, "logbench");
+			sink = i;
+		});
+		double slogf_ns = best_round_ns(options.entries, [&](size_t i) {
+			SLOGF_DEBUG(logger, "logbench", "request handled id={} status={}", i, "ok");
+			sink = i;
+		});
+		SystemLogger::LoggerStats stats = logger.get_stats();
+		
+		printf("运行时级别 INFO，每轮 %zu 次，%d 轮取最快\n", options.entries, DISABLED_ROUNDS);
+		printf("空循环 %.2f ns/次\n", empty_ns);
+		printf("SLOG_DEBUG %.2f ns/次，扣除空循环 %.2f ns\n", slog_ns, slog_ns - empty_ns);
+		printf("SLOGF_DEBUG %.2f ns/次，扣除空循环 %.2f ns\n", slogf_ns, slogf_ns - empty_ns);
+		// 被过滤的调用不应入队
+		return stats.enqueued == 0 ? 0 : 1;
+	}
+	
+	void usage() {
+		std::cerr << "用法: logbench [-t 生产者线程数] [-n 每线程条目数] [-m text|struct|disabled] [-f text|binary]"
+		          << " [-r 合计条目数/秒]"
+		          << std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Options options;
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(i + 1 >= argc) {
+			usage();
+			return 1;
+		}
+		std::string value = argv[++i];
+		if(arg == "-t") {
+			options.threads = std::max(1L, strtol(value.c_str(), nullptr, 10));
+		} else if(arg == "-n") {
+			options.entries = std::max(1L, strtol(value.c_str(), nullptr, 10));
+		} else if(arg == "-m") {
+			options.mode = value;
+		} else if(arg == "-f") {
+			options.format = value;
+		} else if(arg == "-r") {
+			options.rate = std::max(0.0, strtod(value.c_str(), nullptr));
+		} else {
+			usage();
+			return 1;
+		}
+	}
+	if((options.mode != "text" && options.mode != "struct" && options.mode != "disabled") ||
+	   (options.format != "text" && options.format != "binary")) {
+		usage();
+		return 1;
+	}
+	
+	const std::string log_path = "logbench.log";
+	unlink(log_path.c_str());
+	if(options.mode == "disabled") {
+		int result = run_disabled(options, log_path);
+		unlink(log_path.c_str());
+		return result;
+	}
+	
+	std::vector<std::vector<uint32_t>> latencies(options.threads);
+	SystemLogger::LoggerStats stats;
+	double elapsed;
+	{
+		SystemLogger logger(log_path, LOG_HISTORY_ENTRIES,
+			options.format == "binary" ? SystemLogger::LogFormat::BINARY : SystemLogger::LogFormat::TEXT);
+		std::vector<std::thread> producers;
+		auto start = Clock::now();
+		for(int t = 0; t < options.threads; t++) {
+			producers.emplace_back(run_producer, std::cref(options), std::ref(logger), t, std::ref(latencies[t]));
+		}
+		for(auto& producer : producers) {
+			producer.join();
+		}
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		logger.critical("logbench done", "logbench");
+		stats = logger.get_stats();
+	}
+	unlink(log_path.c_str());
+	
+	std::vector<uint32_t> all;
+	for(auto& latency : latencies) {
+		all.insert(all.end(), latency.begin(), latency.end());
+	}
+	std::sort(all.begin(), all.end());
+	auto percentile = [&](double p) -> uint32_t {
+		return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))];
+	};
+	double sum = 0;
+	for(uint32_t ns : all) {
+		sum += ns;
+	}
+	
+	uint64_t calls = all.size();
+	printf("生产者 %d 个，每个 %zu 条，%s 消息，%s 文件，队列 %zu 槽，目标速率 %s\n", options.threads,
+		options.entries, options.mode == "struct" ? "结构化" : "文本", options.format == "binary" ? "二进制" : "文本",
+		stats.ring_capacity, options.rate > 0 ? (std::to_string((long long)options.rate) + " 条/秒").c_str() : "不限");
+	printf("调用 %llu 次，%.1f 秒，%.0f 条/秒\n", (unsigned long long)calls, elapsed, calls / elapsed);
+	printf("调用方耗时 平均 %.0f ns，p50 %u ns，p99 %u ns，p99.9 %u ns，最大 %u ns\n",
+		sum / calls, percentile(0.50), percentile(0.99), percentile(0.999), all.back());
+	// 结束标记的 critical() 也计入入队与写入
+	printf("入队 %llu 条，丢弃 %llu 条（%.2f%%），写入 %llu 条，写文件 %llu 次，%.1f MB\n",
+		(unsigned long long)stats.enqueued, (unsigned long long)stats.dropped,
+		100.0 * stats.dropped / calls, (unsigned long long)stats.written,
+		(unsigned long long)stats.write_calls, stats.bytes_written / (1024.0 * 1024));
+	return stats.written == stats.enqueued ? 0 : 1;
+}
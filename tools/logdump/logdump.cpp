@@ -0,0 +1,174 @@
+// logdump.cpp
+// 把 SystemLogger 的二进制日志（含轮转后压缩的 .gz 分段）转换为文本或 JSON（每行一个对象）
+#include "../../include/logger.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <zlib.h>
+
+namespace {
+	template<typename T>
+	bool read_raw(const std::string& in, size_t& pos, T& value) {
+		if(pos + sizeof(value) > in.size()) {
+			return false;
+		}
+		memcpy(&value, in.data() + pos, sizeof(value));
+		pos += sizeof(value);
+		return true;
+	}
+	
+	std::string json_string(const std::string& text) {
+		std::string out = "\"";
+		for(unsigned char c : text) {
+			if(c == '"' || c == '\\') {
+				out += '\\';
+				out += c;
+			} else if(c == '\n') {
+				out += "\\n";
+			} else if(c == '\t') {
+				out += "\\t";
+			} else if(c < 0x20) {
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				out += escaped;
+			} else {
+				out += c;
+			}
+		}
+		out += '"';
+		return out;
+	}
+	
+	// 数值参数原样输出，非有限的浮点数和字符串按 JSON 字符串输出
+	std::string json_value(const std::pair<char, std::string>& arg) {
+		if(arg.first == 's' || (arg.first == 'd' &&
+		   arg.second.find_first_of("ni") != std::string::npos)) {
+			return json_string(arg.second);
+		}
+		return arg.second;
+	}
+	
+	void usage() {
+		std::cerr << "用法: logdump [--json] <日志文件>" << std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	bool json = false;
+	const char* path = nullptr;
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--json") == 0) {
+			json = true;
+		} else if(!path) {
+			path = argv[i];
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if(!path) {
+		usage();
+		return 2;
+	}
+	
+	// gzread 对未压缩的文件按原样读取
+	gzFile file = gzopen(path, "rb");
+	if(!file) {
+		std::cerr << "无法打开 " << path << std::endl;
+		return 1;
+	}
+	std::string data;
+	char chunk[64 * 1024];
+	int n;
+	while((n = gzread(file, chunk, sizeof(chunk))) > 0) {
+		data.append(chunk, n);
+	}
+	gzclose(file);
+	if(n < 0) {
+		std::cerr << "读取 " << path << " 失败" << std::endl;
+		return 1;
+	}
+	
+	size_t magic_length = strlen(LOG_BINARY_MAGIC);
+	if(data.compare(0, magic_length, LOG_BINARY_MAGIC) != 0) {
+		std::cerr << path << " 不是二进制日志" << std::endl;
+		return 1;
+	}
+	
+	// 同一编号可能被后写入的进程重新定义，以最近一次定义为准
+	std::vector<std::string> formats;
+	size_t pos = magic_length;
+	while(pos < data.size()) {
+		size_t record = pos;
+		char type = data[pos++];
+		
+		if(type == 'F') {
+			uint32_t id;
+			uint16_t length;
+			if(!read_raw(data, pos, id) || !read_raw(data, pos, length) || pos + length > data.size()) {
+				std::cerr << "偏移 " << record << " 处的格式串定义不完整" << std::endl;
+				return 1;
+			}
+			if(id >= formats.size()) {
+				formats.resize(id + 1);
+			}
+			formats[id] = data.substr(pos, length);
+			pos += length;
+			continue;
+		}
+		
+		int64_t timestamp;
+		uint8_t level;
+		uint32_t id;
+		uint16_t source_length;
+		uint16_t args_length;
+		if(type != 'E' || !read_raw(data, pos, timestamp) || !read_raw(data, pos, level) ||
+		   !read_raw(data, pos, id) || !read_raw(data, pos, source_length) ||
+		   !read_raw(data, pos, args_length) || pos + source_length + args_length > data.size()) {
+			std::cerr << "偏移 " << record << " 处的记录损坏" << std::endl;
+			return 1;
+		}
+		std::string source = data.substr(pos, source_length);
+		pos += source_length;
+		SystemLogger::ArgList args;
+		if(!SystemLogger::unpack_args(data.substr(pos, args_length), args)) {
+			std::cerr << "偏移 " << record << " 处的参数损坏" << std::endl;
+			return 1;
+		}
+		pos += args_length;
+		
+		const std::string format = id < formats.size() ? formats[id] : std::string();
+		std::string message = SystemLogger::render(format, args);
+		std::string level_name = SystemLogger::level_to_string(static_cast<SystemLogger::LogLevel>(level));
+		
+		char stamp[32];
+		time_t seconds = static_cast<time_t>(timestamp);
+		struct tm timeinfo;
+		localtime_r(&seconds, &timeinfo);
+		strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &timeinfo);
+		
+		if(json) {
+			std::string args_json;
+			for(const auto& arg : args) {
+				args_json += args_json.empty() ? "" : ",";
+				args_json += json_value(arg);
+			}
+			std::cout << "{\"timestamp\":" << timestamp
+					  << ",\"time\":" << json_string(stamp)
+					  << ",\"level\":" << json_string(level_name)
+					  << ",\"source\":" << json_string(source)
+					  << ",\"format\":" << json_string(format)
+					  << ",\"args\":[" << args_json << "]"
+					  << ",\"message\":" << json_string(message) << "}\n";
+		} else {
+			std::cout << "[" << stamp << "] [" << level_name << "] ";
+			if(!source.empty()) {
+				std::cout << "[" << source << "] ";
+			}
+			std::cout << message << "\n";
+		}
+	}
+	
+	return 0;
+}
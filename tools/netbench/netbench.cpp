@@ -0,0 +1,290 @@
+// netbench.cpp
+// NetworkManager 本机压测：进程内启动回显服务器，若干客户端线程在 127.0.0.1 上
+// 保持指定数量的连接，每个连接一问一答，统计消息速率与往返延迟分位数。
+// 指定 -f 时服务器改为每收到一条请求就从 DiskManager 镜像发回一个文件，
+// 默认经 sendfile 发送，-z 0 时先读出文件再按内存发送以便对比
+#include "../../include/network.h"
+#include "../../include/disk_manager.h"
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+	
+	struct Options {
+		int port = 9090;
+		int connections = 100;
+		int threads = 1;
+		unsigned reactors = 0;      // 服务器反应器线程数，0 表示每个核心一个
+		int seconds = 5;
+		size_t message_size = 64;
+		size_t file_size = 0;       // 大于 0 时服务器以该大小的文件应答
+		bool zero_copy = true;      // 文件经 sendfile 发送，否则读出后按内存发送
+		
+		size_t response_size() const { return file_size ? file_size : message_size; }
+	};
+	
+	struct Connection {
+		int fd;
+		size_t received;            // 本轮已收到的回显字节数
+		Clock::time_point sent_at;
+	};
+	
+	struct ThreadResult {
+		uint64_t messages = 0;
+		uint64_t errors = 0;
+		std::vector<uint32_t> latency_us;
+	};
+	
+	int connect_local(int port) {
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(fd < 0) {
+			return -1;
+		}
+		
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(port);
+		if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+			close(fd);
+			return -1;
+		}
+		
+		int nodelay = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+		return fd;
+	}
+	
+	bool send_all(int fd, const std::string& data) {
+		size_t sent = 0;
+		while(sent < data.size()) {
+			ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+			if(n < 0 && errno == EINTR) continue;
+			if(n <= 0) return false;
+			sent += n;
+		}
+		return true;
+	}
+	
+	// 每个客户端线程用自己的 epoll 驱动一组连接，收齐一条回显后立即发下一条
+	void run_client(const Options& options, int count, const std::atomic<bool>& stop,
+	                ThreadResult& result) {
+		std::string message(options.message_size, 'x');
+		std::vector<Connection> connections;
+		int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		for(int i = 0; i < count; i++) {
+			int fd = connect_local(options.port);
+			if(fd < 0) {
+				result.errors++;
+				continue;
+			}
+			connections.push_back({fd, 0, Clock::now()});
+		}
+		for(size_t i = 0; i < connections.size(); i++) {
+			struct epoll_event event = {};
+			event.events = EPOLLIN;
+			event.data.u64 = i;
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connections[i].fd, &event);
+			connections[i].sent_at = Clock::now();
+			if(!send_all(connections[i].fd, message)) {
+				result.errors++;
+			}
+		}
+		
+		std::vector<char> buffer(64 * 1024);
+		struct epoll_event events[256];
+		while(!stop.load(std::memory_order_relaxed)) {
+			int ready = epoll_wait(epoll_fd, events, 256, 100);
+			for(int i = 0; i < ready; i++) {
+				Connection& conn = connections[events[i].data.u64];
+				ssize_t n = recv(conn.fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+				if(n <= 0) {
+					if(n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+					result.errors++;
+					epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+					continue;
+				}
+				
+				conn.received += n;
+				if(conn.received < options.response_size()) {
+					continue;
+				}
+				auto now = Clock::now();
+				result.messages++;
+				result.latency_us.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+					now - conn.sent_at).count());
+				conn.received -= options.response_size();
+				conn.sent_at = now;
+				if(!send_all(conn.fd, message)) {
+					result.errors++;
+				}
+			}
+		}
+		
+		for(auto& conn : connections) {
+			close(conn.fd);
+		}
+		close(epoll_fd);
+	}
+	
+	void usage() {
+		std::cerr << "用法: netbench [-p 端口] [-c 连接数] [-t 客户端线程数] [-r 反应器数] [-d 秒数] [-s 消息字节数]"
+		          << " [-f 文件字节数] [-z 0|1]"
+		          << std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Options options;
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(i + 1 >= argc) {
+			usage();
+			return 1;
+		}
+		long value = strtol(argv[++i], nullptr, 10);
+		if(arg == "-p") {
+			options.port = value;
+		} else if(arg == "-c") {
+			options.connections = value;
+		} else if(arg == "-t") {
+			options.threads = std::max(1L, value);
+		} else if(arg == "-r") {
+			options.reactors = std::max(0L, value);
+		} else if(arg == "-d") {
+			options.seconds = value;
+		} else if(arg == "-s") {
+			options.message_size = std::max(1L, value);
+		} else if(arg == "-f") {
+			options.file_size = std::max(0L, value);
+		} else if(arg == "-z") {
+			options.zero_copy = value != 0;
+		} else {
+			usage();
+			return 1;
+		}
+	}
+	
+	// 文件模式下在临时镜像中写入一个文件，内容按位置生成以便客户端无需校验也能发现错位
+	const std::string image_path = "netbench.disk";
+	std::unique_ptr<DiskManager> disk;
+	std::string file_content;
+	if(options.file_size > 0) {
+		unlink(image_path.c_str());
+		disk.reset(new DiskManager(image_path, options.file_size * 2 + 16 * 1024 * 1024));
+		file_content.resize(options.file_size);
+		for(size_t i = 0; i < file_content.size(); i++) {
+			file_content[i] = static_cast<char>(i * 131 + 7);
+		}
+		if(!disk->write_file("/payload", file_content)) {
+			std::cerr << "无法写入测试文件" << std::endl;
+			return 1;
+		}
+	}
+	
+	// 回显模式把收到的切片原样发回，不复制字节；文件模式每凑满一条请求发回一次文件
+	NetworkManager server;
+	std::mutex pending_mutex;
+	std::unordered_map<int, size_t> pending;
+	server.set_receive_handler([&](int client_id, const BufferSlice& data) {
+		if(!disk) {
+			server.send_data(client_id, data);
+			return;
+		}
+		size_t requests;
+		{
+			std::lock_guard<std::mutex> lock(pending_mutex);
+			size_t& received = pending[client_id];
+			received += data.size();
+			requests = received / options.message_size;
+			received %= options.message_size;
+		}
+		for(size_t i = 0; i < requests; i++) {
+			if(options.zero_copy) {
+				server.send_disk_file(client_id, *disk, "/payload");
+			} else {
+				server.send_data(client_id, disk->read_file("/payload"));
+			}
+		}
+	});
+	if(!server.start_server(options.port, options.reactors)) {
+		std::cerr << "无法监听端口 " << options.port << std::endl;
+		return 1;
+	}
+	
+	std::atomic<bool> stop(false);
+	std::vector<ThreadResult> results(options.threads);
+	std::vector<std::thread> clients;
+	auto start = Clock::now();
+	for(int t = 0; t < options.threads; t++) {
+		int count = options.connections / options.threads + (t < options.connections % options.threads);
+		clients.emplace_back(run_client, std::cref(options), count, std::cref(stop), std::ref(results[t]));
+	}
+	std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+	stop.store(true);
+	for(auto& client : clients) {
+		client.join();
+	}
+	double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	NetworkManager::NetworkStats server_stats = server.get_stats();
+	server.stop_server();
+	
+	ThreadResult total;
+	for(auto& result : results) {
+		total.messages += result.messages;
+		total.errors += result.errors;
+		total.latency_us.insert(total.latency_us.end(), result.latency_us.begin(), result.latency_us.end());
+	}
+	std::sort(total.latency_us.begin(), total.latency_us.end());
+	auto percentile = [&](double p) -> uint32_t {
+		if(total.latency_us.empty()) return 0;
+		return total.latency_us[std::min(total.latency_us.size() - 1,
+			static_cast<size_t>(p * total.latency_us.size()))];
+	};
+	
+	printf("连接数 %d，客户端线程 %d，反应器 %u，消息 %zu 字节，应答 %zu 字节，时长 %.1f 秒\n",
+		options.connections, options.threads, options.reactors, options.message_size,
+		options.response_size(), elapsed);
+	printf("消息 %llu 条，%.0f 条/秒，%.1f MB/秒，错误 %llu\n",
+		(unsigned long long)total.messages, total.messages / elapsed,
+		total.messages * (options.message_size + options.response_size()) / elapsed / (1024 * 1024),
+		(unsigned long long)total.errors);
+	printf("往返延迟 p50 %u us，p99 %u us，p99.9 %u us，最大 %u us\n",
+		percentile(0.50), percentile(0.99), percentile(0.999),
+		total.latency_us.empty() ? 0 : total.latency_us.back());
+	printf("服务器：接受 %llu 个连接，收 %llu 字节，发 %llu 字节，最近 10 秒接收 %.1f MB/秒\n",
+		(unsigned long long)server_stats.accepted_connections,
+		(unsigned long long)server_stats.total_bytes_received,
+		(unsigned long long)server_stats.total_bytes_sent,
+		server_stats.receive_rate[1] / (1024 * 1024));
+	printf("服务器应答延迟 p50 %.0f us，p99 %.0f us（%llu 次）\n",
+		server_stats.latency_p50_us, server_stats.latency_p99_us,
+		(unsigned long long)server_stats.latency_samples);
+	printf("服务器：sendfile %llu 字节，MSG_ZEROCOPY %llu 字节（回退复制 %llu 次）\n",
+		(unsigned long long)server_stats.sendfile_bytes,
+		(unsigned long long)server_stats.zerocopy_bytes,
+		(unsigned long long)server_stats.zerocopy_copied);
+	printf("服务器：接收缓冲池 %zu 个缓冲，停止前仍在使用 %zu 个\n",
+		server_stats.buffers_allocated, server_stats.buffers_in_use);
+	if(disk) {
+		disk.reset();
+		unlink(image_path.c_str());
+	}
+	return 0;
+}
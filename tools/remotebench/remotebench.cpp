@@ -0,0 +1,423 @@
+// remotebench.cpp
+// 远程管理协议压测：默认在进程内启动 RemoteServer，也可以用 -a 连接已运行的系统。
+// 每个连接保持至多 -q 条未完成的请求，每帧装 -b 条，按 request_id 对应乱序到达的应答，
+// 统计请求速率、单条请求的往返延迟分位数以及服务器端的应答合并情况。
+// 每个连接先以 -u/-k 指定的用户登录，进程内服务器会创建这个用户并授予全部远程权限
+#include "../../include/remote.h"
+#include "../../include/network.h"
+#include "../../include/advanced_kernel.h"
+#include "../../include/disk_manager.h"
+#include "../../include/logger.h"
+#include "../../include/user_auth.h"
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+	
+	struct Options {
+		std::string address;        // 为空时在进程内启动服务器
+		int port = 9191;
+		int connections = 10;
+		int threads = 1;
+		unsigned reactors = 0;
+		unsigned workers = 0;
+		int seconds = 5;
+		uint32_t depth = 64;        // 每个连接未完成的请求上限
+		uint32_t batch = 16;        // 每帧请求数
+		std::string op = "ping";
+		size_t payload = 64;
+		std::string user = "bench";
+		std::string password = "bench";
+	};
+	
+	struct Connection {
+		int fd;
+		std::string input;
+		uint32_t next_id;
+		std::map<uint32_t, Clock::time_point> pending;    // 按 request_id 排序，首项为最早的未完成请求
+	};
+	
+	struct ThreadResult {
+		uint64_t requests = 0;
+		uint64_t frames = 0;
+		uint64_t out_of_order = 0;  // 早于更小 request_id 到达的应答数
+		uint64_t busy = 0;
+		uint64_t errors = 0;
+		std::vector<uint32_t> latency_us;
+	};
+	
+	int connect_to(const std::string& address, int port) {
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(fd < 0) {
+			return -1;
+		}
+		
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		if(address.empty()) {
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		} else if(inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+			close(fd);
+			return -1;
+		}
+		if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+			close(fd);
+			return -1;
+		}
+		
+		int nodelay = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+		return fd;
+	}
+	
+	bool send_all(int fd, const std::string& data) {
+		size_t sent = 0;
+		while(sent < data.size()) {
+			ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+			if(n < 0 && errno == EINTR) continue;
+			if(n <= 0) return false;
+			sent += n;
+		}
+		return true;
+	}
+	
+	// 在连接仍是阻塞模式时同步登录，成功后才开始流水线
+	bool login(const Options& options, int fd) {
+		std::string body;
+		remote_put_u16(body, options.user.size());
+		body += options.user + options.password;
+		RemoteFrameBuilder builder;
+		builder.add(0, static_cast<uint16_t>(RemoteOp::LOGIN), body);
+		if(!send_all(fd, builder.finish())) {
+			return false;
+		}
+		
+		std::string input;
+		std::vector<RemoteRecord> records;
+		char buffer[256];
+		while(true) {
+			size_t frame_size;
+			int parsed = remote_parse_frame(input.data(), input.size(), frame_size, records);
+			if(parsed < 0) {
+				return false;
+			}
+			if(parsed > 0) {
+				return records.size() == 1 && records[0].code == static_cast<uint16_t>(RemoteStatus::OK);
+			}
+			ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+			if(n < 0 && errno == EINTR) continue;
+			if(n <= 0) return false;
+			input.append(buffer, n);
+		}
+	}
+	
+	// 按 -o 选择的操作构造一条请求的操作码与 body
+	bool make_request(const Options& options, int index, uint16_t& op, std::string& body) {
+		body.clear();
+		if(options.op == "ping") {
+			op = static_cast<uint16_t>(RemoteOp::PING);
+			body.assign(options.payload, 'p');
+		} else if(options.op == "cmd") {
+			op = static_cast<uint16_t>(RemoteOp::KERNEL_COMMAND);
+			body = "mem";
+		} else if(options.op == "read") {
+			op = static_cast<uint16_t>(RemoteOp::DISK_READ);
+			body = "/bench.dat";
+		} else if(options.op == "write") {
+			op = static_cast<uint16_t>(RemoteOp::DISK_WRITE);
+			std::string name = "/bench-" + std::to_string(index) + ".dat";
+			remote_put_u16(body, name.size());
+			body += name;
+			body.append(options.payload, 'w');
+		} else if(options.op == "log") {
+			op = static_cast<uint16_t>(RemoteOp::LOG_SEARCH);
+			remote_put_u32(body, LOG_ALL_LEVELS);
+			remote_put_u32(body, 10);
+			body += "bench";
+		} else {
+			return false;
+		}
+		return true;
+	}
+	
+	bool send_frame(const Options& options, Connection& conn, uint16_t op, const std::string& body) {
+		RemoteFrameBuilder builder;
+		auto now = Clock::now();
+		for(uint32_t i = 0; i < options.batch; i++) {
+			conn.pending[conn.next_id] = now;
+			builder.add(conn.next_id++, op, body);
+		}
+		return send_all(conn.fd, builder.finish());
+	}
+	
+	void run_client(const Options& options, int first, int count, const std::atomic<bool>& stop,
+	                ThreadResult& result) {
+		std::vector<Connection> connections;
+		std::vector<std::pair<uint16_t, std::string>> requests;
+		int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		for(int i = 0; i < count; i++) {
+			int fd = connect_to(options.address, options.port);
+			if(fd >= 0 && !login(options, fd)) {
+				close(fd);
+				fd = -1;
+			}
+			if(fd < 0) {
+				result.errors++;
+				continue;
+			}
+			connections.push_back({fd, std::string(), 1, {}});
+			requests.emplace_back();
+			make_request(options, first + i, requests.back().first, requests.back().second);
+		}
+		
+		// 先把每个连接的流水线填满
+		for(size_t i = 0; i < connections.size(); i++) {
+			struct epoll_event event = {};
+			event.events = EPOLLIN;
+			event.data.u64 = i;
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connections[i].fd, &event);
+			while(connections[i].pending.size() + options.batch <= options.depth) {
+				if(!send_frame(options, connections[i], requests[i].first, requests[i].second)) {
+					result.errors++;
+					break;
+				}
+			}
+		}
+		
+		std::vector<char> buffer(256 * 1024);
+		std::vector<RemoteRecord> records;
+		struct epoll_event events[256];
+		while(!stop.load(std::memory_order_relaxed)) {
+			int ready = epoll_wait(epoll_fd, events, 256, 100);
+			for(int i = 0; i < ready; i++) {
+				size_t index = events[i].data.u64;
+				Connection& conn = connections[index];
+				ssize_t n = recv(conn.fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+				if(n <= 0) {
+					if(n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+					result.errors++;
+					epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+					continue;
+				}
+				
+				conn.input.append(buffer.data(), n);
+				size_t consumed = 0;
+				size_t frame_size = 0;
+				int parsed;
+				auto now = Clock::now();
+				while((parsed = remote_parse_frame(conn.input.data() + consumed, conn.input.size() - consumed,
+				                                   frame_size, records)) > 0) {
+					consumed += frame_size;
+					result.frames++;
+					for(const auto& record : records) {
+						auto it = conn.pending.find(record.request_id);
+						if(it == conn.pending.end()) {
+							result.errors++;
+							continue;
+						}
+						// 还有更早的请求未完成，说明这条应答越过了它们
+						if(conn.pending.begin()->first < record.request_id) {
+							result.out_of_order++;
+						}
+						result.latency_us.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+							now - it->second).count());
+						conn.pending.erase(it);
+						if(record.code == static_cast<uint16_t>(RemoteStatus::OK)) {
+							result.requests++;
+						} else if(record.code == static_cast<uint16_t>(RemoteStatus::BUSY)) {
+							result.busy++;
+						} else {
+							result.errors++;
+						}
+					}
+				}
+				if(parsed < 0) {
+					result.errors++;
+					epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+					continue;
+				}
+				conn.input.erase(0, consumed);
+				
+				while(conn.pending.size() + options.batch <= options.depth) {
+					if(!send_frame(options, conn, requests[index].first, requests[index].second)) {
+						result.errors++;
+						break;
+					}
+				}
+			}
+		}
+		
+		for(auto& conn : connections) {
+			close(conn.fd);
+		}
+		close(epoll_fd);
+	}
+	
+	void usage() {
+		std::cerr << "用法: remotebench [-a 地址] [-p 端口] [-c 连接数] [-t 客户端线程数] [-r 反应器数]"
+		          << " [-w 工作线程数] [-d 秒数] [-q 流水线深度] [-b 每帧请求数]"
+		          << " [-o ping|cmd|read|write|log] [-s 负载字节数] [-u 用户名] [-k 密码]" << std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Options options;
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(i + 1 >= argc) {
+			usage();
+			return 1;
+		}
+		std::string text = argv[++i];
+		long value = strtol(text.c_str(), nullptr, 10);
+		if(arg == "-a") {
+			options.address = text;
+		} else if(arg == "-p") {
+			options.port = value;
+		} else if(arg == "-c") {
+			options.connections = value;
+		} else if(arg == "-t") {
+			options.threads = std::max(1L, value);
+		} else if(arg == "-r") {
+			options.reactors = std::max(0L, value);
+		} else if(arg == "-w") {
+			options.workers = std::max(0L, value);
+		} else if(arg == "-d") {
+			options.seconds = value;
+		} else if(arg == "-q") {
+			options.depth = std::max(1L, value);
+		} else if(arg == "-b") {
+			options.batch = std::max(1L, value);
+		} else if(arg == "-o") {
+			options.op = text;
+		} else if(arg == "-s") {
+			options.payload = std::max(0L, value);
+		} else if(arg == "-u") {
+			options.user = text;
+		} else if(arg == "-k") {
+			options.password = text;
+		} else {
+			usage();
+			return 1;
+		}
+	}
+	uint16_t op;
+	std::string body;
+	if(!make_request(options, 0, op, body)) {
+		usage();
+		return 1;
+	}
+	options.depth = std::max(options.depth, options.batch);
+	
+	// 进程内服务器使用临时的镜像与日志文件，结束后删除
+	const std::string image_path = "remotebench.disk";
+	const std::string log_path = "remotebench.log";
+	std::unique_ptr<NetworkManager> network;
+	std::unique_ptr<AdvancedKernel> kernel;
+	std::unique_ptr<DiskManager> disk;
+	std::unique_ptr<SystemLogger> logger;
+	std::unique_ptr<UserAuth> auth;
+	std::unique_ptr<RemoteServer> server;
+	if(options.address.empty()) {
+		unlink(image_path.c_str());
+		network.reset(new NetworkManager);
+		kernel.reset(new AdvancedKernel);
+		disk.reset(new DiskManager(image_path, 256 * 1024 * 1024));
+		logger.reset(new SystemLogger(log_path));
+		disk->write_file("/bench.dat", std::string(options.payload, 'r'));
+		for(int i = 0; i < 1000; i++) {
+			SLOGF_INFO(*logger, "remotebench", "bench entry {} of the remote protocol benchmark", i);
+		}
+		logger->flush();
+		auth.reset(new UserAuth);
+		auth->add_user(options.user, options.password);
+		for(const char* permission : {REMOTE_PERM_KERNEL, REMOTE_PERM_DISK_READ, REMOTE_PERM_DISK_WRITE,
+		                              REMOTE_PERM_LOG}) {
+			auth->add_permission(options.user, permission);
+		}
+		
+		server.reset(new RemoteServer(*network, *kernel, *disk, *logger, *auth));
+		server->start(options.workers);
+		if(!network->start_server(options.port, options.reactors)) {
+			std::cerr << "无法监听端口 " << options.port << std::endl;
+			return 1;
+		}
+	}
+	
+	std::atomic<bool> stop(false);
+	std::vector<ThreadResult> results(options.threads);
+	std::vector<std::thread> clients;
+	auto start = Clock::now();
+	int first = 0;
+	for(int t = 0; t < options.threads; t++) {
+		int count = options.connections / options.threads + (t < options.connections % options.threads);
+		clients.emplace_back(run_client, std::cref(options), first, count, std::cref(stop), std::ref(results[t]));
+		first += count;
+	}
+	std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+	stop.store(true);
+	for(auto& client : clients) {
+		client.join();
+	}
+	double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	
+	ThreadResult total;
+	for(auto& result : results) {
+		total.requests += result.requests;
+		total.frames += result.frames;
+		total.out_of_order += result.out_of_order;
+		total.busy += result.busy;
+		total.errors += result.errors;
+		total.latency_us.insert(total.latency_us.end(), result.latency_us.begin(), result.latency_us.end());
+	}
+	std::sort(total.latency_us.begin(), total.latency_us.end());
+	auto percentile = [&](double p) -> uint32_t {
+		if(total.latency_us.empty()) return 0;
+		return total.latency_us[std::min(total.latency_us.size() - 1,
+			static_cast<size_t>(p * total.latency_us.size()))];
+	};
+	
+	printf("操作 %s，连接数 %d，流水线深度 %u，每帧 %u 条，负载 %zu 字节，时长 %.1f 秒\n",
+		options.op.c_str(), options.connections, options.depth, options.batch, options.payload, elapsed);
+	printf("完成请求 %llu 条，%.0f 条/秒，收到应答帧 %llu 个，乱序应答 %llu 条，BUSY %llu，错误 %llu\n",
+		(unsigned long long)total.requests, total.requests / elapsed, (unsigned long long)total.frames,
+		(unsigned long long)total.out_of_order, (unsigned long long)total.busy,
+		(unsigned long long)total.errors);
+	printf("请求往返延迟 p50 %u us，p99 %u us，p99.9 %u us，最大 %u us\n",
+		percentile(0.50), percentile(0.99), percentile(0.999),
+		total.latency_us.empty() ? 0 : total.latency_us.back());
+	
+	if(server) {
+		network->stop_server();
+		server->stop();
+		RemoteServer::Stats stats = server->get_stats();
+		printf("服务器：收到 %llu 帧 %llu 条请求，发出 %llu 帧 %llu 条应答（平均每帧 %.1f 条），"
+			"协议错误 %llu，拒绝 %llu\n",
+			(unsigned long long)stats.frames_received, (unsigned long long)stats.requests,
+			(unsigned long long)stats.frames_sent, (unsigned long long)stats.responses,
+			stats.frames_sent ? (double)stats.responses / stats.frames_sent : 0.0,
+			(unsigned long long)stats.protocol_errors, (unsigned long long)stats.denied);
+		server.reset();
+		logger.reset();
+		disk.reset();
+		unlink(image_path.c_str());
+		unlink(log_path.c_str());
+	}
+	return 0;
+}